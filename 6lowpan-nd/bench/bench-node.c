@@ -0,0 +1,177 @@
+/**
+ * \file
+ *         One node of the benchmark: the stack, driven through a
+ *         uip_ds6_instance_t. Built once as a host and once as a router
+ *         (UIP_CONF_ROUTER), see the Makefile.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "nd-opt/uip-nd6.h"
+#include "nd-opt/uip-ds6.h"
+#include "bench-node.h"
+
+#if !UIP_DS6_INSTANCES || !UIP_DS6_CONV_STATS
+#error "The benchmark needs UIP_DS6_CONF_INSTANCES and UIP_DS6_CONF_CONV_STATS"
+#endif
+
+/* Same network as the native router of 6lowpan-nd/native */
+#define PREFIX_LIFETIME 0xffffffff /* infinite */
+#define ABR_LIFETIME    10000      /* minutes */
+#define CONTEXT_LIFETIME 60        /* minutes */
+
+/* Ticks to ms, as uip_ds6_conv_json() */
+#define CONV_MS(t) ((unsigned long)((t) / CLOCK_SECOND) * 1000 + \
+                    (unsigned long)((t) % CLOCK_SECOND) * 1000 / CLOCK_SECOND)
+
+/*---------------------------------------------------------------------------*/
+static u8_t
+output(uip_lladdr_t *lladdr)
+{
+  bench_send(&uip_buf[UIP_LLH_LEN], uip_len,
+             lladdr != NULL ? lladdr->addr : NULL);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+node_new(const u8_t *lladdr)
+{
+  static u8_t initialized;
+  uip_ds6_instance_t *inst;
+
+  if(!initialized) {
+    initialized = 1;
+    tcpip_set_outputfunc(output);
+  }
+  inst = calloc(1, sizeof(uip_ds6_instance_t));
+  if(inst != NULL) {
+    memcpy(&inst->lladdr, lladdr, UIP_LLADDR_LEN);
+  }
+  return inst;
+}
+/*---------------------------------------------------------------------------*/
+static void
+boot(void *node)
+{
+#if UIP_CONF_ROUTER
+  uip_ipaddr_t ipaddr;
+#endif /* UIP_CONF_ROUTER */
+
+  uip_ds6_instance_select(node);
+  uip_ds6_init();
+#if UIP_CONF_ROUTER
+  /* Every router is a 6LBR: registrations are checked locally */
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_prefix_add(&ipaddr, 64, 1,
+                     UIP_ND6_RA_FLAG_ONLINK | UIP_ND6_RA_FLAG_AUTONOMOUS,
+                     PREFIX_LIFETIME, PREFIX_LIFETIME);
+#if CONF_6LOWPAN_ND_6CO
+  uip_ds6_context_set(0, &ipaddr, 64, CONTEXT_LIFETIME, 1);
+#endif /* CONF_6LOWPAN_ND_6CO */
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_MANUAL);
+#if CONF_6LOWPAN_ND_ABRO
+  uip_ds6_abr_update(&ipaddr, 1, ABR_LIFETIME);
+#endif /* CONF_6LOWPAN_ND_ABRO */
+#endif /* UIP_CONF_ROUTER */
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+deadline(void *node)
+{
+  uip_ds6_instance_select(node);
+  return etimer_expiration_time(&uip_ds6_timer_periodic);
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(void *node)
+{
+  uip_ds6_instance_select(node);
+  uip_ds6_periodic();
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void *node, const u8_t *pkt, u16_t len, const u8_t *from, int16_t rssi)
+{
+  uip_ds6_instance_select(node);
+#if UIP_DS6_LINK_ESTIMATOR
+  uip_ds6_link_received((uip_lladdr_t *)from, rssi);
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+  if(len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    return;
+  }
+  /* As tcpip_input() */
+  memcpy(&uip_buf[UIP_LLH_LEN], pkt, len);
+  uip_len = len;
+  uip_input();
+  if(uip_len > 0) {
+    tcpip_ipv6_output();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+sent(void *node, const u8_t *to, u8_t acked, u8_t transmissions)
+{
+#if UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD
+  uip_ds6_instance_select(node);
+  uip_ds6_link_sent((uip_lladdr_t *)to, acked, transmissions);
+#endif /* UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD */
+}
+/*---------------------------------------------------------------------------*/
+static void
+conv(void *node, bench_conv_t *c)
+{
+  uip_ds6_conv_stats_t *s;
+  u8_t i;
+
+  uip_ds6_instance_select(node);
+  s = &uip_ds6_conv_stats;
+  c->first_reg_ms = s->registered ? (long)CONV_MS(s->first_reg) : -1L;
+  c->refreshes = s->refreshes;
+  c->losses = s->losses;
+  c->recovering = s->recovering;
+  c->recovery_last_ms = CONV_MS(s->recovery_last);
+  c->recovery_max_ms = CONV_MS(s->recovery_max);
+  for(i = 0; i < BENCH_ND_KINDS && i < UIP_ND6_STATS_TYPES; i++) {
+    c->pkts[i] = s->tx[i].pkts;
+    c->bytes[i] = s->tx[i].bytes;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_ROUTER
+const bench_side_t bench_router_side = {
+#else /* UIP_CONF_ROUTER */
+const bench_side_t bench_host_side = {
+#endif /* UIP_CONF_ROUTER */
+  node_new, boot, deadline, periodic, input, sent, conv
+};
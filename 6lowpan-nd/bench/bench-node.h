@@ -0,0 +1,87 @@
+/**
+ * \file
+ *         Entry points of the benchmark driver into the stack. The stack is
+ *         built twice, as a host and as a router; bench-node.c is the only
+ *         part of each build visible from the driver, under the
+ *         bench_host_ and bench_router_ prefixes.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#ifndef __BENCH_NODE_H__
+#define __BENCH_NODE_H__
+
+#include "contiki.h"
+
+/* Same as UIP_ND6_STATS_TYPES: rs, ra, ns, na, dar, dac */
+#define BENCH_ND_KINDS 6
+
+/** \brief The convergence metrics of a node (uip_ds6_conv_stats_t) */
+typedef struct bench_conv {
+  long first_reg_ms;              /**< -1 if not registered yet */
+  unsigned long refreshes;
+  unsigned losses;
+  unsigned recovering;            /**< addresses yet to register again */
+  unsigned long recovery_last_ms;
+  unsigned long recovery_max_ms;
+  unsigned long pkts[BENCH_ND_KINDS];
+  unsigned long bytes[BENCH_ND_KINDS];
+} bench_conv_t;
+
+/**
+ * \brief One build of the stack. A node is an instance of it
+ * (uip_ds6_instance_t), known to the driver as a void pointer.
+ */
+typedef struct bench_side {
+  /** Allocate a node with link layer address lladdr (UIP_LLADDR_LEN bytes) */
+  void *(* node_new)(const u8_t *lladdr);
+  /** Power up the node, or reboot it: all its state is lost */
+  void (* boot)(void *node);
+  /** When uip_ds6_periodic() must run next */
+  clock_time_t (* deadline)(void *node);
+  void (* periodic)(void *node);
+  /** An IPv6 packet from the node with link layer address from */
+  void (* input)(void *node, const u8_t *pkt, u16_t len, const u8_t *from,
+                 int16_t rssi);
+  /** Outcome of the unicast transmission of the node to to */
+  void (* sent)(void *node, const u8_t *to, u8_t acked, u8_t transmissions);
+  void (* conv)(void *node, bench_conv_t *conv);
+} bench_side_t;
+
+extern const bench_side_t bench_host_side;
+extern const bench_side_t bench_router_side;
+
+/**
+ * \brief Provided by the driver: the current node sends the IPv6 packet
+ * pkt to the node with link layer address to, or to all its neighbors if
+ * to is NULL. The packet must be copied, it is only queued.
+ */
+void bench_send(const u8_t *pkt, u16_t len, const u8_t *to);
+
+#endif /* __BENCH_NODE_H__ */
@@ -0,0 +1,61 @@
+/**
+ * \file
+ *         Configuration of the benchmark. It takes the place of the one
+ *         of the native platform: time is virtual, in ms ticks.
+ */
+#ifndef __CONTIKI_CONF_H__
+#define __CONTIKI_CONF_H__
+
+#include <stdint.h>
+
+#define CCIF
+#define CLIF
+
+typedef uint8_t   u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int32_t  s32_t;
+typedef unsigned short uip_stats_t;
+
+typedef unsigned long clock_time_t;
+#define CLOCK_CONF_SECOND 1000
+
+#define UIP_CONF_IPV6 1
+#define UIP_CONF_BYTE_ORDER UIP_LITTLE_ENDIAN
+#define UIP_CONF_LL_802154 1
+#define UIP_CONF_LLH_LEN 0
+#define RIMEADDR_CONF_SIZE 8
+#define UIP_CONF_BUFFER_SIZE 1300
+#define UIP_CONF_UDP 1
+#define UIP_CONF_TCP 0
+#define UIP_CONF_IPV6_QUEUE_PKT 0
+#define UIP_CONF_IPV6_REASSEMBLY 0
+#define UIP_CONF_STATISTICS 0
+#define UIP_CONF_LOGGING 0
+
+#define CONF_6LOWPAN_ND_6CO 1
+#define CONF_6LOWPAN_ND_ABRO 1
+#define UIP_CONF_ND6_MULTIHOP_DAD 1
+#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 4
+/* No 6LoWPAN layer: the driver carries IPv6 packets */
+#define SICSLOWPAN_CONF_FRAG 0
+
+#define UIP_DS6_CONF_INSTANCES 1
+#define UIP_DS6_CONF_CONV_STATS 1
+/* The packet pool of uip-packetqueue.c would be shared by all the nodes */
+#define UIP_DS6_CONF_QUEUE_NB 0
+
+/* A router keeps an NCE and a 6LBR entry per host in range */
+#ifndef BENCH_CONF_ROUTER_HOSTS
+#define BENCH_CONF_ROUTER_HOSTS 128
+#endif
+#if UIP_CONF_ROUTER
+#define UIP_CONF_DS6_NBR_NBU BENCH_CONF_ROUTER_HOSTS
+#define UIP_DS6_CONF_LBR_REG_NB BENCH_CONF_ROUTER_HOSTS
+#define UIP_DS6_CONF_DAD_NB 16
+#else /* UIP_CONF_ROUTER */
+#define UIP_CONF_DS6_NBR_NBU 8
+#define UIP_CONF_DS6_DEFRT_NBU 4
+#endif /* UIP_CONF_ROUTER */
+
+#endif /* __CONTIKI_CONF_H__ */
@@ -0,0 +1,769 @@
+/**
+ * \file
+ *         Discrete-event convergence benchmark of the 6LoWPAN-ND stack.
+ *
+ *         Hosts and routers are instances of the stack (uip_ds6_instance_t)
+ *         in one process. Routers sit on a grid, hosts at random; two nodes
+ *         closer than the radio range have a link whose loss grows with
+ *         the distance. Time is virtual: the driver runs uip_ds6_periodic()
+ *         at the deadline each node asks for, and carries the IPv6 packets
+ *         the nodes send to their neighbors, with 802.15.4 airtime, loss,
+ *         ACKs and retransmissions. Halfway through, a router reboots.
+ *
+ *         The result, on stdout, is a JSON object: time to the first
+ *         registration of the hosts, ND bytes sent until all of them are
+ *         registered, refresh overhead per node-hour after that, and
+ *         recovery of the hosts of the rebooted router.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "contiki.h"
+#include "lib/random.h"
+#include "bench-node.h"
+
+#define RANGE          100.0 /* m */
+#define ROUTER_SPACING (0.8 * RANGE)
+#define EDGE_LOSS      50    /* % at the edge of the range */
+#define MAX_TX         3     /* transmissions of a unicast frame */
+#define ACK_TICKS      1     /* ACK turnaround and airtime */
+
+static const char *kind_names[BENCH_ND_KINDS] = {
+  "rs", "ra", "ns", "na", "dar", "dac"
+};
+
+struct link {
+  u32_t to;
+  u8_t loss;    /**< % of the frames lost */
+  int16_t rssi;
+};
+
+struct node {
+  const bench_side_t *side;
+  void *inst;
+  u8_t lladdr[8];
+  double x, y;
+  struct link *links;
+  u32_t nlinks;
+  u8_t up;
+  u8_t is_host;
+  clock_time_t timer_at;  /**< uip_ds6_periodic() scheduled at */
+  u32_t timer_gen;        /**< timer events of other generations are stale */
+  long first_reg_ms;      /**< -1 until the host registers */
+  /* Router reboot */
+  u8_t watch;             /**< waiting for the host to recover */
+  unsigned losses;        /**< its losses when the router went down */
+  long recovered_ms;      /**< after the reboot, -1 if not recovered */
+};
+
+struct packet {
+  u32_t refs;
+  u16_t len;
+  u8_t data[1];
+};
+
+enum { EV_TIMER, EV_FRAME, EV_SENT, EV_DOWN, EV_UP };
+
+struct event {
+  clock_time_t time;
+  u32_t seq;     /**< FIFO order among events of the same time */
+  u8_t type;
+  u8_t acked;
+  u8_t tx;
+  u32_t node;
+  u32_t from;
+  u32_t gen;
+  u8_t to[8];
+  struct packet *pkt;
+};
+
+static struct node *nodes;
+static u32_t nb_nodes, nb_hosts, nb_routers;
+static u32_t cur;                 /* the node the stack runs for */
+
+static struct event *heap;
+static u32_t heap_n, heap_size, heap_seq;
+
+static clock_time_t now;
+static unsigned long long rng = 88172645463325252ULL;
+static unsigned long events;
+
+/* Options */
+static unsigned long duration = 3 * 3600;  /* s */
+static unsigned long reboot_at = 2 * 3600; /* s, 0: no reboot */
+static unsigned long down_time = 300;      /* s */
+static long reboot_router = -1;
+static unsigned base_loss = 5;             /* % */
+
+/* Results */
+static u32_t registered;
+static long steady_ms = -1;     /* all the hosts are registered */
+static unsigned long steady_bytes[BENCH_ND_KINDS];
+/* Refresh window: from the steady state to the reboot, or to the end */
+static clock_time_t window_start;
+static unsigned long window_start_refreshes, window_start_bytes;
+static unsigned long window_refreshes, window_bytes;
+static double window_hours;
+
+/*---------------------------------------------------------------------------*/
+/* Virtual time, in place of the clock and etimer modules */
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+
+unsigned long
+clock_seconds(void)
+{
+  return now / CLOCK_SECOND;
+}
+
+/* The timers of the nodes are never run by etimer_process: the driver
+ * reads the deadline of each one with etimer_expiration_time() */
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  timer_set(&et->timer, interval);
+  et->p = PROCESS_CURRENT();
+}
+
+void
+etimer_reset(struct etimer *et)
+{
+  timer_reset(&et->timer);
+}
+
+void
+etimer_restart(struct etimer *et)
+{
+  timer_restart(&et->timer);
+}
+
+clock_time_t
+etimer_expiration_time(struct etimer *et)
+{
+  return et->timer.start + et->timer.interval;
+}
+
+int
+etimer_expired(struct etimer *et)
+{
+  return timer_expired(&et->timer);
+}
+
+void
+etimer_stop(struct etimer *et)
+{
+  timer_set(&et->timer, 0);
+}
+/*---------------------------------------------------------------------------*/
+/* xorshift64*: the draws of the driver do not disturb random_rand() */
+static u32_t
+draw(void)
+{
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return (u32_t)((rng * 2685821657736338717ULL) >> 32);
+}
+
+static double
+draw_unit(void)
+{
+  return draw() / 4294967296.0;
+}
+
+static int
+lost(u8_t loss)
+{
+  return draw() % 100 < loss;
+}
+/*---------------------------------------------------------------------------*/
+static int
+event_before(struct event *a, struct event *b)
+{
+  if(a->time != b->time) {
+    return (long)(a->time - b->time) < 0;
+  }
+  return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static struct event *
+event_new(u8_t type, clock_time_t time, u32_t node)
+{
+  struct event *e;
+
+  if(heap_n == heap_size) {
+    heap_size = heap_size ? heap_size * 2 : 1024;
+    heap = realloc(heap, heap_size * sizeof(struct event));
+    if(heap == NULL) {
+      fprintf(stderr, "nd-bench: out of memory\n");
+      exit(1);
+    }
+  }
+  e = &heap[heap_n];
+  memset(e, 0, sizeof(*e));
+  e->type = type;
+  e->time = time;
+  e->seq = heap_seq++;
+  e->node = node;
+  return e;
+}
+
+/* Called once the event event_new() returned is filled */
+static void
+event_push(void)
+{
+  u32_t i = heap_n++, parent;
+  struct event e = heap[i];
+
+  while(i > 0) {
+    parent = (i - 1) / 2;
+    if(!event_before(&e, &heap[parent])) {
+      break;
+    }
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = e;
+}
+
+static void
+event_pop(struct event *out)
+{
+  u32_t i = 0, child;
+  struct event last;
+
+  *out = heap[0];
+  last = heap[--heap_n];
+  while((child = 2 * i + 1) < heap_n) {
+    if(child + 1 < heap_n && event_before(&heap[child + 1], &heap[child])) {
+      child++;
+    }
+    if(!event_before(&heap[child], &last)) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_release(struct packet *p)
+{
+  if(p != NULL && --p->refs == 0) {
+    free(p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_lladdr(u8_t *lladdr, u32_t i)
+{
+  u32_t id = i + 1;
+
+  memset(lladdr, 0, 8);
+  lladdr[0] = 0x02;
+  lladdr[3] = 0xff;
+  lladdr[4] = 0xfe;
+  lladdr[5] = id >> 16;
+  lladdr[6] = id >> 8;
+  lladdr[7] = id;
+}
+
+static struct node *
+node_of(const u8_t *lladdr)
+{
+  u32_t id;
+
+  if(lladdr[0] != 0x02 || lladdr[3] != 0xff || lladdr[4] != 0xfe) {
+    return NULL;
+  }
+  id = (u32_t)lladdr[5] << 16 | lladdr[6] << 8 | lladdr[7];
+  return id >= 1 && id <= nb_nodes ? &nodes[id - 1] : NULL;
+}
+
+static struct link *
+link_to(struct node *n, u32_t to)
+{
+  u32_t i;
+
+  for(i = 0; i < n->nlinks; i++) {
+    if(n->links[i].to == to) {
+      return &n->links[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Frame airtime at 250 kbit/s, with the 802.15.4 header, in ticks */
+static clock_time_t
+airtime(u16_t len)
+{
+  return 1 + ((clock_time_t)len + 21) * 32 * CLOCK_SECOND / 1000000;
+}
+
+void
+bench_send(const u8_t *pkt, u16_t len, const u8_t *to)
+{
+  struct node *n = &nodes[cur], *dest;
+  struct packet *p;
+  struct event *e;
+  struct link *l;
+  clock_time_t t = now + airtime(len);
+  u32_t i;
+  u8_t tx, acked = 0, delivered = 0;
+
+  if(!n->up) {
+    return;
+  }
+  p = malloc(sizeof(struct packet) + len);
+  if(p == NULL) {
+    return;
+  }
+  p->refs = 1;
+  p->len = len;
+  memcpy(p->data, pkt, len);
+
+  if(to == NULL) {
+    for(i = 0; i < n->nlinks; i++) {
+      if(!lost(n->links[i].loss)) {
+        e = event_new(EV_FRAME, t, n->links[i].to);
+        e->from = cur;
+        e->pkt = p;
+        p->refs++;
+        event_push();
+      }
+    }
+    packet_release(p);
+    return;
+  }
+
+  /* Unicast: retransmitted until acked, as by the MAC */
+  dest = node_of(to);
+  l = dest != NULL ? link_to(n, dest - nodes) : NULL;
+  for(tx = 1; tx <= MAX_TX; tx++) {
+    if(l == NULL || !dest->up || lost(l->loss)) {
+      continue;
+    }
+    if(!delivered) {
+      delivered = 1;
+      e = event_new(EV_FRAME, now + tx * (airtime(len) + ACK_TICKS) - ACK_TICKS,
+                    dest - nodes);
+      e->from = cur;
+      e->pkt = p;
+      p->refs++;
+      event_push();
+    }
+    if(!lost(l->loss)) {
+      acked = 1;
+      break;
+    }
+  }
+  if(tx > MAX_TX) {
+    tx = MAX_TX;
+  }
+  e = event_new(EV_SENT, now + tx * (airtime(len) + ACK_TICKS), cur);
+  memcpy(e->to, to, sizeof(e->to));
+  e->acked = acked;
+  e->tx = tx;
+  event_push();
+  packet_release(p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+totals(unsigned long *bytes, unsigned long *refreshes)
+{
+  bench_conv_t c;
+  u32_t i;
+  u8_t k;
+
+  memset(bytes, 0, BENCH_ND_KINDS * sizeof(unsigned long));
+  *refreshes = 0;
+  for(i = 0; i < nb_nodes; i++) {
+    nodes[i].side->conv(nodes[i].inst, &c);
+    for(k = 0; k < BENCH_ND_KINDS; k++) {
+      bytes[k] += c.bytes[k];
+    }
+    if(nodes[i].is_host) {
+      *refreshes += c.refreshes;
+    }
+  }
+}
+
+static unsigned long
+sum(unsigned long *bytes)
+{
+  unsigned long s = 0;
+  u8_t k;
+
+  for(k = 0; k < BENCH_ND_KINDS; k++) {
+    s += bytes[k];
+  }
+  return s;
+}
+/*---------------------------------------------------------------------------*/
+/* Schedule uip_ds6_periodic() of node i, and note its progress */
+static void
+after_call(u32_t i)
+{
+  struct node *n = &nodes[i];
+  clock_time_t deadline;
+  struct event *e;
+  bench_conv_t c;
+  unsigned long refreshes;
+
+  deadline = n->side->deadline(n->inst);
+  if(deadline != n->timer_at) {
+    n->timer_at = deadline;
+    n->timer_gen++;
+    e = event_new(EV_TIMER, (long)(deadline - now) > 0 ? deadline : now, i);
+    e->gen = n->timer_gen;
+    event_push();
+  }
+
+  if(!n->is_host || (n->first_reg_ms >= 0 && !n->watch)) {
+    return;
+  }
+  n->side->conv(n->inst, &c);
+  if(n->first_reg_ms < 0 && c.first_reg_ms >= 0) {
+    n->first_reg_ms = c.first_reg_ms;
+    if(++registered == nb_hosts) {
+      steady_ms = now * 1000 / CLOCK_SECOND;
+      totals(steady_bytes, &refreshes);
+      window_start = now;
+      window_start_refreshes = refreshes;
+      window_start_bytes = sum(steady_bytes);
+    }
+  }
+  if(n->watch && c.losses > n->losses && c.recovering == 0) {
+    n->watch = 0;
+    n->recovered_ms = (long)(now - reboot_at * CLOCK_SECOND) * 1000 / CLOCK_SECOND;
+  }
+}
+
+static void
+window_end(void)
+{
+  unsigned long bytes[BENCH_ND_KINDS], refreshes;
+
+  if(steady_ms < 0 || window_hours > 0) {
+    return;
+  }
+  totals(bytes, &refreshes);
+  window_hours = (double)(now - window_start) / CLOCK_SECOND / 3600;
+  window_refreshes = refreshes - window_start_refreshes;
+  window_bytes = sum(bytes) - window_start_bytes;
+}
+/*---------------------------------------------------------------------------*/
+static void
+topology(void)
+{
+  u32_t i, j, grid;
+  double side, dx, dy, d;
+  struct node *a, *b;
+  struct link *l;
+
+  grid = (u32_t)ceil(sqrt(nb_routers));
+  side = grid * ROUTER_SPACING;
+  for(i = 0; i < nb_nodes; i++) {
+    a = &nodes[i];
+    if(i < nb_routers) {
+      a->x = (i % grid + 0.5) * ROUTER_SPACING;
+      a->y = (i / grid + 0.5) * ROUTER_SPACING;
+    } else {
+      a->x = draw_unit() * side;
+      a->y = draw_unit() * side;
+    }
+  }
+  for(i = 0; i < nb_nodes; i++) {
+    for(j = i + 1; j < nb_nodes; j++) {
+      a = &nodes[i];
+      b = &nodes[j];
+      dx = a->x - b->x;
+      dy = a->y - b->y;
+      d = sqrt(dx * dx + dy * dy) / RANGE;
+      if(d >= 1) {
+        continue;
+      }
+      a->links = realloc(a->links, (a->nlinks + 1) * sizeof(struct link));
+      b->links = realloc(b->links, (b->nlinks + 1) * sizeof(struct link));
+      if(a->links == NULL || b->links == NULL) {
+        fprintf(stderr, "nd-bench: out of memory\n");
+        exit(1);
+      }
+      l = &a->links[a->nlinks++];
+      l->to = j;
+      l->loss = base_loss + (u8_t)((EDGE_LOSS - (int)base_loss) * d * d);
+      l->rssi = -45 - (int16_t)(45 * d);
+      b->links[b->nlinks] = *l;
+      b->links[b->nlinks++].to = i;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+cmp_long(const void *a, const void *b)
+{
+  long x = *(const long *)a, y = *(const long *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Count, mean, 50th and 95th percentile and max of v[0..n-1] */
+static void
+print_dist(const char *name, long *v, u32_t n)
+{
+  double mean = 0;
+  u32_t i;
+
+  printf("\"%s\":{\"n\":%lu", name, (unsigned long)n);
+  if(n > 0) {
+    qsort(v, n, sizeof(long), cmp_long);
+    for(i = 0; i < n; i++) {
+      mean += v[i];
+    }
+    printf(",\"mean\":%.0f,\"p50\":%ld,\"p95\":%ld,\"max\":%ld",
+           mean / n, v[n / 2], v[(n * 95) / 100 < n ? (n * 95) / 100 : n - 1],
+           v[n - 1]);
+  }
+  printf("}");
+}
+
+static void
+report(unsigned long seed, double wall)
+{
+  long *v = malloc((nb_hosts + 1) * sizeof(long));
+  bench_conv_t c;
+  u32_t i, n, affected = 0, recovered = 0;
+  u8_t k;
+
+  if(v == NULL) {
+    return;
+  }
+  printf("{\"hosts\":%lu,\"routers\":%lu,\"seed\":%lu,\"duration_s\":%lu,"
+         "\"base_loss_pct\":%u,\"events\":%lu,\"wall_s\":%.2f,",
+         (unsigned long)nb_hosts, (unsigned long)nb_routers, seed, duration,
+         base_loss, events, wall);
+
+  for(i = n = 0; i < nb_hosts; i++) {
+    if(nodes[nb_routers + i].first_reg_ms >= 0) {
+      v[n++] = nodes[nb_routers + i].first_reg_ms;
+    }
+  }
+  print_dist("first_aro_ms", v, n);
+
+  printf(",\"steady_state_ms\":%ld,\"bytes_to_steady_state\":{", steady_ms);
+  for(k = 0; k < BENCH_ND_KINDS; k++) {
+    printf("\"%s\":%lu,", kind_names[k], steady_bytes[k]);
+  }
+  printf("\"total\":%lu}", sum(steady_bytes));
+
+  if(window_hours > 0) {
+    printf(",\"refresh\":{\"window_s\":%.0f,\"per_node_hour\":%.3f,"
+           "\"nd_bytes_per_node_hour\":%.1f}", window_hours * 3600,
+           window_refreshes / window_hours / nb_hosts,
+           window_bytes / window_hours / nb_nodes);
+  } else {
+    printf(",\"refresh\":null");
+  }
+
+  if(reboot_router >= 0) {
+    /* Hosts that lost a router since the reboot: those of the rebooted
+     * router, and any that lost another one to the radio meanwhile */
+    for(i = n = 0; i < nb_hosts; i++) {
+      struct node *h = &nodes[nb_routers + i];
+
+      h->side->conv(h->inst, &c);
+      if(c.losses > h->losses) {
+        affected++;
+        if(h->recovered_ms >= 0) {
+          recovered++;
+          v[n++] = c.recovery_last_ms;
+        }
+      }
+    }
+    printf(",\"reboot\":{\"router\":%ld,\"at_s\":%lu,\"down_s\":%lu,"
+           "\"hosts_lost_router\":%lu,\"hosts_recovered\":%lu,",
+           reboot_router, reboot_at, down_time, (unsigned long)affected,
+           (unsigned long)recovered);
+    /* From the loss of the router to the new registration */
+    print_dist("recovery_ms", v, n);
+    /* From the reboot: includes the time to notice the loss */
+    for(i = n = 0; i < nb_hosts; i++) {
+      if(nodes[nb_routers + i].recovered_ms >= 0) {
+        v[n++] = nodes[nb_routers + i].recovered_ms;
+      }
+    }
+    printf(",");
+    print_dist("reboot_to_recovered_ms", v, n);
+    printf("}");
+  }
+  printf("}\n");
+  free(v);
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n hosts] [-r routers] [-s seed] "
+          "[-t duration_s] [-l base_loss_pct]\n"
+          "       [-b reboot_at_s (0: none)] [-d down_s] [-B router]\n", name);
+  exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+  unsigned long seed = 1;
+  struct event e;
+  struct node *n;
+  clock_t wall = clock();
+  u32_t i;
+  int opt;
+
+  nb_hosts = 200;
+  nb_routers = 9;
+  while((opt = getopt(argc, argv, "n:r:s:t:l:b:d:B:")) != -1) {
+    switch(opt) {
+    case 'n': nb_hosts = strtoul(optarg, NULL, 0); break;
+    case 'r': nb_routers = strtoul(optarg, NULL, 0); break;
+    case 's': seed = strtoul(optarg, NULL, 0); break;
+    case 't': duration = strtoul(optarg, NULL, 0); break;
+    case 'l': base_loss = strtoul(optarg, NULL, 0); break;
+    case 'b': reboot_at = strtoul(optarg, NULL, 0); break;
+    case 'd': down_time = strtoul(optarg, NULL, 0); break;
+    case 'B': reboot_router = strtol(optarg, NULL, 0); break;
+    default: usage(argv[0]);
+    }
+  }
+  if(nb_routers == 0 || nb_hosts == 0 || base_loss > EDGE_LOSS ||
+     nb_routers + nb_hosts > 0xffffff) {
+    usage(argv[0]);
+  }
+  if(reboot_at == 0 || reboot_at >= duration) {
+    reboot_router = -1;
+  } else if(reboot_router < 0 || reboot_router >= (long)nb_routers) {
+    /* The router in the middle of the grid */
+    reboot_router = nb_routers / 2;
+  }
+
+  rng ^= seed * 0x9e3779b97f4a7c15ULL;
+  random_init(seed);
+  process_init();
+  nb_nodes = nb_routers + nb_hosts;
+  nodes = calloc(nb_nodes, sizeof(struct node));
+  if(nodes == NULL) {
+    fprintf(stderr, "nd-bench: out of memory\n");
+    return 1;
+  }
+  topology();
+
+  for(i = 0; i < nb_nodes; i++) {
+    n = &nodes[i];
+    n->is_host = i >= nb_routers;
+    n->side = n->is_host ? &bench_host_side : &bench_router_side;
+    n->first_reg_ms = -1;
+    n->recovered_ms = -1;
+    set_lladdr(n->lladdr, i);
+    n->inst = n->side->node_new(n->lladdr);
+    if(n->inst == NULL) {
+      fprintf(stderr, "nd-bench: out of memory\n");
+      return 1;
+    }
+    event_new(EV_UP, 0, i);
+    event_push();
+  }
+  if(reboot_router >= 0) {
+    event_new(EV_DOWN, reboot_at * CLOCK_SECOND, reboot_router);
+    event_push();
+    event_new(EV_UP, (reboot_at + down_time) * CLOCK_SECOND, reboot_router);
+    event_push();
+  }
+
+  while(heap_n > 0 && heap[0].time <= duration * CLOCK_SECOND) {
+    event_pop(&e);
+    now = e.time;
+    events++;
+    n = &nodes[e.node];
+    cur = e.node;
+    switch(e.type) {
+    case EV_TIMER:
+      if(n->up && e.gen == n->timer_gen) {
+        n->side->periodic(n->inst);
+        after_call(e.node);
+      }
+      break;
+    case EV_FRAME:
+      if(n->up) {
+        n->side->input(n->inst, e.pkt->data, e.pkt->len,
+                       nodes[e.from].lladdr, link_to(n, e.from)->rssi);
+        after_call(e.node);
+      }
+      packet_release(e.pkt);
+      break;
+    case EV_SENT:
+      if(n->up) {
+        n->side->sent(n->inst, e.to, e.acked, e.tx);
+        after_call(e.node);
+      }
+      break;
+    case EV_DOWN:
+      window_end();
+      n->up = 0;
+      n->timer_gen++;
+      for(i = nb_routers; i < nb_nodes; i++) {
+        bench_conv_t c;
+
+        nodes[i].side->conv(nodes[i].inst, &c);
+        nodes[i].losses = c.losses;
+        nodes[i].watch = 1;
+      }
+      break;
+    case EV_UP:
+      n->up = 1;
+      n->timer_at = 0;
+      n->side->boot(n->inst);
+      after_call(e.node);
+      break;
+    }
+  }
+  now = duration * CLOCK_SECOND;
+  window_end();
+
+  report(seed, (double)(clock() - wall) / CLOCKS_PER_SEC);
+  return 0;
+}
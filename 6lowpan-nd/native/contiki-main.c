@@ -0,0 +1,128 @@
+/**
+ * \file
+ *         main() of the native 6LoWPAN-ND nodes: the one of the native
+ *         platform, with the link layer address taken from the command
+ *         line and the radio threads watched by select().
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/netstack.h"
+#include "net/rime.h"
+#include "lib/random.h"
+#include "nd-opt/sicslowpan.h"
+
+/*---------------------------------------------------------------------------*/
+/* The link layer address of node id: 02:00:00:ff:fe:00:hi:lo */
+static void
+set_addresses(u16_t id)
+{
+  rimeaddr_t addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = 0x02;
+  addr.u8[3] = 0xff;
+  addr.u8[4] = 0xfe;
+  addr.u8[6] = id >> 8;
+  addr.u8[7] = id & 0xff;
+  rimeaddr_set_node_addr(&addr);
+  memcpy(&uip_lladdr.addr, &addr, sizeof(uip_lladdr.addr));
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  unsigned long id;
+  fd_set fds;
+  struct timeval tv;
+  clock_time_t next, now;
+  int maxfd;
+
+  if(argc != 2 || (id = strtoul(argv[1], NULL, 0)) == 0 || id > 0xffff) {
+    fprintf(stderr, "usage: %s <node id 1-65535>\n", argv[0]);
+    return 1;
+  }
+
+  process_init();
+  process_start(&etimer_process, NULL);
+  ctimer_init();
+
+  set_addresses(id);
+  random_init(id);
+  queuebuf_init();
+  netstack_init();
+  printf("node %lu: %s %s %s\n", id, NETSTACK_MAC.name, NETSTACK_RDC.name,
+         NETSTACK_NETWORK.name);
+
+  /* uip_ds6_init() derives the link-local address from uip_lladdr */
+  process_start(&tcpip_process, NULL);
+
+  autostart_start(autostart_processes);
+
+  while(1) {
+    while(process_run() > 0);
+
+    FD_ZERO(&fds);
+    maxfd = 0;
+#if SICSLOWPAN_THREADS
+    FD_SET(sicslowpan_rx_fd(), &fds);
+    maxfd = sicslowpan_rx_fd() + 1;
+#endif /* SICSLOWPAN_THREADS */
+    /* Sleep until the next timer, the radio process polls the medium */
+    next = CLOCK_SECOND;
+    if(etimer_pending()) {
+      now = clock_time();
+      next = etimer_next_expiration_time() - now;
+      if((long)next < 0) {
+        next = 0;
+      }
+      if(next > CLOCK_SECOND) {
+        next = CLOCK_SECOND;
+      }
+    }
+    tv.tv_sec = next / CLOCK_SECOND;
+    tv.tv_usec = (long)(next % CLOCK_SECOND) * 1000000 / CLOCK_SECOND;
+    if(select(maxfd, &fds, NULL, NULL, &tv) > 0) {
+#if SICSLOWPAN_THREADS
+      if(FD_ISSET(sicslowpan_rx_fd(), &fds)) {
+        sicslowpan_rx_wakeup();
+      }
+#endif /* SICSLOWPAN_THREADS */
+    }
+    etimer_request_poll();
+  }
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * \file
+ *         A 6LoWPAN-ND node for the native platform. Built with ROUTER=1,
+ *         it is a 6LBR advertising aaaa::/64 and a context for it; else a
+ *         host that registers with the routers it hears. Both print their
+ *         addresses and, with UIP_DS6_CONV_STATS, their convergence
+ *         metrics every STATUS_INTERVAL.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include <stdio.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "nd-opt/uip-nd6.h"
+#include "nd-opt/uip-ds6.h"
+
+#define STATUS_INTERVAL (10 * CLOCK_SECOND)
+
+#define PREFIX_LIFETIME 0xffffffff /* infinite */
+#define ABR_LIFETIME    10000      /* minutes */
+#define CONTEXT_LIFETIME 60        /* minutes */
+
+PROCESS(nd_node_process, "6LoWPAN-ND node");
+AUTOSTART_PROCESSES(&nd_node_process);
+
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_ROUTER
+static void
+router_init(void)
+{
+  uip_ipaddr_t ipaddr;
+
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_prefix_add(&ipaddr, 64, 1,
+                     UIP_ND6_RA_FLAG_ONLINK | UIP_ND6_RA_FLAG_AUTONOMOUS,
+                     PREFIX_LIFETIME, PREFIX_LIFETIME);
+#if CONF_6LOWPAN_ND_6CO
+  uip_ds6_context_set(0, &ipaddr, 64, CONTEXT_LIFETIME, 1);
+#endif /* CONF_6LOWPAN_ND_6CO */
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_MANUAL);
+#if CONF_6LOWPAN_ND_ABRO
+  /* We are the 6LBR */
+  uip_ds6_abr_update(&ipaddr, 1, ABR_LIFETIME);
+#endif /* CONF_6LOWPAN_ND_ABRO */
+}
+#endif /* UIP_CONF_ROUTER */
+/*---------------------------------------------------------------------------*/
+static void
+print_status(void)
+{
+  u8_t i;
+  u8_t *a;
+#if UIP_DS6_CONV_STATS
+  static char json[256];
+#endif /* UIP_DS6_CONV_STATS */
+
+  for(i = 0; i < UIP_DS6_ADDR_NB; i++) {
+    if(uip_ds6_if.addr_list[i].isused) {
+      a = uip_ds6_if.addr_list[i].ipaddr.u8;
+      printf("addr %02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:"
+             "%02x%02x:%02x%02x state %u\n", a[0], a[1], a[2], a[3], a[4],
+             a[5], a[6], a[7], a[8], a[9], a[10], a[11], a[12], a[13], a[14],
+             a[15], uip_ds6_if.addr_list[i].state);
+    }
+  }
+#if UIP_DS6_CONV_STATS
+  uip_ds6_conv_json(json, sizeof(json));
+  printf("conv %s\n", json);
+#endif /* UIP_DS6_CONV_STATS */
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nd_node_process, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+#if UIP_CONF_ROUTER
+  router_init();
+#endif /* UIP_CONF_ROUTER */
+
+  etimer_set(&et, STATUS_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+    print_status();
+  }
+
+  PROCESS_END();
+}
@@ -0,0 +1,2 @@
+/* The core files include net/sicslowpan.h: give them the one of nd-opt */
+#include "nd-opt/sicslowpan.h"
@@ -0,0 +1,2 @@
+/* The core files include net/uip-ds6.h: give them the one of nd-opt */
+#include "nd-opt/uip-ds6.h"
@@ -0,0 +1,2 @@
+/* The core files include net/uip-nd6.h: give them the one of nd-opt */
+#include "nd-opt/uip-nd6.h"
@@ -0,0 +1,49 @@
+/**
+ * \file
+ *         Configuration of the native 6LoWPAN-ND nodes
+ */
+#ifndef __PROJECT_CONF_H__
+#define __PROJECT_CONF_H__
+
+#undef NETSTACK_CONF_RADIO
+#define NETSTACK_CONF_RADIO   shm_radio_driver
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC     nullrdc_driver
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC     csma_driver
+#undef NETSTACK_CONF_FRAMER
+#define NETSTACK_CONF_FRAMER  framer_802154
+#undef NETSTACK_CONF_NETWORK
+#define NETSTACK_CONF_NETWORK sicslowpan_driver
+
+/* The radio acks unicast frames itself: nullrdc passes its result,
+ * RADIO_TX_NOACK included, to the MAC */
+#undef NULLRDC_CONF_802154_AUTOACK
+#define NULLRDC_CONF_802154_AUTOACK 0
+
+#undef RIMEADDR_CONF_SIZE
+#define RIMEADDR_CONF_SIZE 8
+#undef UIP_CONF_LL_802154
+#define UIP_CONF_LL_802154 1
+#undef UIP_CONF_LLH_LEN
+#define UIP_CONF_LLH_LEN 0
+
+#undef SICSLOWPAN_CONF_COMPRESSION
+#define SICSLOWPAN_CONF_COMPRESSION SICSLOWPAN_COMPRESSION_HC06
+#undef SICSLOWPAN_CONF_FRAG
+#define SICSLOWPAN_CONF_FRAG 1
+#undef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
+#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 4
+
+#undef CONF_6LOWPAN_ND_6CO
+#define CONF_6LOWPAN_ND_6CO 1
+#undef CONF_6LOWPAN_ND_ABRO
+#define CONF_6LOWPAN_ND_ABRO 1
+#undef UIP_CONF_ND6_MULTIHOP_DAD
+#define UIP_CONF_ND6_MULTIHOP_DAD 1
+
+#undef UIP_DS6_CONF_CONV_STATS
+#define UIP_DS6_CONF_CONV_STATS 1
+
+
+#endif /* __PROJECT_CONF_H__ */
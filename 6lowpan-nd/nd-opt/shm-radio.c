@@ -0,0 +1,458 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *         Simulated 802.15.4 radio for the native platform: a broadcast
+ *         medium shared by the processes of one host through a
+ *         memory-mapped file.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "contiki.h"
+#include "net/netstack.h"
+#include "net/rime.h"
+#include "lib/random.h"
+#include "nd-opt/shm-radio.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define SHM_MAGIC 0x53484d32 /* "SHM2" */
+#define SHM_FORMATTING 0x53484d3f /* "SHM?": a node is formatting it */
+
+/* 802.15.4 frame control field */
+#define FCF_DEST_ADDR_MODE(fcf1) (((fcf1) >> 2) & 3)
+#define FCF_ADDR_SHORT 2
+#define FCF_ADDR_LONG 3
+
+/*
+ * The medium is a ring of frames. head counts the frames ever sent: a
+ * sender reserves frame number n by incrementing it, fills slot
+ * n % SHM_RADIO_SLOTS, then publishes it by setting seq to n + 1. Every
+ * node reads from its own cursor, so no lock is needed between senders
+ * and receivers. A receiver that is lapped by the senders loses the
+ * frames overwritten, as a real receiver would lose them in a collision.
+ *
+ * Unicast frames are acked by the medium on behalf of their destination,
+ * whether the MAC asked for an ACK or not: the sender looks it up in the node table, and draws the
+ * loss of the frame and of its ACK itself. A destination that is not
+ * running, or whose radio is off, never acks.
+ */
+struct shm_frame {
+  u32_t seq;    /**< number of the frame + 1, 0 while it is written */
+  u32_t sender; /**< pid of the node that sent it */
+  u16_t len;
+  u8_t acked;   /**< its loss was drawn by the sender */
+  u8_t data[SHM_RADIO_MAX_FRAME];
+};
+
+struct shm_node {
+  u32_t pid;    /**< 0 if the entry is free */
+  u8_t on;      /**< its radio is on */
+  u8_t addr[RIMEADDR_SIZE];
+};
+
+struct shm_medium {
+  u32_t magic;
+  u32_t head;
+  struct shm_node node[SHM_RADIO_NODES];
+  struct shm_frame slot[SHM_RADIO_SLOTS];
+};
+
+static struct shm_medium *medium;
+static struct shm_node *node; /* our entry in the node table */
+static u32_t cursor;
+static u32_t held;   /* frame at the cursor that passed the loss test, + 1 */
+static u32_t self;
+static u8_t radio_on;
+static u8_t tx_buf[SHM_RADIO_MAX_FRAME];
+static u16_t tx_len;
+
+PROCESS(shm_radio_process, "Shared memory radio");
+
+/*---------------------------------------------------------------------------*/
+/* Draw the loss of a frame (or of an ACK) */
+static int
+lost(void)
+{
+  return SHM_RADIO_LOSS > 0 && random_rand() % 100 < SHM_RADIO_LOSS;
+}
+/*---------------------------------------------------------------------------*/
+static int
+alive(u32_t pid)
+{
+  return pid != 0 && (kill((pid_t)pid, 0) == 0 || errno != ESRCH);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Take an entry in the node table, ours from a previous call or one left
+ * by a node that is no longer running, and publish our address and radio
+ * state in it. The address may be set after the radio is initialized, so
+ * this is done again periodically.
+ */
+static void
+node_update(void)
+{
+  struct shm_node *n;
+  u32_t pid;
+
+  if(medium == NULL) {
+    return;
+  }
+  for(n = medium->node; node == NULL && n < medium->node + SHM_RADIO_NODES;
+      n++) {
+    pid = __atomic_load_n(&n->pid, __ATOMIC_ACQUIRE);
+    if(!alive(pid) &&
+       __atomic_compare_exchange_n(&n->pid, &pid, self, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      node = n;
+    }
+  }
+  if(node == NULL) {
+    PRINTF("shm-radio: node table full, nobody will ack us\n");
+    return;
+  }
+  memcpy(node->addr, &rimeaddr_node_addr, RIMEADDR_SIZE);
+  __atomic_store_n(&node->on, radio_on, __ATOMIC_RELEASE);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Whether the destination of a frame is running with its radio on. The
+ * address is in the frame in reverse byte order.
+ */
+static int
+node_listening(const u8_t *addr)
+{
+  struct shm_node *n;
+  u8_t i;
+
+  for(n = medium->node; n < medium->node + SHM_RADIO_NODES; n++) {
+    if(n == node || !__atomic_load_n(&n->on, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    for(i = 0; i < RIMEADDR_SIZE && n->addr[i] == addr[RIMEADDR_SIZE - 1 - i];
+        i++);
+    if(i == RIMEADDR_SIZE && alive(__atomic_load_n(&n->pid, __ATOMIC_ACQUIRE))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Destination address of a unicast frame, NULL for broadcast frames and
+ * for addresses of another size than ours.
+ */
+static const u8_t *
+ack_dest(const u8_t *frame, unsigned short len)
+{
+  u8_t mode;
+
+  if(len < 3) {
+    return NULL;
+  }
+  mode = FCF_DEST_ADDR_MODE(frame[1]);
+  if((mode == FCF_ADDR_SHORT && RIMEADDR_SIZE != 2) ||
+     (mode == FCF_ADDR_LONG && RIMEADDR_SIZE != 8) ||
+     (mode != FCF_ADDR_SHORT && mode != FCF_ADDR_LONG) ||
+     len < 5 + RIMEADDR_SIZE) {
+    return NULL;
+  }
+  if(mode == FCF_ADDR_SHORT && frame[5] == 0xff && frame[6] == 0xff) {
+    return NULL;
+  }
+  /* After the sequence number and the destination PAN id */
+  return &frame[5];
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Frame at the cursor, skipping our own frames and the ones lost.
+ * Returns NULL when we have read everything sent so far.
+ */
+static struct shm_frame *
+next_frame(void)
+{
+  struct shm_frame *f;
+  u32_t head;
+
+  if(medium == NULL) {
+    return NULL;
+  }
+  head = __atomic_load_n(&medium->head, __ATOMIC_ACQUIRE);
+  if(head - cursor > SHM_RADIO_SLOTS) {
+    PRINTF("shm-radio: lost %lu frames\n",
+           (unsigned long)(head - cursor - SHM_RADIO_SLOTS));
+    cursor = head - SHM_RADIO_SLOTS;
+  }
+  while(cursor != head) {
+    f = &medium->slot[cursor % SHM_RADIO_SLOTS];
+    if(__atomic_load_n(&f->seq, __ATOMIC_ACQUIRE) != cursor + 1) {
+      /*
+       * Still being written. Wait for it if it is the last one, else
+       * drop it: the sender may have died while writing it.
+       */
+      if(head - cursor == 1) {
+        return NULL;
+      }
+    } else if(f->sender != self &&
+              (f->acked || held == cursor + 1 || !lost())) {
+      held = cursor + 1;
+      return f;
+    }
+    cursor++;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_init(void)
+{
+  int fd;
+  int i;
+  u32_t magic;
+
+  self = (u32_t)getpid();
+  fd = open(SHM_RADIO_FILE, O_RDWR | O_CREAT, 0600);
+  if(fd < 0) {
+    PRINTF("shm-radio: cannot open %s\n", SHM_RADIO_FILE);
+    return 0;
+  }
+  if(ftruncate(fd, sizeof(struct shm_medium)) < 0) {
+    close(fd);
+    return 0;
+  }
+  medium = mmap(NULL, sizeof(struct shm_medium), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  close(fd);
+  if(medium == MAP_FAILED) {
+    medium = NULL;
+    return 0;
+  }
+  /*
+   * The first node to start formats the medium. Nodes started at the same
+   * time race for it on magic: the losers wait for the winner to finish.
+   */
+  magic = __atomic_load_n(&medium->magic, __ATOMIC_ACQUIRE);
+  if(magic != SHM_MAGIC) {
+    if(magic != SHM_FORMATTING &&
+       __atomic_compare_exchange_n(&medium->magic, &magic, SHM_FORMATTING, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      memset(medium->node, 0, sizeof(medium->node));
+      memset(medium->slot, 0, sizeof(medium->slot));
+      __atomic_store_n(&medium->head, 0, __ATOMIC_RELEASE);
+      __atomic_store_n(&medium->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    } else {
+      for(i = 0; i < 100 &&
+          __atomic_load_n(&medium->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC; i++) {
+        usleep(10000);
+      }
+      if(i == 100) {
+        /* Its formatter died: the file must be removed */
+        PRINTF("shm-radio: %s is not formatted\n", SHM_RADIO_FILE);
+        munmap(medium, sizeof(struct shm_medium));
+        medium = NULL;
+        return 0;
+      }
+    }
+  }
+  /* Frames sent before we joined are not for us */
+  cursor = __atomic_load_n(&medium->head, __ATOMIC_ACQUIRE);
+  radio_on = 1;
+  node_update();
+  process_start(&shm_radio_process, NULL);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_prepare(const void *payload, unsigned short payload_len)
+{
+  if(payload_len > SHM_RADIO_MAX_FRAME) {
+    return 1;
+  }
+  memcpy(tx_buf, payload, payload_len);
+  tx_len = payload_len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_transmit(unsigned short transmit_len)
+{
+  struct shm_frame *f;
+  const u8_t *dest;
+  u32_t n;
+
+  if(medium == NULL || !radio_on || transmit_len > tx_len) {
+    return RADIO_TX_ERR;
+  }
+  dest = ack_dest(tx_buf, transmit_len);
+  if(dest != NULL && (!node_listening(dest) || lost())) {
+    /* Nobody received it: no ACK */
+    return RADIO_TX_NOACK;
+  }
+  n = __atomic_fetch_add(&medium->head, 1, __ATOMIC_ACQ_REL);
+  f = &medium->slot[n % SHM_RADIO_SLOTS];
+  __atomic_store_n(&f->seq, 0, __ATOMIC_RELEASE);
+  f->sender = self;
+  f->len = transmit_len;
+  f->acked = dest != NULL;
+  memcpy(f->data, tx_buf, transmit_len);
+  __atomic_store_n(&f->seq, n + 1, __ATOMIC_RELEASE);
+  if(dest != NULL && lost()) {
+    /* Received, but the ACK was lost: the MAC will send it again */
+    return RADIO_TX_NOACK;
+  }
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_send(const void *payload, unsigned short payload_len)
+{
+  if(shm_radio_prepare(payload, payload_len)) {
+    return RADIO_TX_ERR;
+  }
+  return shm_radio_transmit(payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_read(void *buf, unsigned short buf_len)
+{
+  struct shm_frame *f;
+  u16_t len;
+
+  f = next_frame();
+  if(f == NULL) {
+    return 0;
+  }
+  len = f->len;
+  if(len > buf_len) {
+    len = buf_len;
+  }
+  memcpy(buf, f->data, len);
+  /* Overwritten while we copied it: it collided. The fence keeps the copy
+   * from being reordered after the check */
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(__atomic_load_n(&f->seq, __ATOMIC_RELAXED) != cursor + 1) {
+    len = 0;
+  }
+  cursor++;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_pending_packet(void)
+{
+  return radio_on && next_frame() != NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_on(void)
+{
+  if(medium != NULL && !radio_on) {
+    /* What was sent while we were off is lost */
+    cursor = __atomic_load_n(&medium->head, __ATOMIC_ACQUIRE);
+  }
+  radio_on = 1;
+  node_update();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+shm_radio_off(void)
+{
+  radio_on = 0;
+  node_update();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shm_radio_process, ev, data)
+{
+  static struct etimer et;
+  int len;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, SHM_RADIO_POLL_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+    node_update();
+    while(shm_radio_pending_packet()) {
+      packetbuf_clear();
+      len = shm_radio_read(packetbuf_dataptr(), PACKETBUF_SIZE);
+      if(len > 0) {
+        packetbuf_set_datalen(len);
+        NETSTACK_RDC.input();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver shm_radio_driver = {
+  shm_radio_init,
+  shm_radio_prepare,
+  shm_radio_transmit,
+  shm_radio_send,
+  shm_radio_read,
+  shm_radio_channel_clear,
+  shm_radio_receiving_packet,
+  shm_radio_pending_packet,
+  shm_radio_on,
+  shm_radio_off,
+};
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,108 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *         Simulated 802.15.4 radio for the native platform.
+ *
+ *         All the Contiki processes started on one host with this driver
+ *         share a broadcast medium: a ring of frames in a memory-mapped
+ *         file. Each frame sent is received by every other node, the MAC
+ *         layer filters on the destination address as with a real radio.
+ *         This lets sicslowpan.c, uip-ds6.c, uip-nd6.c and tcpip.c run
+ *         unmodified as Linux processes, to debug and profile them.
+ *
+ *         To use it, build for the native platform with, in project-conf.h:
+ *         \code
+ *         #define NETSTACK_CONF_RADIO   shm_radio_driver
+ *         #define NETSTACK_CONF_RDC     nullrdc_driver
+ *         #define NETSTACK_CONF_FRAMER  framer_802154
+ *         #define NETSTACK_CONF_NETWORK sicslowpan_driver
+ *         \endcode
+ *         and start one process per node. Each node needs its own link
+ *         layer address (rimeaddr_node_addr). Unicast frames get an ACK
+ *         if their destination runs with its radio on, and the ACK is
+ *         subject to the loss model too: the MAC sees MAC_TX_NOACK, with
+ *         nullrdc_driver as long as it leaves ACKs to the radio.
+ *         6lowpan-nd/native builds such nodes.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#ifndef __SHM_RADIO_H__
+#define __SHM_RADIO_H__
+
+#include "dev/radio.h"
+
+/** \brief File holding the shared medium */
+#ifdef SHM_RADIO_CONF_FILE
+#define SHM_RADIO_FILE SHM_RADIO_CONF_FILE
+#else
+#define SHM_RADIO_FILE "/tmp/contiki-shm-radio"
+#endif
+
+/** \brief Number of frames kept in the medium; a node reading less
+ * often than this many frames are sent loses the oldest ones */
+#ifdef SHM_RADIO_CONF_SLOTS
+#define SHM_RADIO_SLOTS SHM_RADIO_CONF_SLOTS
+#else
+#define SHM_RADIO_SLOTS 64
+#endif
+
+/** \brief Nodes that can share the medium */
+#ifdef SHM_RADIO_CONF_NODES
+#define SHM_RADIO_NODES SHM_RADIO_CONF_NODES
+#else
+#define SHM_RADIO_NODES 64
+#endif
+
+/** \brief Percentage of the frames dropped at reception, and of the ACKs
+ * dropped, to exercise retransmissions, NUD and router failover */
+#ifdef SHM_RADIO_CONF_LOSS
+#define SHM_RADIO_LOSS SHM_RADIO_CONF_LOSS
+#else
+#define SHM_RADIO_LOSS 0
+#endif
+
+/** \brief How often the medium is polled for new frames */
+#ifdef SHM_RADIO_CONF_POLL_INTERVAL
+#define SHM_RADIO_POLL_INTERVAL SHM_RADIO_CONF_POLL_INTERVAL
+#else
+#define SHM_RADIO_POLL_INTERVAL (CLOCK_SECOND / 100 > 0 ? CLOCK_SECOND / 100 : 1)
+#endif
+
+/** \brief aMaxPHYPacketSize */
+#define SHM_RADIO_MAX_FRAME 127
+
+extern const struct radio_driver shm_radio_driver;
+
+#endif /* __SHM_RADIO_H__ */
+/** @} */
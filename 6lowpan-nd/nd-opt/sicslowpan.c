@@ -58,6 +58,10 @@
  */
 
 #include <string.h>
+#if SICSLOWPAN_CONF_THREADS
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* SICSLOWPAN_CONF_THREADS */
 
 #include "contiki.h"
 #include "dev/watchdog.h"
@@ -179,6 +183,55 @@ void uip_log(char *msg);
  */
 /** A pointer to the mac driver */
 const struct mac_driver *sicslowpan_mac;
+#if UIP_DS6_IF_NB > 1
+SICSLOWPAN_TLS u8_t sicslowpan_ifindex;
+#define RX_IFINDEX sicslowpan_ifindex
+#else /* UIP_DS6_IF_NB > 1 */
+#define RX_IFINDEX 0
+#endif /* UIP_DS6_IF_NB > 1 */
+
+#if SICSLOWPAN_THREADS
+#if !SICSLOWPAN_CONF_FRAG
+#error "SICSLOWPAN_THREADS needs SICSLOWPAN_CONF_FRAG: uip_buf belongs to the IP layer"
+#endif
+#if SICSLOWPAN_CONF_NEIGHBOR_INFO
+#error "SICSLOWPAN_THREADS does not support SICSLOWPAN_CONF_NEIGHBOR_INFO"
+#endif
+#if UIP_DS6_INSTANCES
+#error "SICSLOWPAN_THREADS keeps the fragmentation state per thread, not per node instance"
+#endif
+/** A reassembled packet on its way from a radio thread to the IP layer */
+struct rx_slot {
+  u16_t len;
+  int16_t rssi;
+  rimeaddr_t sender;
+  uip_buf_t buf;
+};
+
+/**
+ * One ring per interface. head is only written by the radio thread and
+ * tail by sicslowpan_rx_process; both run freely, the slot is the counter
+ * modulo SICSLOWPAN_RING_SIZE. The release store of a counter publishes
+ * the slot it covers.
+ */
+static struct rx_ring {
+  u16_t head;
+  u16_t tail;
+  struct rx_slot slot[SICSLOWPAN_RING_SIZE];
+} rx_rings[UIP_DS6_IF_NB];
+
+/**
+ * process_poll() is not thread-safe. A radio thread that queued a packet
+ * sets rx_pending instead, and the one that sets it writes a byte to
+ * rx_pipe for a main loop sleeping in select(). The IP thread empties the
+ * pipe, then clears rx_pending, then drains the rings: a packet queued
+ * after that sets it again.
+ */
+static u8_t rx_pending;
+static int rx_pipe[2] = { -1, -1 };
+
+PROCESS(sicslowpan_rx_process, "6LoWPAN rx");
+#endif /* SICSLOWPAN_THREADS */
 
 #ifdef SICSLOWPAN_NH_COMPRESSOR
 /** A pointer to the additional compressor */
@@ -190,14 +243,14 @@ extern struct sicslowpan_nh_compressor SICSLOWPAN_NH_COMPRESSOR;
  * We initialize it to the beginning of the rime buffer, then
  * access different fields by updating the offset rime_hdr_len.
  */
-static u8_t *rime_ptr;
+static SICSLOWPAN_TLS u8_t *rime_ptr;
 
 /**
  * rime_hdr_len is the total length of (the processed) 6lowpan headers
  * (fragment headers, IPV6 or HC1, HC2, and HC1 and HC2 non compressed
  * fields).
  */
-static u8_t rime_hdr_len;
+static SICSLOWPAN_TLS u8_t rime_hdr_len;
 
 /**
  * The length of the payload in the Rime buffer.
@@ -205,13 +258,13 @@ static u8_t rime_hdr_len;
  * headers (can be the IP payload if the IP header only is compressed
  * or the UDP payload if the UDP header is also compressed)
  */
-static u8_t rime_payload_len;
+static SICSLOWPAN_TLS u8_t rime_payload_len;
 
 /**
  * uncomp_hdr_len is the length of the headers before compression (if HC2
  * is used this includes the UDP header in addition to the IP header).
  */
-static u8_t uncomp_hdr_len;
+static SICSLOWPAN_TLS u8_t uncomp_hdr_len;
 /** @} */
 
 #if SICSLOWPAN_CONF_FRAG
@@ -219,14 +272,22 @@ static u8_t uncomp_hdr_len;
  *  @{
  */
 
-static u16_t sicslowpan_len;
+#if UIP_DS6_INSTANCES
+#define sicslowpan_len (uip_ds6_instance->lowpan_len)
+#define sicslowpan_aligned_buf (uip_ds6_instance->lowpan_buf)
+#define processed_ip_len (uip_ds6_instance->lowpan_processed_len)
+#else /* UIP_DS6_INSTANCES */
+static SICSLOWPAN_TLS u16_t sicslowpan_len;
+#endif /* UIP_DS6_INSTANCES */
 
 /**
  * The buffer used for the 6lowpan reassembly.
  * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
  * It has a fix size as we do not use dynamic memory allocation.
  */
-static uip_buf_t sicslowpan_aligned_buf;
+#if !UIP_DS6_INSTANCES
+static SICSLOWPAN_TLS uip_buf_t sicslowpan_aligned_buf;
+#endif /* !UIP_DS6_INSTANCES */
 #define sicslowpan_buf (sicslowpan_aligned_buf.u8)
 
 /** The total length of the IPv6 packet in the sicslowpan_buf. */
@@ -235,19 +296,29 @@ static uip_buf_t sicslowpan_aligned_buf;
  * length of the ip packet already sent / received.
  * It includes IP and transport headers.
  */
-static u16_t processed_ip_len;
-
+#if !UIP_DS6_INSTANCES
+static SICSLOWPAN_TLS u16_t processed_ip_len;
+#endif /* !UIP_DS6_INSTANCES */
+
+#if UIP_DS6_INSTANCES
+/* The fragmentation state is part of the node instance, see uip-ds6.h */
+#define my_tag (uip_ds6_instance->lowpan_tag)
+#define reass_tag (uip_ds6_instance->lowpan_reass_tag)
+#define frag_sender (uip_ds6_instance->lowpan_frag_sender)
+#define reass_timer (uip_ds6_instance->lowpan_reass_timer)
+#else /* UIP_DS6_INSTANCES */
 /** Datagram tag to be put in the fragments I send. */
 static u16_t my_tag;
 
 /** When reassembling, the tag in the fragments being merged. */
-static u16_t reass_tag;
+static SICSLOWPAN_TLS u16_t reass_tag;
 
 /** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+SICSLOWPAN_TLS rimeaddr_t frag_sender;
 
 /** Reassembly %process %timer. */
-static struct timer reass_timer;
+static SICSLOWPAN_TLS struct timer reass_timer;
+#endif /* UIP_DS6_INSTANCES */
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -266,20 +337,28 @@ static struct timer reass_timer;
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
 #if CONF_6LOWPAN_ND_6CO
 /* 64-bits long suffix from 16-bits iid */
-static u8_t iid_16_mapping[] = {0, 0, 0, 0xff, 0xfe, 0, 0, 0};
+static SICSLOWPAN_TLS u8_t iid_16_mapping[] = {0, 0, 0, 0xff, 0xfe, 0, 0, 0};
 /* pointers to context */
-static uip_ds6_addr_context_t *src_context, *dest_context;
+static SICSLOWPAN_TLS uip_ds6_addr_context_t *src_context, *dest_context;
+#if SICSLOWPAN_THREADS
+/* Radio threads decompress with copies, as the IP thread may be changing
+ * the contexts */
+static SICSLOWPAN_TLS uip_ds6_addr_context_t src_context_copy, dest_context_copy;
+#define CONTEXT_LOOKUP_BY_ID(id, copy) uip_ds6_context_read((id), (copy))
+#else /* SICSLOWPAN_THREADS */
+#define CONTEXT_LOOKUP_BY_ID(id, copy) uip_ds6_context_lookup_by_id(id)
+#endif /* SICSLOWPAN_THREADS */
 #else
 static struct sicslowpan_addr_context 
 addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
 /** pointer to an address context. */
-static struct sicslowpan_addr_context *context;
+static SICSLOWPAN_TLS struct sicslowpan_addr_context *context;
 
 #endif /* !CONF_6LOWPAN_ND_6CO */
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 
 /** pointer to the byte where to write next inline field. */
-static u8_t *hc06_ptr;
+static SICSLOWPAN_TLS u8_t *hc06_ptr;
 
 #if !CONF_6LOWPAN_ND_6CO
 /* Uncompression of linklocal */
@@ -1037,7 +1116,7 @@ uncompress_hdr_hc06(u16_t ip_len) {
   	u8_t sci = (iphc1 & SICSLOWPAN_IPHC_CID) ? RIME_IPHC_BUF[2] >> 4 : 0;
 	  if ((tmp & 0x03) != 0) {
 	  	/* Context refers to the unspecified address*/
-	    src_context = uip_ds6_context_lookup_by_id(sci);
+	    src_context = CONTEXT_LOOKUP_BY_ID(sci, &src_context_copy);
 	    if(src_context == NULL) {
 		    PRINTF("sicslowpan uncompress_hdr: error context not found\n");
 	      return;
@@ -1051,7 +1130,7 @@ uncompress_hdr_hc06(u16_t ip_len) {
   tmp = (iphc1 & 0x0f) | 0x10; /* First nibble = 1 means dest. addr. */
   if (IS_STATEFUL_COMPRESSION(tmp)) {
   	u8_t dci = (iphc1 & SICSLOWPAN_IPHC_CID) ? RIME_IPHC_BUF[2] & 0x0f : 0;
-  	dest_context = uip_ds6_context_lookup_by_id(dci);
+  	dest_context = CONTEXT_LOOKUP_BY_ID(dci, &dest_context_copy);
   	if(dest_context == NULL) {
 			PRINTF("sicslowpan uncompress_hdr: error context not found\n");
 			return;
@@ -1516,6 +1595,22 @@ compress_hdr_ipv6(rimeaddr_t *rime_destaddr) {
 static void
 packet_sent(void *ptr, int status, int transmissions)
 {
+#if UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex = uip_ds6_if_index;
+#endif /* UIP_DS6_IF_NB > 1 */
+
+  /* Broadcasts, collisions and deferrals say nothing about the link */
+  if((status == MAC_TX_OK || status == MAC_TX_NOACK) &&
+     !rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &rimeaddr_null)) {
+    /* The MAC may call back later: ptr is the interface the frame was
+     * sent on, see send_packet() */
+    uip_ds6_if_select((u8_t)(uintptr_t)ptr);
+    uip_ds6_link_sent((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                      status == MAC_TX_OK, transmissions);
+    uip_ds6_if_select(ifindex);
+  }
+#endif /* UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD */
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
   neighbor_info_packet_sent(status, transmissions);
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
@@ -1538,7 +1633,11 @@ send_packet(rimeaddr_t *dest)
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
+#if UIP_DS6_IF_NB > 1
+  NETSTACK_MAC.send(&packet_sent, (void *)(uintptr_t)uip_ds6_if_index);
+#else /* UIP_DS6_IF_NB > 1 */
   NETSTACK_MAC.send(&packet_sent, NULL);
+#endif /* UIP_DS6_IF_NB > 1 */
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
@@ -1643,6 +1742,7 @@ output(uip_lladdr_t *localdest)
     q = queuebuf_new_from_packetbuf();
     if(q == NULL) {
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
+      UIP_DS6_TRACE_FRAG_DROP(my_tag, UIP_DS6_TRACE_FRAG_NOBUF);
       return 0;
     }
     send_packet(&dest);
@@ -1681,6 +1781,7 @@ output(uip_lladdr_t *localdest)
       q = queuebuf_new_from_packetbuf();
       if(q == NULL) {
         PRINTFO("could not allocate queuebuf, dropping fragment\n");
+        UIP_DS6_TRACE_FRAG_DROP(my_tag, UIP_DS6_TRACE_FRAG_NOBUF);
         return 0;
       }
       send_packet(&dest);
@@ -1711,6 +1812,92 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_THREADS
+/*--------------------------------------------------------------------*/
+/** \brief Radio thread: queue the packet reassembled in sicslowpan_buf
+ * for the IP layer */
+static void
+rx_ring_put(void)
+{
+  struct rx_ring *r = &rx_rings[RX_IFINDEX];
+  struct rx_slot *s;
+  u16_t head = r->head;
+
+  if((u16_t)(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) >=
+     SICSLOWPAN_RING_SIZE) {
+    PRINTFI("sicslowpan input: rx ring full, dropping packet\n");
+    UIP_DS6_TRACE_FRAG_DROP(RX_IFINDEX, UIP_DS6_TRACE_FRAG_RING_FULL);
+    return;
+  }
+  s = &r->slot[head % SICSLOWPAN_RING_SIZE];
+  memcpy(&s->buf.u8[UIP_LLH_LEN], SICSLOWPAN_IP_BUF, sicslowpan_len);
+  s->len = sicslowpan_len;
+  s->rssi = (int16_t)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  rimeaddr_copy(&s->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  __atomic_store_n(&r->head, (u16_t)(head + 1), __ATOMIC_RELEASE);
+  if(!__atomic_exchange_n(&rx_pending, 1, __ATOMIC_ACQ_REL) &&
+     rx_pipe[1] >= 0 && write(rx_pipe[1], "", 1) < 0) {
+    PRINTFI("sicslowpan input: rx pipe full\n");
+  }
+}
+
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_rx_fd(void)
+{
+  return rx_pipe[0];
+}
+
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_rx_wakeup(void)
+{
+  process_poll(&sicslowpan_rx_process);
+}
+
+/*--------------------------------------------------------------------*/
+/** \brief IP layer thread: pass up the packets queued by the radio
+ * threads, one at a time through uip_buf */
+PROCESS_THREAD(sicslowpan_rx_process, ev, data)
+{
+  static u8_t i;
+  static struct rx_ring *r;
+  static struct etimer et;
+  struct rx_slot *s;
+  char c;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, SICSLOWPAN_RX_POLL_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || etimer_expired(&et));
+    if(etimer_expired(&et)) {
+      etimer_reset(&et);
+    }
+    while(rx_pipe[0] >= 0 && read(rx_pipe[0], &c, 1) > 0);
+    if(!__atomic_exchange_n(&rx_pending, 0, __ATOMIC_ACQ_REL)) {
+      continue;
+    }
+    for(i = 0; i < UIP_DS6_IF_NB; i++) {
+      r = &rx_rings[i];
+      while(r->tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+        s = &r->slot[r->tail % SICSLOWPAN_RING_SIZE];
+        memcpy(UIP_IP_BUF, &s->buf.u8[UIP_LLH_LEN], s->len);
+        uip_len = s->len;
+        uip_ds6_if_select(i);
+#if UIP_DS6_LINK_ESTIMATOR
+        uip_ds6_link_received((uip_lladdr_t *)&s->sender, s->rssi);
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+        __atomic_store_n(&r->tail, (u16_t)(r->tail + 1), __ATOMIC_RELEASE);
+        tcpip_input();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* SICSLOWPAN_THREADS */
+
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1746,6 +1933,9 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* if reassembly timed out, cancel it */
   if(timer_expired(&reass_timer)){
+    if(processed_ip_len > 0) {
+      UIP_DS6_TRACE_FRAG_DROP(reass_tag, UIP_DS6_TRACE_FRAG_TIMEOUT);
+    }
     sicslowpan_len = 0;
     processed_ip_len = 0;
   }
@@ -1796,6 +1986,7 @@ input(void)
        * being reassembled or the packet is not a fragment.
        */
       PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+      UIP_DS6_TRACE_FRAG_DROP(frag_tag, UIP_DS6_TRACE_FRAG_MISMATCH);
       return;
     }
   } else {
@@ -1864,6 +2055,11 @@ input(void)
    */
   if(packetbuf_datalen() < rime_hdr_len) {
     PRINTF("SICSLOWPAN: packet dropped due to header > total packet\n");
+#if SICSLOWPAN_CONF_FRAG
+    UIP_DS6_TRACE_FRAG_DROP(frag_tag, UIP_DS6_TRACE_FRAG_TRUNCATED);
+#else /* SICSLOWPAN_CONF_FRAG */
+    UIP_DS6_TRACE_FRAG_DROP(0, UIP_DS6_TRACE_FRAG_TRUNCATED);
+#endif /* SICSLOWPAN_CONF_FRAG */
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
@@ -1891,6 +2087,13 @@ input(void)
   if(processed_ip_len == 0 || (processed_ip_len == sicslowpan_len)){
     PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
            sicslowpan_len);
+#if SICSLOWPAN_THREADS
+    /* uip_buf belongs to the thread of the IP layer */
+    rx_ring_put();
+    sicslowpan_len = 0;
+    processed_ip_len = 0;
+    return;
+#endif /* SICSLOWPAN_THREADS */
     memcpy((void *)UIP_IP_BUF, (void *)SICSLOWPAN_IP_BUF, sicslowpan_len);
     uip_len = sicslowpan_len;
     sicslowpan_len = 0;
@@ -1912,7 +2115,11 @@ input(void)
 #if SICSLOWPAN_CONF_NEIGHBOR_INFO
     neighbor_info_packet_received();
 #endif /* SICSLOWPAN_CONF_NEIGHBOR_INFO */
-
+    uip_ds6_if_select(sicslowpan_ifindex);
+#if UIP_DS6_LINK_ESTIMATOR
+    uip_ds6_link_received((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                          (int16_t)packetbuf_attr(PACKETBUF_ATTR_RSSI));
+#endif /* UIP_DS6_LINK_ESTIMATOR */
     tcpip_input();
 #if SICSLOWPAN_CONF_FRAG
   }
@@ -1935,6 +2142,16 @@ sicslowpan_init(void)
    */
   tcpip_set_outputfunc(output);
 
+#if SICSLOWPAN_THREADS
+  if(pipe(rx_pipe) == 0) {
+    fcntl(rx_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(rx_pipe[1], F_SETFL, O_NONBLOCK);
+  } else {
+    rx_pipe[0] = rx_pipe[1] = -1;
+  }
+  process_start(&sicslowpan_rx_process, NULL);
+#endif /* SICSLOWPAN_THREADS */
+
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 #if !CONF_6LOWPAN_ND_6CO
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 
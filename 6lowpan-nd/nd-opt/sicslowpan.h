@@ -63,6 +63,40 @@
 
 /** @} */
 
+/**
+ * \name Threaded input, for routers hosted on a POSIX system
+ * @{
+ */
+/* Each radio calls input() from its own thread, and the adaptation layer
+ * state is thread-local. Reassembled packets reach the IP layer through one
+ * single-producer single-consumer ring per interface, drained by
+ * sicslowpan_rx_process. Needs SICSLOWPAN_CONF_FRAG; the packetbuf of the
+ * platform must be thread-local too. */
+#ifdef SICSLOWPAN_CONF_THREADS
+#define SICSLOWPAN_THREADS SICSLOWPAN_CONF_THREADS
+#else
+#define SICSLOWPAN_THREADS 0
+#endif
+#ifdef SICSLOWPAN_CONF_RING_SIZE
+#define SICSLOWPAN_RING_SIZE SICSLOWPAN_CONF_RING_SIZE
+#else
+#define SICSLOWPAN_RING_SIZE 8 /* packets, a power of two */
+#endif
+#if SICSLOWPAN_THREADS
+#define SICSLOWPAN_TLS __thread
+#else
+#define SICSLOWPAN_TLS
+#endif
+/* Radio threads can not poll a Contiki process. They wake the IP thread
+ * through a pipe, see sicslowpan_rx_fd(); a platform that does not watch
+ * it gets the packets within this interval. */
+#ifdef SICSLOWPAN_CONF_RX_POLL_INTERVAL
+#define SICSLOWPAN_RX_POLL_INTERVAL SICSLOWPAN_CONF_RX_POLL_INTERVAL
+#else
+#define SICSLOWPAN_RX_POLL_INTERVAL (CLOCK_SECOND / 100 > 0 ? CLOCK_SECOND / 100 : 1)
+#endif
+/** @} */
+
 /**
  * \name 6lowpan compressions
  * @{
@@ -320,5 +354,22 @@ struct sicslowpan_nh_compressor {
 extern const struct network_driver sicslowpan_driver;
 
 extern const struct mac_driver *sicslowpan_mac;
+#if UIP_DS6_IF_NB > 1
+/** \brief The DS6 interface frames are received on. Drivers that share
+ * this layer among several radios set it before passing a frame up; with
+ * SICSLOWPAN_THREADS, each radio thread sets its own once. */
+extern SICSLOWPAN_TLS u8_t sicslowpan_ifindex;
+#endif /* UIP_DS6_IF_NB > 1 */
+#if SICSLOWPAN_THREADS
+/**
+ * \brief Read end of a pipe that becomes readable when a radio thread
+ * queued packets for the IP layer. A platform whose main loop sleeps in
+ * select() adds it to the read set, and calls sicslowpan_rx_wakeup() from
+ * the IP thread when it is readable. -1 if the pipe could not be created.
+ */
+int sicslowpan_rx_fd(void);
+/** \brief IP thread: pass up the packets queued by the radio threads */
+void sicslowpan_rx_wakeup(void);
+#endif /* SICSLOWPAN_THREADS */
 #endif /* __SICSLOWPAN_H__ */
 /** @} */
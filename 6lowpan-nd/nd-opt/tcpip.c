@@ -78,6 +78,14 @@ void uip_log(char *msg);
 #ifdef UIP_FALLBACK_INTERFACE
 extern struct uip_fallback_interface UIP_FALLBACK_INTERFACE;
 #endif
+
+#if UIP_CONF_IPV6
+#if UIP_DS6_DEFRT_FLOW_HASH
+#define DEFRT_CHOOSE() uip_ds6_defrt_choose_flow(&UIP_IP_BUF->srcipaddr, flow_hash())
+#else
+#define DEFRT_CHOOSE() uip_ds6_defrt_choose()
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
+#endif /* UIP_CONF_IPV6 */
 #if UIP_CONF_IPV6_RPL
 void rpl_init(void);
 #endif
@@ -120,7 +128,14 @@ enum {
 /* Called on IP packet output. */
 #if UIP_CONF_IPV6
 
+#if UIP_DS6_IF_NB > 1
+/* One output function per interface, the one of the current interface is
+ * used */
+static u8_t (* outputfuncs[UIP_DS6_IF_NB])(uip_lladdr_t *a);
+#define outputfunc outputfuncs[uip_ds6_if_index]
+#else /* UIP_DS6_IF_NB > 1 */
 static u8_t (* outputfunc)(uip_lladdr_t *a);
+#endif /* UIP_DS6_IF_NB > 1 */
 
 u8_t
 tcpip_output(uip_lladdr_t *a)
@@ -137,8 +152,25 @@ tcpip_output(uip_lladdr_t *a)
 void
 tcpip_set_outputfunc(u8_t (*f)(uip_lladdr_t *))
 {
+#if UIP_DS6_IF_NB > 1
+  u8_t i;
+
+  /* A single driver for all interfaces */
+  for(i = 0; i < UIP_DS6_IF_NB; i++) {
+    outputfuncs[i] = f;
+  }
+#else /* UIP_DS6_IF_NB > 1 */
   outputfunc = f;
+#endif /* UIP_DS6_IF_NB > 1 */
 }
+
+#if UIP_DS6_IF_NB > 1
+void
+tcpip_if_set_outputfunc(u8_t ifindex, u8_t (*f)(uip_lladdr_t *))
+{
+  outputfuncs[ifindex] = f;
+}
+#endif /* UIP_DS6_IF_NB > 1 */
 #else
 
 static u8_t (* outputfunc)(void);
@@ -482,8 +514,14 @@ eventhandler(process_event_t ev, process_data_t data)
           uip_nd6_periodic();
           tcpip_ipv6_output();
         }*/
+#if UIP_DS6_INSTANCES
+        /* Each instance has its periodic timer: find out whose it is */
+        if(uip_ds6_instance_timer(data) &&
+           etimer_expired(&uip_ds6_timer_periodic)){
+#else /* UIP_DS6_INSTANCES */
         if(data == &uip_ds6_timer_periodic &&
            etimer_expired(&uip_ds6_timer_periodic)){
+#endif /* UIP_DS6_INSTANCES */
           uip_ds6_periodic();
           tcpip_ipv6_output();
         }
@@ -540,11 +578,51 @@ tcpip_input(void)
 }
 /*---------------------------------------------------------------------------*/
 #if UIP_CONF_IPV6
+#if UIP_DS6_DEFRT_FLOW_HASH
+/* FNV-1a hash of a flow: addresses, protocol and, for UDP and TCP, the
+ * source and destination ports as they are on the wire (ports may be NULL) */
+static u32_t
+flow_hash_of(uip_ipaddr_t *src, uip_ipaddr_t *dst, u8_t proto, u8_t *ports)
+{
+  u32_t h = 2166136261UL;
+  u8_t i;
+
+  for(i = 0; i < 16; i++) {
+    h = (h ^ src->u8[i]) * 16777619UL;
+  }
+  for(i = 0; i < 16; i++) {
+    h = (h ^ dst->u8[i]) * 16777619UL;
+  }
+  h = (h ^ proto) * 16777619UL;
+  if(ports != NULL && (proto == UIP_PROTO_UDP || proto == UIP_PROTO_TCP)) {
+    for(i = 0; i < 4; i++) {
+      h = (h ^ ports[i]) * 16777619UL;
+    }
+  }
+  return h;
+}
+
+/* Flow of the packet in uip_buf; the ports of UDP and TCP are right after
+ * the IPv6 header */
+static u32_t
+flow_hash(void)
+{
+  return flow_hash_of(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr,
+                      UIP_IP_BUF->proto, &uip_buf[UIP_LLIPH_LEN]);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
 void
 tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t* nexthop;
+#if UIP_DS6_IF_NB > 1
+  u8_t i;
+  /* Next hop determination may select another interface: the caller's is
+   * selected again once the packet is sent or queued */
+  u8_t ifindex = uip_ds6_if_index;
+#endif /* UIP_DS6_IF_NB > 1 */
   
   if(uip_len == 0) {
     return;
@@ -569,17 +647,33 @@ tcpip_ipv6_output(void)
       uip_ds6_route_t* locrt;
       locrt = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
       if(locrt == NULL) {
-        if((nexthop = uip_ds6_defrt_choose()) == NULL) {
+        nexthop = DEFRT_CHOOSE();
+#if UIP_DS6_IF_NB > 1
+        /* None on the current interface: the first one on another */
+        for(i = 0; nexthop == NULL && i < UIP_DS6_IF_NB; i++) {
+          uip_ds6_if_select(i);
+          nexthop = DEFRT_CHOOSE();
+        }
+#endif /* UIP_DS6_IF_NB > 1 */
+        if(nexthop == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
 	  UIP_FALLBACK_INTERFACE.output();
+#elif UIP_DS6_QUEUE_NB > 0
+          /* Held until a default router is known, e.g. after boot or when
+           * the last one failed */
+          uip_ds6_queue_add(NULL);
 #else
           PRINTF("tcpip_ipv6_output: Destination off-link but no route\n");
 #endif
+          uip_ds6_if_select(ifindex);
           uip_len = 0;
           return;
         }
       } else {
         nexthop = &locrt->nexthop;
+#if UIP_DS6_IF_NB > 1
+        uip_ds6_if_select(locrt->ifindex);
+#endif /* UIP_DS6_IF_NB > 1 */
       }
     }
     /* end of next hop determination */
@@ -591,9 +685,36 @@ tcpip_ipv6_output(void)
 	 * In addition, there are neither INCOMPLETE, STALE, DELAY, nor PROBE NCEs 
 	 * in 6LoWPAN-ND.
 	 */	
+#if UIP_CONF_ROUTER
+      /* Link-local addresses are formed from the EUI-64, so the link-layer
+       * address can be derived from them. This is how a 6LR answers a
+       * registration it refused, for which it has no NCE. */
+      if(uip_is_addr_link_local(nexthop)) {
+        uip_lladdr_t lladdr;
+        uip_ds6_set_lladdr_from_iid(&lladdr, nexthop);
+        tcpip_output(&lladdr);
+        uip_ds6_if_select(ifindex);
+        uip_len = 0;
+        return;
+      }
+#endif /* UIP_CONF_ROUTER */
+#if UIP_DS6_QUEUE_NB > 0
+      /* Held until an NCE is added for the next hop */
+      uip_ds6_queue_add(nexthop);
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+      uip_ds6_if_select(ifindex);
+      uip_len = 0;
 		return;
     } else {
+#if UIP_DS6_QUEUE_NB > 0
+      if(uip_ds6_queue_hold(nbr)) {
+        uip_ds6_if_select(ifindex);
+        uip_len = 0;
+        return;
+      }
+#endif /* UIP_DS6_QUEUE_NB > 0 */
     	tcpip_output(&(nbr->lladdr));
+      uip_ds6_if_select(ifindex);
       uip_len = 0;
       return;
     }
@@ -643,6 +764,26 @@ tcpip_uipcall(void)
    static unsigned char i;
    register struct listenport *l;
    
+#if UIP_CONF_IPV6
+   /* New data acknowledged: the path to the peer works, no need for NUD */
+   if(uip_conn != NULL && uip_acked()) {
+#if UIP_DS6_DEFRT_FLOW_HASH
+     /* The flow of our segments, which picked the router they went through */
+     uip_ipaddr_t src;
+     u16_t ports[2];
+
+     uip_ds6_select_src(&src, &uip_conn->ripaddr);
+     ports[0] = uip_conn->lport;
+     ports[1] = uip_conn->rport;
+     uip_ds6_reachability_confirm(&src, &uip_conn->ripaddr,
+                                  flow_hash_of(&src, &uip_conn->ripaddr,
+                                               UIP_PROTO_TCP, (u8_t *)ports));
+#else /* UIP_DS6_DEFRT_FLOW_HASH */
+     uip_ds6_reachability_confirm(NULL, &uip_conn->ripaddr, 0);
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
+   }
+#endif /* UIP_CONF_IPV6 */
+   
    /* If this is a connection request for a listening port, we must
       mark the connection with the right process ID. */
    if(uip_connected()) {
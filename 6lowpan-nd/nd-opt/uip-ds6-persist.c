@@ -0,0 +1,345 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *         Persistent registrations for routers hosted on a POSIX system.
+ *         The registered NCEs and the 6LBR table are mirrored, entry by
+ *         entry, in a memory-mapped file, and adopted again at startup.
+ */
+/*
+ * Copyright (c) 2006, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+#include "nd-opt/uip-ds6.h"
+
+#if UIP_CONF_ROUTER && UIP_DS6_PERSIST
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define PERSIST_MAGIC 0x44533650 /* "DS6P" */
+#define PERSIST_TMP_FILE UIP_DS6_PERSIST_FILE ".tmp"
+
+/*
+ * File layout: a header, then one record per entry of the neighbor cache,
+ * then one per entry of the 6LBR table. Record i mirrors entry i of the
+ * table, so that a change is saved by rewriting one record.
+ * Lifetimes are saved as absolute deadlines (time()), as the Contiki clock
+ * starts again from 0 at restart. Each record has its own checksum: a
+ * record half written when the process died is just ignored.
+ */
+struct persist_hdr {
+  u32_t magic;
+  u16_t version;
+  u16_t nbr_nb;
+  u16_t lbr_nb;
+  u8_t nbr_size;
+  u8_t lbr_size;
+};
+
+struct persist_nbr {
+  u32_t deadline; /**< end of the registration, 0 for an empty record */
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t lladdr;
+  uip_lladdr_t eui64;
+  u8_t isrouter;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;
+#endif /* UIP_DS6_IF_NB > 1 */
+  u16_t check;
+};
+
+struct persist_lbr {
+  u32_t deadline;
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t eui64;
+  u16_t check;
+};
+
+#if UIP_ND6_MULTIHOP_DAD
+#define PERSIST_LBR_NB UIP_DS6_LBR_REG_NB
+#else
+#define PERSIST_LBR_NB 0
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+#define PERSIST_SIZE (sizeof(struct persist_hdr) + \
+                      UIP_DS6_NBR_NB * sizeof(struct persist_nbr) + \
+                      PERSIST_LBR_NB * sizeof(struct persist_lbr))
+
+static struct persist_hdr *hdr;
+static struct persist_nbr *nbr_rec;
+#if UIP_ND6_MULTIHOP_DAD
+static struct persist_lbr *lbr_rec;
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+/*---------------------------------------------------------------------------*/
+/* Fletcher-16 over a record, check field excluded (it comes last) */
+static u16_t
+check(const void *rec, u16_t len)
+{
+  const u8_t *p = rec;
+  u16_t a = 0, b = 0;
+
+  while(len--) {
+    a = (a + *p++) % 255;
+    b = (b + a) % 255;
+  }
+  return (b << 8) | a;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_persist_nbr(uip_ds6_nbr_t *nbr)
+{
+  struct persist_nbr *rec;
+
+  if(hdr == NULL) {
+    return;
+  }
+  rec = &nbr_rec[nbr - uip_ds6_nbr_cache];
+  memset(rec, 0, sizeof(*rec));
+  if(nbr->isused && nbr->reg_state == REG_REGISTERED) {
+    rec->deadline = (u32_t)time(NULL) + stimer_remaining(&nbr->reg_lifetime);
+    uip_ipaddr_copy(&rec->ipaddr, &nbr->ipaddr);
+    memcpy(&rec->lladdr, &nbr->lladdr, UIP_LLADDR_LEN);
+    memcpy(&rec->eui64, &nbr->eui64, UIP_LLADDR_LEN);
+    rec->isrouter = nbr->isrouter;
+#if UIP_DS6_IF_NB > 1
+    rec->ifindex = nbr->ifindex;
+#endif /* UIP_DS6_IF_NB > 1 */
+  }
+  rec->check = check(rec, offsetof(struct persist_nbr, check));
+}
+
+#if UIP_ND6_MULTIHOP_DAD
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_persist_lbr(uip_ds6_lbr_reg_t *reg)
+{
+  struct persist_lbr *rec;
+
+  if(hdr == NULL) {
+    return;
+  }
+  rec = &lbr_rec[reg - uip_ds6_lbr_reg_table];
+  memset(rec, 0, sizeof(*rec));
+  if(reg->isused) {
+    rec->deadline = (u32_t)time(NULL) + stimer_remaining(&reg->lifetime);
+    uip_ipaddr_copy(&rec->ipaddr, &reg->ipaddr);
+    memcpy(&rec->eui64, &reg->eui64, UIP_LLADDR_LEN);
+  }
+  rec->check = check(rec, offsetof(struct persist_lbr, check));
+}
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+/*---------------------------------------------------------------------------*/
+/* Adopts the valid, unexpired records. The tables were just initialized */
+static void
+restore(void)
+{
+  struct persist_nbr *rec;
+  uip_ds6_nbr_t *nbr;
+  u32_t now = (u32_t)time(NULL);
+#if UIP_ND6_MULTIHOP_DAD
+  struct persist_lbr *lrec;
+  uip_ds6_lbr_reg_t *reg;
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+  for(rec = nbr_rec; rec < nbr_rec + UIP_DS6_NBR_NB; rec++) {
+    if(rec->deadline <= now ||
+       rec->check != check(rec, offsetof(struct persist_nbr, check))) {
+      continue;
+    }
+#if UIP_DS6_IF_NB > 1
+    if(rec->ifindex >= UIP_DS6_IF_NB) {
+      continue;
+    }
+    uip_ds6_if_select(rec->ifindex);
+#endif /* UIP_DS6_IF_NB > 1 */
+    /* NUD confirms the reachability when the neighbor is used */
+    nbr = uip_ds6_nbr_add(&rec->ipaddr, &rec->lladdr, rec->isrouter,
+                          NBR_STALE);
+    if(nbr == NULL) {
+      break;
+    }
+    uip_ds6_nbr_set_reg_state(nbr, REG_REGISTERED);
+    memcpy(&nbr->eui64, &rec->eui64, UIP_LLADDR_LEN);
+    stimer_set(&nbr->reg_lifetime, rec->deadline - now);
+  }
+  uip_ds6_if_select(0);
+#if UIP_ND6_MULTIHOP_DAD
+  for(lrec = lbr_rec; lrec < lbr_rec + UIP_DS6_LBR_REG_NB; lrec++) {
+    if(lrec->deadline <= now ||
+       lrec->check != check(lrec, offsetof(struct persist_lbr, check))) {
+      continue;
+    }
+    reg = uip_ds6_lbr_reg_add(&lrec->ipaddr, &lrec->eui64);
+    if(reg == NULL) {
+      break;
+    }
+    stimer_set(&reg->lifetime, lrec->deadline - now);
+  }
+#endif /* UIP_ND6_MULTIHOP_DAD */
+}
+
+/*---------------------------------------------------------------------------*/
+/* Adopts the records of the current file, if it has the same layout */
+static void
+load(void)
+{
+  int fd;
+  struct stat st;
+  void *map;
+  struct persist_hdr *h;
+
+  fd = open(UIP_DS6_PERSIST_FILE, O_RDONLY);
+  if(fd < 0) {
+    return;
+  }
+  if(fstat(fd, &st) < 0 || (size_t)st.st_size != PERSIST_SIZE) {
+    PRINTF("%s has another layout, starting from scratch\n",
+           UIP_DS6_PERSIST_FILE);
+    close(fd);
+    return;
+  }
+  map = mmap(NULL, PERSIST_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    return;
+  }
+  h = map;
+  if(h->magic == PERSIST_MAGIC &&
+     h->version == UIP_DS6_PERSIST_VERSION &&
+     h->nbr_nb == UIP_DS6_NBR_NB &&
+     h->lbr_nb == PERSIST_LBR_NB &&
+     h->nbr_size == sizeof(struct persist_nbr) &&
+     h->lbr_size == sizeof(struct persist_lbr)) {
+    nbr_rec = (struct persist_nbr *)(h + 1);
+#if UIP_ND6_MULTIHOP_DAD
+    lbr_rec = (struct persist_lbr *)(nbr_rec + UIP_DS6_NBR_NB);
+#endif /* UIP_ND6_MULTIHOP_DAD */
+    restore();
+  } else {
+    PRINTF("%s has another layout, starting from scratch\n",
+           UIP_DS6_PERSIST_FILE);
+  }
+  munmap(map, PERSIST_SIZE);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_persist_init(void)
+{
+  int fd;
+  void *map;
+  uip_ds6_nbr_t *nbr;
+#if UIP_ND6_MULTIHOP_DAD
+  uip_ds6_lbr_reg_t *reg;
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+  hdr = NULL;
+  load();
+
+  /*
+   * The adopted entries may sit elsewhere in the tables, so the whole file
+   * is rewritten. It is built aside and renamed over the current one: a
+   * crash at any point leaves either the old or the new file, complete.
+   */
+  fd = open(PERSIST_TMP_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if(fd < 0) {
+    PRINTF("Can not open %s, registrations will not persist\n",
+           PERSIST_TMP_FILE);
+    return;
+  }
+  if(ftruncate(fd, PERSIST_SIZE) < 0) {
+    close(fd);
+    unlink(PERSIST_TMP_FILE);
+    return;
+  }
+  map = mmap(NULL, PERSIST_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED) {
+    close(fd);
+    unlink(PERSIST_TMP_FILE);
+    return;
+  }
+  hdr = map;
+  nbr_rec = (struct persist_nbr *)(hdr + 1);
+#if UIP_ND6_MULTIHOP_DAD
+  lbr_rec = (struct persist_lbr *)(nbr_rec + UIP_DS6_NBR_NB);
+#endif /* UIP_ND6_MULTIHOP_DAD */
+
+  /* The file was just truncated: it reads as zeroes, magic included */
+  for(nbr = uip_ds6_nbr_cache; nbr < uip_ds6_nbr_cache + UIP_DS6_NBR_NB;
+      nbr++) {
+    uip_ds6_persist_nbr(nbr);
+  }
+#if UIP_ND6_MULTIHOP_DAD
+  for(reg = uip_ds6_lbr_reg_table;
+      reg < uip_ds6_lbr_reg_table + UIP_DS6_LBR_REG_NB; reg++) {
+    uip_ds6_persist_lbr(reg);
+  }
+#endif /* UIP_ND6_MULTIHOP_DAD */
+  hdr->version = UIP_DS6_PERSIST_VERSION;
+  hdr->nbr_nb = UIP_DS6_NBR_NB;
+  hdr->lbr_nb = PERSIST_LBR_NB;
+  hdr->nbr_size = sizeof(struct persist_nbr);
+  hdr->lbr_size = sizeof(struct persist_lbr);
+  /* Written last: a header without magic is never trusted */
+  hdr->magic = PERSIST_MAGIC;
+
+  /* The new file must be on disk before it replaces the old one */
+  if(msync(map, PERSIST_SIZE, MS_SYNC) < 0 || fsync(fd) < 0 ||
+     rename(PERSIST_TMP_FILE, UIP_DS6_PERSIST_FILE) < 0) {
+    PRINTF("Can not replace %s, registrations will not persist\n",
+           UIP_DS6_PERSIST_FILE);
+    munmap(map, PERSIST_SIZE);
+    close(fd);
+    unlink(PERSIST_TMP_FILE);
+    hdr = NULL;
+    return;
+  }
+  /* The mapping follows the file under its new name */
+  close(fd);
+}
+#endif /* UIP_CONF_ROUTER && UIP_DS6_PERSIST */
+/** @} */
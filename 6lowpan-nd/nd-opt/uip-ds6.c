@@ -46,6 +46,11 @@
 #include "nd-opt/uip-nd6.h"
 #include "nd-opt/uip-ds6.h"
 #include "net/uip-packetqueue.h"
+#include "net/tcpip.h"
+#include "net/uip-icmp6.h"
+#if UIP_DS6_CONV_STATS
+#include <stdio.h>
+#endif /* UIP_DS6_CONV_STATS */
 
 #define DEBUG 0
 #if DEBUG
@@ -59,6 +64,21 @@
 #define PRINTLLADDR(addr)
 #endif
 
+#if UIP_CONF_ROUTER && UIP_DS6_PERSIST
+#define PERSIST_NBR(n) uip_ds6_persist_nbr(n)
+#define PERSIST_LBR(r) uip_ds6_persist_lbr(r)
+#else
+#define PERSIST_NBR(n)
+#define PERSIST_LBR(r)
+#endif /* UIP_CONF_ROUTER && UIP_DS6_PERSIST */
+
+/* What routers advertise changed */
+#if UIP_CONF_ROUTER && UIP_ND6_SEND_RA && UIP_ND6_RA_TRICKLE
+#define RA_TRICKLE_RESET() uip_ds6_ra_trickle_reset()
+#else
+#define RA_TRICKLE_RESET()
+#endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA && UIP_ND6_RA_TRICKLE */
+
 #ifdef UIP_CONF_DS6_NEIGHBOR_STATE_CHANGED
 #define NEIGHBOR_STATE_CHANGED(n) UIP_CONF_DS6_NEIGHBOR_STATE_CHANGED(n)
 void NEIGHBOR_STATE_CHANGED(uip_ds6_nbr_t *n);
@@ -66,32 +86,83 @@ void NEIGHBOR_STATE_CHANGED(uip_ds6_nbr_t *n);
 #define NEIGHBOR_STATE_CHANGED(n)
 #endif /* UIP_DS6_CONF_NEIGHBOR_STATE_CHANGED */
 
+#if UIP_DS6_INSTANCES
+uip_ds6_instance_t *uip_ds6_instance;                           /** \brief The current instance */
+static uip_ds6_instance_t *instances;                           /** \brief The instances initialized */
+
+/* Private state of the current instance */
+#define trickle_i (uip_ds6_instance->trickle_i)
+#define trickle_rest (uip_ds6_instance->trickle_rest)
+#define trickle_c (uip_ds6_instance->trickle_c)
+#define trickle_sent (uip_ds6_instance->trickle_sent)
+#define racount (uip_ds6_instance->racount)
+#define rand_time (uip_ds6_instance->rand_time)
+#define rs_suppress (uip_ds6_instance->rs_suppress)
+#define nd_tx_tokens (uip_ds6_instance->nd_tx_tokens)
+#define nd_tx_refill_time (uip_ds6_instance->nd_tx_refill_time)
+#define nd_tx_rr (uip_ds6_instance->nd_tx_rr)
+#define nd_tx_start (uip_ds6_instance->nd_tx_start)
+#define lbr_ipaddr (uip_ds6_instance->lbr_ipaddr)
+#define lbr_reg_hash (uip_ds6_instance->lbr_reg_hash)
+#define lbr_reg_free (uip_ds6_instance->lbr_reg_free)
+#define queue (uip_ds6_instance->queue)
+#define queue_changed (uip_ds6_instance->queue_changed)
+#define nbr_hand (uip_ds6_instance->nbr_hand)
+#define nbr_gc_nb (uip_ds6_instance->nbr_gc_nb)
+#define nbr_hash (uip_ds6_instance->nbr_hash)
+#define nbr_free (uip_ds6_instance->nbr_free)
+#else /* UIP_DS6_INSTANCES */
 struct etimer uip_ds6_timer_periodic;                           /** \brief Timer for maintenance of data structures */
 
 #if UIP_CONF_ROUTER
 struct stimer uip_ds6_timer_ra;                                 /** \brief RA timer, to schedule RA sending */
 #if UIP_ND6_SEND_RA
+#if UIP_ND6_RA_TRICKLE
+static u16_t trickle_i;                                  /** \brief Trickle interval (s), 0 before the first one */
+static u16_t trickle_rest;                               /** \brief time left in the interval after its RA */
+static u8_t trickle_c;                                   /** \brief consistent RAs heard in the interval */
+static u8_t trickle_sent;                                /** \brief the RA of the interval is behind us */
+#else /* UIP_ND6_RA_TRICKLE */
 static u8_t racount;                                         /** \brief number of RA already sent */
 static u16_t rand_time;                                      /** \brief random time value for timers */
+#endif /* UIP_ND6_RA_TRICKLE */
 #endif
 #else /* UIP_CONF_ROUTER */
 struct timer uip_ds6_timer_rs;                                 /** \brief RS timer, to schedule RS sending */
-u8_t rscount = 0;                                         /** \brief number of rs already sent */
+u8_t uip_ds6_rscount = 0;                                 /** \brief number of rs already sent */
+static struct timer rs_suppress;                          /** \brief a RA was received lately, RS not needed */
+uip_ds6_rs_stats_t uip_ds6_rs_stats;                      /** \brief Router discovery counters */
 #endif /* UIP_CONF_ROUTER */
+#if UIP_DS6_CONV_STATS
+uip_ds6_conv_stats_t uip_ds6_conv_stats;                  /** \brief Convergence metrics */
+#endif /* UIP_DS6_CONV_STATS */
 
 /** \name "DS6" Data structures */
 /** @{ */
+#if UIP_DS6_IF_NB > 1
+uip_ds6_netif_t uip_ds6_if_list[UIP_DS6_IF_NB];                   /** \brief The interfaces */
+u8_t uip_ds6_if_index;                                            /** \brief The current interface */
+#else /* UIP_DS6_IF_NB > 1 */
 uip_ds6_netif_t uip_ds6_if;                                       /** \brief The single interface */
+#endif /* UIP_DS6_IF_NB > 1 */
 uip_ds6_nbr_t uip_ds6_nbr_cache[UIP_DS6_NBR_NB];                  /** \brief Neighor cache */
 uip_ds6_reg_t uip_ds6_reg_list[UIP_DS6_REG_LIST_SIZE];				/** \brief Registrations list */
 #if CONF_6LOWPAN_ND_6CO
 uip_ds6_addr_context_t uip_ds6_addr_context_table[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS]; /** \brief Contexts list */
 #endif /* CONF_6LOWPAN_ND_6CO */
 uip_ds6_defrt_t uip_ds6_defrt_list[UIP_DS6_DEFRT_NB];             /** \brief Default rt list */
+#if CONF_6LOWPAN_ND_ABRO
+uip_ds6_abr_t uip_ds6_abr_list[UIP_DS6_ABR_NB];                   /** \brief Authoritative border routers */
+#endif /* CONF_6LOWPAN_ND_ABRO */
 uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];          /** \brief Prefix list */
 uip_ds6_route_t uip_ds6_routing_table[UIP_DS6_ROUTE_NB];          /** \brief Routing table */
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+uip_ds6_dad_t uip_ds6_dad_cache[UIP_DS6_DAD_NB];                  /** \brief Multihop DAD transactions */
+uip_ds6_lbr_reg_t uip_ds6_lbr_reg_table[UIP_DS6_LBR_REG_NB];      /** \brief 6LBR registrations */
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
 
 /** @} */
+#endif /* UIP_DS6_INSTANCES */
 
 /* "full" (as opposed to pointer) ip address used in this file,  */
 static uip_ipaddr_t loc_fipaddr;
@@ -110,49 +181,146 @@ static uip_ds6_route_t *locroute;
 static uip_ds6_reg_t *locreg;
 static uip_ds6_defrt_t *min_defrt; /* default router with minimum lifetime */
 static unsigned long min_lifetime; /* minimum lifetime */
+static unsigned long next_deadline; /* ticks until uip_ds6_periodic() is needed again */
+#if !UIP_DS6_INSTANCES
+static u8_t nd_tx_tokens; /* ND transmit token bucket */
+static clock_time_t nd_tx_refill_time; /* when the last token was added */
+static u16_t nd_tx_start[UIP_DS6_ND_TX_CLASSES]; /* table index each ND class starts from */
+#endif /* !UIP_DS6_INSTANCES */
 #if CONF_6LOWPAN_ND_6CO
 static uip_ds6_addr_context_t *loccontext;
 #endif /* CONF_6LOWPAN_ND_6CO */
+#if CONF_6LOWPAN_ND_ABRO
+static uip_ds6_abr_t *locabr;
+#endif /* CONF_6LOWPAN_ND_ABRO */
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+static uip_ds6_dad_t *locdad;
+static uip_ds6_lbr_reg_t *loclbrreg;
+#if !UIP_DS6_INSTANCES
+static uip_ipaddr_t lbr_ipaddr; /* the 6LBR, unspecified if we stand in for it */
+/* 6LBR table index: entries chained by hash of their IP address, and
+ * unused entries kept in a free list */
+static uip_ds6_lbr_reg_t *lbr_reg_hash[UIP_DS6_LBR_REG_HASH_SIZE];
+static uip_ds6_lbr_reg_t *lbr_reg_free;
+#endif /* !UIP_DS6_INSTANCES */
+#define LBR_REG_HASH(a) ((((u16_t)(a)->u8[12] << 8 | (a)->u8[13]) ^ \
+                          ((u16_t)(a)->u8[14] << 8 | (a)->u8[15])) % UIP_DS6_LBR_REG_HASH_SIZE)
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+#if !UIP_DS6_INSTANCES
+#if UIP_DS6_QUEUE_NB > 0
+/* Packets waiting for their next hop, see uip_ds6_queue_add() */
+static uip_ds6_queue_t queue[UIP_DS6_QUEUE_NB];
+static u8_t queue_changed; /* an NCE or a router was added since last flush */
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+/* CLOCK hand of the neighbor cache: the next entry of the ring of evictable
+ * entries (gc_next) considered for eviction, NULL if the ring is empty */
+static uip_ds6_nbr_t *nbr_hand;
+static u16_t nbr_gc_nb; /* entries in the ring */
+#if UIP_DS6_NBR_HASH_SIZE > 0
+/* Neighbor cache index: entries chained by hash of their IP address, and
+ * unused entries kept in a free list */
+static uip_ds6_nbr_t *nbr_hash[UIP_DS6_NBR_HASH_SIZE];
+static uip_ds6_nbr_t *nbr_free;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+#endif /* !UIP_DS6_INSTANCES */
+#if UIP_DS6_NBR_HASH_SIZE > 0
+#define NBR_HASH(a) ((((u16_t)(a)->u8[12] << 8 | (a)->u8[13]) ^ \
+                      ((u16_t)(a)->u8[14] << 8 | (a)->u8[15])) % UIP_DS6_NBR_HASH_SIZE)
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_init(void)
 {
+  u8_t i;
+#if UIP_DS6_INSTANCES
+  uip_ds6_instance_t *inst;
+
+  for(inst = instances; inst != NULL && inst != uip_ds6_instance;
+      inst = inst->next);
+  if(inst == NULL) {
+    uip_ds6_instance->next = instances;
+    instances = uip_ds6_instance;
+  }
+#endif /* UIP_DS6_INSTANCES */
+
   PRINTF("Init of IPv6 data structures\n");
   PRINTF("%u neighbors\n%u default routers\n%u prefixes\n%u routes\n%u unicast addresses\n%u multicast addresses\n%u anycast addresses\n",
      UIP_DS6_NBR_NB, UIP_DS6_DEFRT_NB, UIP_DS6_PREFIX_NB, UIP_DS6_ROUTE_NB,
      UIP_DS6_ADDR_NB, UIP_DS6_MADDR_NB, UIP_DS6_AADDR_NB);
   memset(uip_ds6_nbr_cache, 0, sizeof(uip_ds6_nbr_cache));
+  nbr_hand = NULL;
+  nbr_gc_nb = 0;
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  memset(nbr_hash, 0, sizeof(nbr_hash));
+  nbr_free = NULL;
+  for(locnbr = uip_ds6_nbr_cache + UIP_DS6_NBR_NB - 1;
+      locnbr >= uip_ds6_nbr_cache; locnbr--) {
+    locnbr->hash_next = nbr_free;
+    nbr_free = locnbr;
+  }
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
 	memset(uip_ds6_reg_list, 0, sizeof(uip_ds6_reg_list));
 #if CONF_6LOWPAN_ND_6CO
 	memset(uip_ds6_addr_context_table, 0, sizeof(uip_ds6_addr_context_table));
 #endif /* CONF_6LOWPAN_ND_6CO */	
   memset(uip_ds6_defrt_list, 0, sizeof(uip_ds6_defrt_list));
+#if CONF_6LOWPAN_ND_ABRO
+  memset(uip_ds6_abr_list, 0, sizeof(uip_ds6_abr_list));
+#endif /* CONF_6LOWPAN_ND_ABRO */
   memset(uip_ds6_prefix_list, 0, sizeof(uip_ds6_prefix_list));
+#if UIP_DS6_IF_NB > 1
+  memset(uip_ds6_if_list, 0, sizeof(uip_ds6_if_list));
+#else /* UIP_DS6_IF_NB > 1 */
   memset(&uip_ds6_if, 0, sizeof(uip_ds6_if));
+#endif /* UIP_DS6_IF_NB > 1 */
   memset(uip_ds6_routing_table, 0, sizeof(uip_ds6_routing_table));
-
-  /* Set interface parameters */
-  uip_ds6_if.link_mtu = UIP_LINK_MTU;
-  uip_ds6_if.cur_hop_limit = UIP_TTL;
-  uip_ds6_if.base_reachable_time = UIP_ND6_REACHABLE_TIME;
-  uip_ds6_if.reachable_time = uip_ds6_compute_reachable_time();
-  uip_ds6_if.retrans_timer = UIP_ND6_RETRANS_TIMER;
-
-  /* Create link local address, prefix, multicast addresses, anycast addresses */
-  uip_create_linklocal_prefix(&loc_fipaddr);
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+  memset(uip_ds6_dad_cache, 0, sizeof(uip_ds6_dad_cache));
+  memset(uip_ds6_lbr_reg_table, 0, sizeof(uip_ds6_lbr_reg_table));
+  memset(lbr_reg_hash, 0, sizeof(lbr_reg_hash));
+  lbr_reg_free = NULL;
+  for(loclbrreg = uip_ds6_lbr_reg_table + UIP_DS6_LBR_REG_NB - 1;
+      loclbrreg >= uip_ds6_lbr_reg_table; loclbrreg--) {
+    loclbrreg->hash_next = lbr_reg_free;
+    lbr_reg_free = loclbrreg;
+  }
+  uip_create_unspecified(&lbr_ipaddr);
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+#if UIP_DS6_QUEUE_NB > 0
+  for(i = 0; i < UIP_DS6_QUEUE_NB; i++) {
+    uip_packetqueue_new(&queue[i].handle);
+  }
+  queue_changed = 0;
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+
+  for(i = 0; i < UIP_DS6_IF_NB; i++) {
+    uip_ds6_if_select(i);
+    /* Set interface parameters */
+    uip_ds6_if.link_mtu = UIP_LINK_MTU;
+    uip_ds6_if.cur_hop_limit = UIP_TTL;
+    uip_ds6_if.base_reachable_time = UIP_ND6_REACHABLE_TIME;
+    uip_ds6_if.reachable_time = uip_ds6_compute_reachable_time();
+    uip_ds6_if.retrans_timer = UIP_ND6_RETRANS_TIMER;
+
+    /* Create link local address, prefix, multicast addresses, anycast addresses */
+    uip_create_linklocal_prefix(&loc_fipaddr);
 #if UIP_CONF_ROUTER
-  uip_ds6_prefix_add(&loc_fipaddr, UIP_DEFAULT_PREFIX_LEN, 0, 0, 0, 0);
+    uip_ds6_prefix_add(&loc_fipaddr, UIP_DEFAULT_PREFIX_LEN, 0, 0, 0, 0);
 #else /* UIP_CONF_ROUTER */
-  uip_ds6_prefix_add(&loc_fipaddr, UIP_DEFAULT_PREFIX_LEN, 0);
+    uip_ds6_prefix_add(&loc_fipaddr, UIP_DEFAULT_PREFIX_LEN, 0);
 #endif /* UIP_CONF_ROUTER */
-  uip_ds6_set_addr_iid(&loc_fipaddr, &uip_lladdr);
-  uip_ds6_addr_add(&loc_fipaddr, 0, ADDR_AUTOCONF);
+    uip_ds6_set_addr_iid(&loc_fipaddr, &uip_lladdr);
+    uip_ds6_addr_add(&loc_fipaddr, 0, ADDR_AUTOCONF);
 
-  uip_create_linklocal_allnodes_mcast(&loc_fipaddr);
-  uip_ds6_maddr_add(&loc_fipaddr);
+    uip_create_linklocal_allnodes_mcast(&loc_fipaddr);
+    uip_ds6_maddr_add(&loc_fipaddr);
+#if UIP_CONF_ROUTER
+    uip_create_linklocal_allrouters_mcast(&loc_fipaddr);
+    uip_ds6_maddr_add(&loc_fipaddr);
+#endif /* UIP_CONF_ROUTER */
+  }
+  uip_ds6_if_select(0);
 #if UIP_CONF_ROUTER
-  uip_create_linklocal_allrouters_mcast(&loc_fipaddr);
-  uip_ds6_maddr_add(&loc_fipaddr);
 #if UIP_ND6_SEND_RA
   stimer_set(&uip_ds6_timer_ra, 2);     /* wait to have a link local IP address */
 #endif /* UIP_ND6_SEND_RA */
@@ -161,19 +329,727 @@ uip_ds6_init(void)
              random_rand() % (UIP_ND6_MAX_RTR_SOLICITATION_DELAY *
                               CLOCK_SECOND));
 #endif /* UIP_CONF_ROUTER */
+#if UIP_CONF_ROUTER && UIP_DS6_PERSIST
+  /* Adopt the registrations saved before the restart */
+  uip_ds6_persist_init();
+#endif /* UIP_CONF_ROUTER && UIP_DS6_PERSIST */
+  nd_tx_tokens = UIP_DS6_ND_TX_BURST;
+  nd_tx_refill_time = clock_time();
+  memset(nd_tx_start, 0, sizeof(nd_tx_start));
+#if UIP_DS6_CONV_STATS
+  memset(&uip_ds6_conv_stats, 0, sizeof(uip_ds6_conv_stats));
+  uip_ds6_conv_stats.start = clock_time();
+#endif /* UIP_DS6_CONV_STATS */
   etimer_set(&uip_ds6_timer_periodic, UIP_DS6_PERIOD);
 
   return;
 }
 
+#if UIP_DS6_INSTANCES
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_instance_select(uip_ds6_instance_t *inst)
+{
+  uip_ds6_instance = inst;
+  memcpy(&uip_lladdr, &inst->lladdr, UIP_LLADDR_LEN);
+  rimeaddr_copy(&rimeaddr_node_addr, (rimeaddr_t *)&inst->lladdr);
+}
+
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_ds6_instance_timer(void *timer)
+{
+  uip_ds6_instance_t *inst;
+
+  for(inst = instances; inst != NULL; inst = inst->next) {
+    if(timer == &inst->timer_periodic) {
+      uip_ds6_instance_select(inst);
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* UIP_DS6_INSTANCES */
+
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Lower the deadline of the next uip_ds6_periodic() invocation.
+ * \param ticks Time from now (in clock ticks) at which some state needs
+ *        processing.
+ */
+static void
+set_deadline(unsigned long ticks)
+{
+  if(ticks < next_deadline) {
+    next_deadline = ticks;
+  }
+}
+
+/** \brief Same as set_deadline(), with a delay in seconds (stimer based
+ * structures) */
+static void
+set_deadline_seconds(unsigned long seconds)
+{
+  if(seconds < next_deadline / CLOCK_SECOND) {
+    set_deadline(seconds * CLOCK_SECOND);
+  }
+}
+
+/** \brief Same as set_deadline(), for the expiration of a timer */
+static void
+set_deadline_timer(struct timer *t)
+{
+  if(timer_expired(t)) {
+    set_deadline(0);
+  } else {
+    set_deadline((clock_time_t)(t->start + t->interval - clock_time()));
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* ND transmit scheduler.
+ * uip_ds6_periodic() does not send ND messages while it walks the data
+ * structures: it queues the entries that have a message due in one queue
+ * per class. The queues are then served round-robin as long as the token
+ * bucket allows it. Each message is flushed with tcpip_ipv6_output() right
+ * after it is built, as they all use uip_buf. The queues only live for one
+ * invocation: whatever is left is found due again on the next one. So that
+ * the entries at the start of a table do not always fill the queue first,
+ * each table is walked from the entry after the last one served. */
+#define ND_TX_TOKEN_TICKS (CLOCK_SECOND / UIP_DS6_ND_TX_RATE > 0 ? \
+                           CLOCK_SECOND / UIP_DS6_ND_TX_RATE : 1)
+
+struct nd_tx_queue {
+  void *item[UIP_DS6_ND_TX_QUEUE_LEN];
+  u8_t len;
+  u8_t head;
+  u8_t overflow; /* due entries did not fit */
+};
+
+static struct nd_tx_queue nd_tx_queues[UIP_DS6_ND_TX_CLASSES];
+#if !UIP_DS6_INSTANCES
+static u8_t nd_tx_rr;                   /* class served first next time */
+
+uip_ds6_nd_tx_stats_t uip_ds6_nd_tx_stats;
+#endif /* !UIP_DS6_INSTANCES */
+
+/*---------------------------------------------------------------------------*/
+static void
+nd_tx_refill(void)
+{
+  clock_time_t now = clock_time();
+
+  while((nd_tx_tokens < UIP_DS6_ND_TX_BURST) &&
+        ((clock_time_t)(now - nd_tx_refill_time) >= ND_TX_TOKEN_TICKS)) {
+    nd_tx_tokens++;
+    nd_tx_refill_time += ND_TX_TOKEN_TICKS;
+  }
+  if(nd_tx_tokens >= UIP_DS6_ND_TX_BURST) {
+    /* A full bucket does not accumulate credit */
+    nd_tx_refill_time = now;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+static void
+nd_tx_enqueue(u8_t class, void *item)
+{
+  struct nd_tx_queue *q = &nd_tx_queues[class];
+
+  if(q->len >= UIP_DS6_ND_TX_QUEUE_LEN) {
+    /* Still due, it will be queued again on the next invocation */
+    q->overflow = 1;
+    set_deadline(ND_TX_TOKEN_TICKS);
+    return;
+  }
+  q->item[q->len++] = item;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Whether a registration with defrt is waiting for its NA. Error NAs
+ * are sent to our link-local address, so only one registration per router
+ * may be in progress for them to be matched to it */
+static u8_t
+defrt_reg_in_progress(uip_ds6_defrt_t *defrt)
+{
+  uip_ds6_reg_t *reg;
+
+  for(reg = defrt->reg_list; reg != NULL; reg = reg->defrt_next) {
+    if(reg->in_progress) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Send the next (re)registration NS for reg, or give up on its
+ * router if we already sent UIP_ND6_MAX_UNICAST_SOLICIT of them */
+static void
+nd_tx_send_reg(uip_ds6_reg_t *reg)
+{
+  uip_ds6_defrt_t *defrt;
+
+  if(!reg->isused) {
+    return;
+  }
+  if(reg->in_progress) {
+    /* We already sent a NS message for this address but there has been no response */
+    if(reg->reg_count >= UIP_ND6_MAX_UNICAST_SOLICIT) {
+      /* NUD failed. Signal the need for next-hop determination by deleting the 
+       * NCE (RFC 4861) */
+      UIP_ND6_STAT(++uip_nd6_stats.reg_failures);
+      /* Delete neighbor and corresponding router (as hosts only keep
+       * NCEs for routers in 6lowpan-nd) */ 
+      defrt = reg->defrt;
+      locnbr = uip_ds6_nbr_lookup(&defrt->ipaddr); 
+      uip_ds6_nbr_rm(locnbr);
+      /* This also deletes all registrations with that router, this one
+       * included: uip_ds6_defrt_rm() still sees it registered, so a failed
+       * refresh counts as the loss of the router */
+      uip_ds6_defrt_rm(defrt);
+#if !UIP_CONF_ROUTER
+      /* We will also need to start sending RS, as specified in I-D.ietf-6lowpan-nd 
+       * for NUD failure case */
+      uip_ds6_send_rs(NULL);
+#endif /* !UIP_CONF_ROUTER */
+    } else {
+      UIP_ND6_STAT(++uip_nd6_stats.reg_retries);
+      reg->reg_count++;
+      timer_restart(&reg->registration_timer);
+      uip_nd6_ns_output(&reg->addr->ipaddr, &reg->defrt->ipaddr, 
+                        &reg->defrt->ipaddr, 1, UIP_ND6_REGISTRATION_LIFETIME);
+    }
+  } else if(uip_ds6_if.registrations_in_progress < UIP_DS6_MAX_REGS_IN_PROGRESS &&
+            !defrt_reg_in_progress(reg->defrt)) {
+    /* Issue (re)registration */
+    reg->in_progress = 1;
+    uip_ds6_if.registrations_in_progress++;
+    reg->reg_count++;
+    timer_set(&reg->registration_timer, (uip_ds6_if.retrans_timer / 1000) * CLOCK_SECOND);
+    if(reg->state == REG_TO_BE_UNREGISTERED) {
+      uip_nd6_ns_output(&reg->addr->ipaddr, &reg->defrt->ipaddr, 
+                        &reg->defrt->ipaddr, 1, 0);
+    } else {
+      uip_nd6_ns_output(&reg->addr->ipaddr, &reg->defrt->ipaddr, 
+                        &reg->defrt->ipaddr, 1, UIP_ND6_REGISTRATION_LIFETIME);
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Send the next NUD (or address resolution) NS for nbr */
+static void
+nd_tx_send_nud(uip_ds6_nbr_t *nbr)
+{
+  if(!nbr->isused) {
+    return;
+  }
+  switch(nbr->state) {
+#if UIP_CONF_ROUTER
+  case NBR_INCOMPLETE:
+    nbr->nscount++;
+    PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
+    uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr, 0, 0);
+    stimer_set(&(nbr->sendns), uip_ds6_if.retrans_timer / 1000);
+    break;
+#endif /* UIP_CONF_ROUTER */
+  case NBR_DELAY:
+    nbr->state = NBR_PROBE;
+    nbr->nscount = 1;
+    NEIGHBOR_STATE_CHANGED(nbr);
+    UIP_DS6_TRACE_NBR(nbr);
+    PRINTF("DELAY: moving to PROBE + NS %u\n", nbr->nscount);
+    uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr, 0, 0);
+    stimer_set(&(nbr->sendns), uip_ds6_if.retrans_timer / 1000);
+    break;
+  case NBR_PROBE:
+    nbr->nscount++;
+    PRINTF("PROBE: NS %u\n", nbr->nscount);
+    uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr, 0, 0);
+    stimer_set(&(nbr->sendns), uip_ds6_if.retrans_timer / 1000);
+    break;
+  default:
+    break;
+  }
+}
+
+#if UIP_CONF_ROUTER && UIP_ND6_SEND_RA
+/*---------------------------------------------------------------------------*/
+/** \brief Build a multicast RA. It answers the RSs not answered yet */
+static void
+ra_output_mcast(void)
+{
+  uip_nd6_ra_output(NULL);
+  timer_set(&uip_ds6_if.ra_mcast, UIP_ND6_MIN_DELAY_BETWEEN_RAS * CLOCK_SECOND);
+  uip_ds6_if.ra_solicited = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Build the periodic multicast RA, on every interface */
+static void
+ra_output_periodic(void)
+{
+  u8_t i;
+
+  for(i = 0; i < UIP_DS6_IF_NB; i++) {
+    uip_ds6_if_select(i);
+    ra_output_mcast();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Send the solicited RA for dest (NULL: multicast). The window is
+ * closed once every host of it has been answered */
+static void
+nd_tx_send_ra(uip_ipaddr_t *dest)
+{
+  u8_t i;
+
+  if(dest == NULL) {
+    if(uip_ds6_if.ra_solicited != UIP_DS6_RA_SOLICITED_MCAST) {
+      /* Already answered by a periodic RA */
+      return;
+    }
+    ra_output_mcast();
+    return;
+  }
+  if(uip_ds6_if.ra_solicited == 0 ||
+     uip_ds6_if.ra_solicited == UIP_DS6_RA_SOLICITED_MCAST ||
+     uip_is_addr_unspecified(dest)) {
+    return;
+  }
+  uip_nd6_ra_output(dest);
+  uip_create_unspecified(dest);
+  for(i = 0; i < uip_ds6_if.ra_solicited; i++) {
+    if(!uip_is_addr_unspecified(&uip_ds6_if.ra_dest[i])) {
+      return;
+    }
+  }
+  uip_ds6_if.ra_solicited = 0;
+}
+#endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA */
+
+/*---------------------------------------------------------------------------*/
+/** \brief Serve the ND transmit queues filled by uip_ds6_periodic() */
+static void
+nd_tx_run(void)
+{
+  struct nd_tx_queue *q;
+  u8_t class, i, pending;
+
+  nd_tx_refill();
+  do {
+    pending = 0;
+    for(i = 0; i < UIP_DS6_ND_TX_CLASSES; i++) {
+      class = (nd_tx_rr + i) % UIP_DS6_ND_TX_CLASSES;
+      q = &nd_tx_queues[class];
+      if(q->head < q->len) {
+        pending = 1;
+        break;
+      }
+    }
+    if(!pending || nd_tx_tokens == 0) {
+      break;
+    }
+    /* Next round starts with the class after this one */
+    nd_tx_rr = (class + 1) % UIP_DS6_ND_TX_CLASSES;
+    switch(class) {
+    case UIP_DS6_ND_TX_REG:
+      nd_tx_send_reg((uip_ds6_reg_t *)q->item[q->head]);
+      nd_tx_start[class] = ((uip_ds6_reg_t *)q->item[q->head] -
+                            uip_ds6_reg_list + 1) % (UIP_DS6_REG_LIST_SIZE);
+      break;
+    case UIP_DS6_ND_TX_NUD:
+      nd_tx_send_nud((uip_ds6_nbr_t *)q->item[q->head]);
+      nd_tx_start[class] = ((uip_ds6_nbr_t *)q->item[q->head] -
+                            uip_ds6_nbr_cache + 1) % (UIP_DS6_NBR_NB);
+      break;
+#if !UIP_CONF_ROUTER
+    case UIP_DS6_ND_TX_RS:
+      uip_ds6_send_rs((uip_ds6_defrt_t *)q->item[q->head]);
+      break;
+#endif /* !UIP_CONF_ROUTER */
+#if UIP_CONF_ROUTER && UIP_ND6_SEND_RA
+    case UIP_DS6_ND_TX_RA:
+      nd_tx_send_ra((uip_ipaddr_t *)q->item[q->head]);
+      break;
+#endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA */
+    }
+    q->head++;
+    /* The entry may have become stale because of an earlier message of this
+     * invocation (e.g. its router was removed), in which case nothing was
+     * built and no token is spent */
+    if(uip_len > 0) {
+      nd_tx_tokens--;
+      uip_ds6_nd_tx_stats.sent[class]++;
+      tcpip_ipv6_output();
+    }
+  } while(1);
+
+  /* Whatever is left waits for the next token */
+  for(class = 0; class < UIP_DS6_ND_TX_CLASSES; class++) {
+    q = &nd_tx_queues[class];
+    uip_ds6_nd_tx_stats.depth[class] = q->len - q->head;
+    if(q->head < q->len || q->overflow) {
+      uip_ds6_nd_tx_stats.deferred[class]++;
+    }
+    if(q->head < q->len) {
+      if((clock_time_t)(clock_time() - nd_tx_refill_time) < ND_TX_TOKEN_TICKS) {
+        set_deadline(ND_TX_TOKEN_TICKS -
+                     (clock_time_t)(clock_time() - nd_tx_refill_time));
+      } else {
+        set_deadline(0);
+      }
+    }
+    q->len = 0;
+    q->head = 0;
+    q->overflow = 0;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_reschedule(clock_time_t ticks)
+{
+  /* If the timer has already fired, uip_ds6_periodic() is about to run and
+   * will compute its next deadline anyway */
+  if(!etimer_expired(&uip_ds6_timer_periodic) &&
+     (clock_time_t)(uip_ds6_timer_periodic.timer.start +
+                    uip_ds6_timer_periodic.timer.interval - clock_time()) > ticks) {
+    PROCESS_CONTEXT_BEGIN(&tcpip_process);
+    etimer_set(&uip_ds6_timer_periodic, ticks);
+    PROCESS_CONTEXT_END(&tcpip_process);
+  }
+}
 
+#if UIP_DS6_QUEUE_NB > 0
 /*---------------------------------------------------------------------------*/
 void
-uip_ds6_periodic(void)
+uip_ds6_queue_add(uip_ipaddr_t *nexthop)
+{
+  u8_t i;
+
+  for(i = 0; i < UIP_DS6_QUEUE_NB; i++) {
+    if(uip_packetqueue_alloc(&queue[i].handle,
+                             UIP_DS6_QUEUE_LIFETIME) != NULL) {
+      memcpy(uip_packetqueue_buf(&queue[i].handle), &uip_buf[UIP_LLH_LEN],
+             uip_len);
+      uip_packetqueue_set_buflen(&queue[i].handle, uip_len);
+      if(nexthop != NULL) {
+        uip_ipaddr_copy(&queue[i].nexthop, nexthop);
+      } else {
+        uip_create_unspecified(&queue[i].nexthop);
+      }
+      UIP_DS6_IF_SET(&queue[i]);
+      PRINTF("Queued packet for next hop");
+      PRINT6ADDR(&queue[i].nexthop);
+      PRINTF("\n");
+      return;
+    }
+  }
+  PRINTF("Packet queue full, dropping packet\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Whether a packet from src may be sent to nbr now: not while its
+ * reachability is being probed, nor, if it is a default router, while src
+ * is being registered with it for the first time (e.g. after a failover).
+ * The router would discard it.
+ */
+static u8_t
+nbr_ready(uip_ds6_nbr_t *nbr, uip_ipaddr_t *src)
+{
+  uip_ds6_addr_t *addr;
+  uip_ds6_reg_t *reg;
+
+  if(nbr->state == NBR_PROBE) {
+    return 0;
+  }
+  if((locdefrt = uip_ds6_defrt_lookup(&nbr->ipaddr)) != NULL &&
+     (addr = uip_ds6_addr_lookup(src)) != NULL &&
+     (reg = uip_ds6_reg_lookup(addr, locdefrt)) != NULL &&
+     reg->in_progress && reg->state != REG_REGISTERED &&
+     reg->state != REG_TO_BE_UNREGISTERED) {
+    return 0;
+  }
+  return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_ds6_queue_hold(uip_ds6_nbr_t *nbr)
+{
+  struct uip_ip_hdr *ip = (struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN];
+  u8_t type = uip_buf[UIP_LLIPH_LEN];
+
+  /* ND messages are what gets the neighbor ready: never hold them */
+  if(ip->proto == UIP_PROTO_ICMP6 &&
+     ((type >= ICMP6_RS && type <= ICMP6_REDIRECT) ||
+      type == ICMP6_DAR || type == ICMP6_DAC)) {
+    return 0;
+  }
+  if(nbr_ready(nbr, &ip->srcipaddr)) {
+    return 0;
+  }
+  /* Through a default router: any other one will do if this one fails */
+  uip_ds6_queue_add(uip_ds6_defrt_lookup(&nbr->ipaddr) != NULL ?
+                    NULL : &nbr->ipaddr);
+  return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_queue_wakeup(void)
+{
+  u8_t i;
+
+  for(i = 0; i < UIP_DS6_QUEUE_NB; i++) {
+    if(uip_packetqueue_buflen(&queue[i].handle) != 0) {
+      queue_changed = 1;
+      uip_ds6_reschedule(0);
+      return;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Send the queued packets whose next hop is now resolved. uip_buf
+ * must be free: this is called from uip_ds6_periodic(), never from input.
+ */
+static void
+queue_flush(void)
+{
+  u8_t i;
+  uip_ipaddr_t *nexthop;
+
+  for(i = 0; i < UIP_DS6_QUEUE_NB; i++) {
+    if(uip_packetqueue_buflen(&queue[i].handle) == 0) {
+      continue;
+    }
+#if UIP_DS6_IF_NB > 1
+    uip_ds6_if_select(queue[i].ifindex);
+#endif /* UIP_DS6_IF_NB > 1 */
+    nexthop = uip_is_addr_unspecified(&queue[i].nexthop) ?
+      uip_ds6_defrt_choose() : &queue[i].nexthop;
+    if(nexthop == NULL || (locnbr = uip_ds6_nbr_lookup(nexthop)) == NULL ||
+       !nbr_ready(locnbr, &((struct uip_ip_hdr *)
+                            uip_packetqueue_buf(&queue[i].handle))->srcipaddr)) {
+      continue;
+    }
+    uip_len = uip_packetqueue_buflen(&queue[i].handle);
+    memcpy(&uip_buf[UIP_LLH_LEN], uip_packetqueue_buf(&queue[i].handle),
+           uip_len);
+    uip_packetqueue_free(&queue[i].handle);
+    tcpip_ipv6_output();
+  }
+}
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+
+#if UIP_DS6_TRACE
+/*---------------------------------------------------------------------------*/
+/* Trace ring. trace_head counts the records ever written: a writer
+ * reserves record n by incrementing it, then fills slot
+ * n % UIP_DS6_TRACE_SIZE between two writes of its seq, as a seqlock. A
+ * reader checks seq before and after copying a record: a record that
+ * changed meanwhile was overwritten, and is skipped. */
+static uip_ds6_trace_rec_t trace_ring[UIP_DS6_TRACE_SIZE];
+static u32_t trace_head;
+
+void
+uip_ds6_trace(u8_t event, u16_t id, u8_t arg)
+{
+  u32_t n = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+  uip_ds6_trace_rec_t *r = &trace_ring[n % UIP_DS6_TRACE_SIZE];
+
+  __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  r->time = (u32_t)clock_time();
+  r->id = id;
+  r->event = event;
+  r->arg = arg;
+  __atomic_store_n(&r->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+/*---------------------------------------------------------------------------*/
+u16_t
+uip_ds6_trace_read(uip_ds6_trace_rec_t *out, u16_t max, u32_t *cursor)
 {
-	/* This flag signals whether we allow or not to send a packet in the current 
-	 * invocation. */
-  u8_t allow_output = 1;
+  uip_ds6_trace_rec_t *r;
+  u32_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  u32_t seq;
+  u16_t n = 0;
+
+  if(head - *cursor > UIP_DS6_TRACE_SIZE) {
+    *cursor = head - UIP_DS6_TRACE_SIZE;
+  }
+  while(n < max && *cursor != head) {
+    r = &trace_ring[*cursor % UIP_DS6_TRACE_SIZE];
+    seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if(seq == 0 || (int32_t)(seq - (*cursor + 1)) < 0) {
+      /* Reserved but not written yet: read it next time */
+      break;
+    }
+    if(seq == *cursor + 1) {
+      memcpy(&out[n], r, sizeof(uip_ds6_trace_rec_t));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if(__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq) {
+        n++;
+      }
+    }
+    (*cursor)++;
+  }
+  return n;
+}
+#endif /* UIP_DS6_TRACE */
+
+#if UIP_DS6_CONV_STATS
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_conv_sent(u8_t kind, u16_t len)
+{
+  uip_ds6_conv_stats.tx[kind].pkts++;
+  uip_ds6_conv_stats.tx[kind].bytes += len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Drop the lost_addr entry of addr, if any. Returns 1 if it had one */
+static u8_t
+conv_found(uip_ds6_addr_t *addr)
+{
+  uip_ds6_conv_lost_t *l;
+
+  for(l = uip_ds6_conv_stats.lost_addr;
+      l < uip_ds6_conv_stats.lost_addr + UIP_DS6_ADDR_NB; l++) {
+    if(l->addr == addr) {
+      l->addr = NULL;
+      uip_ds6_conv_stats.recovering--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_conv_registered(uip_ds6_addr_t *addr, u8_t refresh)
+{
+  clock_time_t now = clock_time() - uip_ds6_conv_stats.start;
+
+  if(refresh) {
+    uip_ds6_conv_stats.refreshes++;
+  }
+  if(!uip_ds6_conv_stats.registered) {
+    uip_ds6_conv_stats.registered = 1;
+    uip_ds6_conv_stats.first_reg = now;
+  }
+  /* Registrations of addresses that kept a router do not end recovery */
+  if(conv_found(addr) && uip_ds6_conv_stats.recovering == 0) {
+    uip_ds6_conv_stats.recovery_last = now - uip_ds6_conv_stats.lost;
+    if(uip_ds6_conv_stats.recovery_last > uip_ds6_conv_stats.recovery_max) {
+      uip_ds6_conv_stats.recovery_max = uip_ds6_conv_stats.recovery_last;
+    }
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief A router we were registered with is gone. Record the addresses it
+ * leaves with no registration, until they register again
+ */
+static void
+conv_lost(uip_ds6_defrt_t *defrt)
+{
+  uip_ds6_reg_t *reg, *other;
+  uip_ds6_conv_lost_t *l, *slot;
+  u8_t lost = 0;
+
+  for(reg = defrt->reg_list; reg != NULL; reg = reg->defrt_next) {
+    if(reg->state != REG_REGISTERED) {
+      continue;
+    }
+    lost = 1;
+    for(other = reg->addr->reg_list; other != NULL; other = other->addr_next) {
+      if(other != reg && other->state == REG_REGISTERED) {
+        break;
+      }
+    }
+    if(other != NULL) {
+      /* Still reachable through another router */
+      continue;
+    }
+    slot = NULL;
+    for(l = uip_ds6_conv_stats.lost_addr;
+        l < uip_ds6_conv_stats.lost_addr + UIP_DS6_ADDR_NB; l++) {
+      if(l->addr == reg->addr) {
+        break;
+      }
+      if(l->addr == NULL && slot == NULL) {
+        slot = l;
+      }
+    }
+    if(l == uip_ds6_conv_stats.lost_addr + UIP_DS6_ADDR_NB && slot != NULL) {
+      if(uip_ds6_conv_stats.recovering++ == 0) {
+        uip_ds6_conv_stats.lost = clock_time() - uip_ds6_conv_stats.start;
+      }
+      slot->addr = reg->addr;
+      uip_ipaddr_copy(&slot->defrt, &defrt->ipaddr);
+    }
+  }
+  if(lost) {
+    uip_ds6_conv_stats.losses++;
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Ticks to ms, without overflowing 32 bits for long runs */
+#define CONV_MS(t) ((unsigned long)((t) / CLOCK_SECOND) * 1000 + \
+                    (unsigned long)((t) % CLOCK_SECOND) * 1000 / CLOCK_SECOND)
+
+int
+uip_ds6_conv_json(char *buf, int size)
+{
+  static const char *names[UIP_ND6_STATS_TYPES] = {
+    "rs", "ra", "ns", "na", "dar", "dac"
+  };
+  uip_ds6_conv_stats_t *s = &uip_ds6_conv_stats;
+  int len;
+  u8_t i;
+
+  len = snprintf(buf, size,
+                 "{\"uptime_ms\":%lu,\"first_reg_ms\":%ld,\"refreshes\":%lu,"
+                 "\"losses\":%u,\"recovering\":%u,\"recovery_last_ms\":%lu,"
+                 "\"recovery_max_ms\":%lu,\"tx\":{",
+                 CONV_MS(clock_time() - s->start),
+                 s->registered ? (long)CONV_MS(s->first_reg) : -1L,
+                 (unsigned long)s->refreshes, s->losses, s->recovering,
+                 CONV_MS(s->recovery_last), CONV_MS(s->recovery_max));
+  for(i = 0; i < UIP_ND6_STATS_TYPES; i++) {
+    len += snprintf(buf + (len < size ? len : size), len < size ? size - len : 0,
+                    "%s\"%s\":{\"msgs\":%lu,\"bytes\":%lu}",
+                    i == 0 ? "" : ",", names[i],
+                    (unsigned long)s->tx[i].pkts, (unsigned long)s->tx[i].bytes);
+  }
+  len += snprintf(buf + (len < size ? len : size), len < size ? size - len : 0,
+                  "}}");
+  return len;
+}
+#endif /* UIP_DS6_CONV_STATS */
+
+/*---------------------------------------------------------------------------*/
+/** \brief Periodic processing of the current interface */
+static void
+if_periodic(void)
+{
+  /* Registrations that may still be started in this invocation */
+  u8_t reg_slots = UIP_DS6_MAX_REGS_IN_PROGRESS - uip_ds6_if.registrations_in_progress;
+  u16_t k;
+#if UIP_CONF_ROUTER & UIP_ND6_SEND_RA
+  u8_t i;
+#endif /* UIP_CONF_ROUTER & UIP_ND6_SEND_RA */
 
   /* minimum lifetime */
   min_lifetime = 0xFFFFFFFF;
@@ -181,65 +1057,39 @@ uip_ds6_periodic(void)
   min_defrt = NULL;
 	
 	/* Periodic processing on registrations */
-	for(locreg = uip_ds6_reg_list;
-      locreg < uip_ds6_reg_list + UIP_DS6_REG_LIST_SIZE; locreg++) {
-  	if (locreg->isused) {
+	for(k = 0; k < UIP_DS6_REG_LIST_SIZE; k++) {
+		locreg = &uip_ds6_reg_list[(nd_tx_start[UIP_DS6_ND_TX_REG] + k) %
+		                           (UIP_DS6_REG_LIST_SIZE)];
+  	if (locreg->isused && UIP_DS6_IF_MATCH(locreg->defrt)) {
   		if (stimer_expired(&locreg->reg_lifetime)) {
   			uip_ds6_reg_rm(locreg);
-  		} else if (allow_output) {
-  			/* If no output is allowed, it is pointless to enter here in this invocation */
-  			if (uip_ds6_if.registration_in_progress) {
-  				/* There is a registration in progress */
-  				if ((locreg == uip_ds6_if.registration_in_progress) && 
-  						(timer_expired(&locreg->registration_timer))) {
-	      		/* We already sent a NS message for this address but there has been no response */
-	      		if(locreg->reg_count >= UIP_ND6_MAX_UNICAST_SOLICIT) {
-			  			/* NUD failed. Signal the need for next-hop determination by deleting the 
-			   			 * NCE (RFC 4861) */
-			   			uip_ds6_reg_rm(locreg); 
-			  			/* And then, delete neighbor and corresponding router (as hosts only keep
-			  			 * NCEs for routers in 6lowpan-nd) */ 
-			  			locnbr = uip_ds6_nbr_lookup(&locreg->defrt->ipaddr); 
-			  			uip_ds6_nbr_rm(locnbr);
-			  			uip_ds6_defrt_rm(locreg->defrt);
-			  			/* Since we are deleting a default router, we must delete also all 
-			  			 * registrations with that router.
-			  			 * Be careful here, uip_ds6_reg_cleanup_defrt() modifies the value of locreg!*/
-			  			uip_ds6_reg_cleanup_defrt(locreg->defrt);
-		      		/* We will also need to start sending RS, as specified in I-D.ietf-6lowpan-nd 
-		      		 * for NUD failure case */
-		      		uip_ds6_send_rs(NULL);
-		      		uip_ds6_if.registration_in_progress = NULL;
-  					} else {
-  						locreg->reg_count++;
-		      		timer_restart(&locreg->registration_timer);
-		   	 			uip_nd6_ns_output(&locreg->addr->ipaddr, &locreg->defrt->ipaddr, 
-		          			            &locreg->defrt->ipaddr, 1, UIP_ND6_REGISTRATION_LIFETIME);
- 						}
-  					allow_output = 0; /* Prevent this invocation from sending anything else */
-  				}
-  			} else {
-  				/* There are no registrations in progress, let's see this entry needs (re)registration
-  				 * or deletion */
-  				if ((locreg->state == REG_GARBAGE_COLLECTIBLE) || 
-  						(locreg->state == REG_TO_BE_UNREGISTERED) || 
-  						((locreg->state == REG_REGISTERED) && 
-	 						(stimer_remaining(&locreg->reg_lifetime) < stimer_elapsed(&locreg->reg_lifetime)))) {
- 						/* Issue (re)registration */
-				  	uip_ds6_if.registration_in_progress = locreg;
-				  	locreg->reg_count++;
-				  	timer_set(&locreg->registration_timer, (uip_ds6_if.retrans_timer / 1000) * CLOCK_SECOND);
-				  	if (locreg->state == REG_TO_BE_UNREGISTERED) {
-					  	uip_nd6_ns_output(&locreg->addr->ipaddr, &locreg->defrt->ipaddr, 
-				      	   			        &locreg->defrt->ipaddr, 1, 0);
-				  	} else {
-				  		uip_nd6_ns_output(&locreg->addr->ipaddr, &locreg->defrt->ipaddr, 
-				      	   			        &locreg->defrt->ipaddr, 1, UIP_ND6_REGISTRATION_LIFETIME);
-				  	}   	   			       
-			      allow_output = 0; /* Prevent this invocation from sending anything else */
-  				}
-  			}
+  			continue;
   		}
+  		set_deadline_seconds(stimer_remaining(&locreg->reg_lifetime));
+			if (locreg->in_progress) {
+				if (timer_expired(&locreg->registration_timer)) {
+      		/* We already sent a NS message for this address but there has been
+      		 * no response: retransmit or give up on the router */
+      		nd_tx_enqueue(UIP_DS6_ND_TX_REG, locreg);
+      	} else {
+					set_deadline_timer(&locreg->registration_timer);
+      	}
+			} else if ((locreg->state == REG_GARBAGE_COLLECTIBLE) || 
+					(locreg->state == REG_TO_BE_UNREGISTERED) || 
+					((locreg->state == REG_REGISTERED) && 
+						(stimer_remaining(&locreg->reg_lifetime) < stimer_elapsed(&locreg->reg_lifetime)))) {
+				/* This entry needs (re)registration or deletion. If all slots are 
+				 * taken, or its router already has a registration in progress, the
+				 * end of a registration in progress reschedules us */
+				if (reg_slots > 0 && !defrt_reg_in_progress(locreg->defrt)) {
+					nd_tx_enqueue(UIP_DS6_ND_TX_REG, locreg);
+					reg_slots--;
+				}
+			} else if (locreg->state == REG_REGISTERED) {
+				/* Refresh at half the registration lifetime */
+				set_deadline_seconds((stimer_remaining(&locreg->reg_lifetime) - 
+						                  stimer_elapsed(&locreg->reg_lifetime)) / 2);
+			}
   	}
   }
 
@@ -250,37 +1100,42 @@ uip_ds6_periodic(void)
     if(locaddr->isused) {
       if((!locaddr->isinfinite) && (stimer_expired(&locaddr->vlifetime))) {
         uip_ds6_addr_rm(locaddr);
-      } else if (allow_output) {
+      } else if (!locaddr->isinfinite) {
         if (stimer_remaining(&locaddr->vlifetime) < min_lifetime) {
           min_lifetime = stimer_remaining(&locaddr->vlifetime);
           min_defrt = locaddr->defrt;
         }
+        set_deadline_seconds(stimer_remaining(&locaddr->vlifetime));
       }
     }
   }
   
   /* Periodic processing on default routers */
 	if (uip_ds6_defrt_choose() == NULL) {
-	  if (allow_output) {
-	    /* If default router list is empty, start sending RS */
-	    uip_ds6_send_rs(NULL);
-	    allow_output = 0; /* Prevent this invocation from sending anything else */
+#if !UIP_CONF_ROUTER
+	  /* If default router list is empty, start sending RS */
+	  if (timer_expired(&uip_ds6_timer_rs)) {
+	    nd_tx_enqueue(UIP_DS6_ND_TX_RS, NULL);
+	  } else {
+	    set_deadline_timer(&uip_ds6_timer_rs);
 	  }
+#endif /* !UIP_CONF_ROUTER */
 	} else {
     for(locdefrt = uip_ds6_defrt_list;
         locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-      if((locdefrt->isused) && (!locdefrt->isinfinite)) {
+      if((locdefrt->isused) && (!locdefrt->isinfinite) &&
+         UIP_DS6_IF_MATCH(locdefrt)) {
         if (stimer_expired(&(locdefrt->lifetime))) {
           uip_ds6_defrt_rm(locdefrt);
           /* If default router list is empty, we will start sending RS in
            * the next invocation of ds6_periodic() */
+          set_deadline(0);
         } else {
-          if (allow_output) {
-            if (stimer_remaining(&locdefrt->lifetime) < min_lifetime) {
-              min_lifetime = stimer_remaining(&locdefrt->lifetime);
-              min_defrt = locdefrt;
-            }
+          if (stimer_remaining(&locdefrt->lifetime) < min_lifetime) {
+            min_lifetime = stimer_remaining(&locdefrt->lifetime);
+            min_defrt = locdefrt;
           }
+          set_deadline_seconds(stimer_remaining(&locdefrt->lifetime));
         }
       }
     }
@@ -290,14 +1145,16 @@ uip_ds6_periodic(void)
   /* Periodic processing on prefixes */
   for (locprefix = uip_ds6_prefix_list;
       locprefix < uip_ds6_prefix_list + UIP_DS6_PREFIX_NB; locprefix++) {
-    if((locprefix->isused) && (!locprefix->isinfinite)) {
+    if((locprefix->isused) && (!locprefix->isinfinite) &&
+       UIP_DS6_IF_MATCH(locprefix)) {
     	if (stimer_expired(&locprefix->vlifetime)) {
       	uip_ds6_prefix_rm(locprefix);
-    	} else if (allow_output) {
+    	} else {
     		if (stimer_remaining(&locprefix->vlifetime) < min_lifetime) {
     			min_lifetime = stimer_remaining(&locprefix->vlifetime);
     			min_defrt = locprefix->defrt;
     		}
+    		set_deadline_seconds(stimer_remaining(&locprefix->vlifetime));
     	}
     }
   }
@@ -307,51 +1164,99 @@ uip_ds6_periodic(void)
 	/* Periodic processing on contexts */
   for(loccontext = uip_ds6_addr_context_table;
       loccontext < uip_ds6_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; loccontext++) {
-    if(loccontext->state != NOT_IN_USE) {
+#if UIP_CONF_ROUTER
+    /* Our own contexts only change state at the end of a pending change */
+    if((loccontext->state == EXPIRED) ||
+       ((loccontext->state != NOT_IN_USE) &&
+        (loccontext->pending != CONTEXT_STABLE))) {
+      if(stimer_expired(&loccontext->vlifetime)) {
+        if(loccontext->state == EXPIRED) {
+          /* Advertised with a lifetime of 0 long enough */
+          uip_ds6_context_rm(loccontext);
+        } else if(loccontext->pending == CONTEXT_TO_COMPRESS) {
+          UIP_DS6_CONTEXT_SET_STATE(loccontext, IN_USE_COMPRESS);
+          UIP_DS6_TRACE_CONTEXT(loccontext);
+        } else {
+          UIP_DS6_CONTEXT_SET_STATE(loccontext, EXPIRED);
+          UIP_DS6_TRACE_CONTEXT(loccontext);
+          stimer_set(&loccontext->vlifetime, UIP_ND6_MIN_CONTEXT_CHANGE_DELAY);
+        }
+        loccontext->pending = CONTEXT_STABLE;
+        RA_TRICKLE_RESET();
+      }
+      if(loccontext->state == EXPIRED || loccontext->pending != CONTEXT_STABLE) {
+        set_deadline_seconds(stimer_remaining(&loccontext->vlifetime));
+      }
+    }
+#else /* UIP_CONF_ROUTER */
+    if(loccontext->state != NOT_IN_USE) {
     	if (stimer_expired(&loccontext->vlifetime)) {
     		if (loccontext->state != EXPIRED) {
-    			loccontext->state = IN_USE_UNCOMPRESS_ONLY;
+    			/* Decompression only, for twice the default router lifetime */
+    			UIP_DS6_CONTEXT_SET_STATE(loccontext, EXPIRED);
+    			UIP_DS6_TRACE_CONTEXT(loccontext);
     			stimer_set(&loccontext->vlifetime, 2 * loccontext->defrt_lifetime);
     		} else {
       		uip_ds6_context_rm(loccontext);
     		}
-    	} else if (allow_output) {
+    	} else {
     		if (stimer_remaining(&loccontext->vlifetime) < min_lifetime) {
     			min_lifetime = stimer_remaining(&loccontext->vlifetime);
     			min_defrt = loccontext->defrt;
     		}
     	}
+    	if (loccontext->state != NOT_IN_USE) {
+    		set_deadline_seconds(stimer_remaining(&loccontext->vlifetime));
+    	}
     }
+#endif /* UIP_CONF_ROUTER */
   }
 #endif /* CONF_6LOWPAN_ND_6CO */
 
+#if !UIP_CONF_ROUTER
 	/* Start sending RS well before the minimum of the lifetimes (def. router, 
 	 * context, or prefix) expires */
-	if ((allow_output) && (min_lifetime < UIP_DS6_LIFETIME_THRESHOLD)) {
-	  /* Start sending RSs to the router with minimum lifetime (if possible) */
-		uip_ds6_send_rs(min_defrt);
-		allow_output = 0;
+	if (min_lifetime < UIP_DS6_LIFETIME_THRESHOLD) {
+		if (!timer_expired(&uip_ds6_timer_rs)) {
+			set_deadline_timer(&uip_ds6_timer_rs);
+		} else if (nd_tx_queues[UIP_DS6_ND_TX_RS].len == 0) {
+		  /* Start sending RSs to the router with minimum lifetime (if possible) */
+			nd_tx_enqueue(UIP_DS6_ND_TX_RS, min_defrt);
+		}
+	} else if (min_lifetime != 0xFFFFFFFF) {
+		set_deadline_seconds(min_lifetime - UIP_DS6_LIFETIME_THRESHOLD);
 	}
+#endif /* !UIP_CONF_ROUTER */
 
   /* Periodic processing on neighbors */
-  for(locnbr = uip_ds6_nbr_cache; locnbr < uip_ds6_nbr_cache + UIP_DS6_NBR_NB;
-      locnbr++) {
-    if(locnbr->isused) {
+  for(k = 0; k < UIP_DS6_NBR_NB; k++) {
+    locnbr = &uip_ds6_nbr_cache[(nd_tx_start[UIP_DS6_ND_TX_NUD] + k) %
+                                (UIP_DS6_NBR_NB)];
+    if(locnbr->isused && UIP_DS6_IF_MATCH(locnbr)) {
+#if UIP_CONF_ROUTER
+      /* Registrations of hosts with us */
+      if(locnbr->reg_state != REG_GARBAGE_COLLECTIBLE) {
+        if(stimer_expired(&locnbr->reg_lifetime)) {
+          PRINTF("Registration of");
+          PRINT6ADDR(&locnbr->ipaddr);
+          PRINTF("expired\n");
+          uip_ds6_nbr_rm(locnbr);
+          continue;
+        }
+        set_deadline_seconds(stimer_remaining(&locnbr->reg_lifetime));
+      }
+#endif /* UIP_CONF_ROUTER */
       switch (locnbr->state) {
 #if UIP_CONF_ROUTER
 /* There can not be INCOMPLETE NCEs in a host in 6lowpan-nd */
       case NBR_INCOMPLETE:
-    		if (allow_output) {  
-	        if(locnbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
-	          uip_ds6_nbr_rm(locnbr);
-	        } else if(stimer_expired(&(locnbr->sendns))) {
-	          locnbr->nscount++;
-	          PRINTF("NBR_INCOMPLETE: NS %u\n", locnbr->nscount);
-	          uip_nd6_ns_output(NULL, NULL, &locnbr->ipaddr);
-	          stimer_set(&(locnbr->sendns), uip_ds6_if.retrans_timer / 1000);
-						allow_output = 0;
-	        }
-    		}  
+        if(locnbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
+          uip_ds6_nbr_rm(locnbr);
+        } else if(stimer_expired(&(locnbr->sendns))) {
+          nd_tx_enqueue(UIP_DS6_ND_TX_NUD, locnbr);
+        } else {
+          set_deadline_seconds(stimer_remaining(&locnbr->sendns));
+        }
         break;
 #endif /* UIP_CONF_ROUTER */
       case NBR_REACHABLE:
@@ -361,37 +1266,30 @@ uip_ds6_periodic(void)
           PRINTF(")\n");
           locnbr->state = NBR_STALE;
           NEIGHBOR_STATE_CHANGED(locnbr);
+          UIP_DS6_TRACE_NBR(locnbr);
+        } else {
+          set_deadline_seconds(stimer_remaining(&locnbr->reachable));
         }
         break;
       case NBR_DELAY:
-    		if (allow_output) {  
-	        if(stimer_expired(&(locnbr->reachable))) {
-	          locnbr->state = NBR_PROBE;
-	          locnbr->nscount = 1;
-	          NEIGHBOR_STATE_CHANGED(locnbr);
-	          PRINTF("DELAY: moving to PROBE + NS %u\n", locnbr->nscount);
-	          uip_nd6_ns_output(NULL, &locnbr->ipaddr, &locnbr->ipaddr, 0, 0);
-	          stimer_set(&(locnbr->sendns), uip_ds6_if.retrans_timer / 1000);
-	          allow_output = 0;
-	        }
-    		}  
+        if(stimer_expired(&(locnbr->reachable))) {
+          nd_tx_enqueue(UIP_DS6_ND_TX_NUD, locnbr);
+        } else {
+          set_deadline_seconds(stimer_remaining(&locnbr->reachable));
+        }
         break;
       case NBR_PROBE:
-    		if (allow_output) {  
-	        if(locnbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
-	          PRINTF("PROBE END \n");
-	          if((locdefrt = uip_ds6_defrt_lookup(&locnbr->ipaddr)) != NULL) {
-	            uip_ds6_defrt_rm(locdefrt);
-	          }
-	          uip_ds6_nbr_rm(locnbr);
-	        } else if(stimer_expired(&(locnbr->sendns))) {
-	          locnbr->nscount++;
-	          PRINTF("PROBE: NS %u\n", locnbr->nscount);
-	          uip_nd6_ns_output(NULL, &locnbr->ipaddr, &locnbr->ipaddr, 0, 0);
-	          stimer_set(&(locnbr->sendns), uip_ds6_if.retrans_timer / 1000);
-	          allow_output = 0;
-	        }
-    		}  
+        if(locnbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
+          PRINTF("PROBE END \n");
+          if((locdefrt = uip_ds6_defrt_lookup(&locnbr->ipaddr)) != NULL) {
+            uip_ds6_defrt_rm(locdefrt);
+          }
+          uip_ds6_nbr_rm(locnbr);
+        } else if(stimer_expired(&(locnbr->sendns))) {
+          nd_tx_enqueue(UIP_DS6_ND_TX_NUD, locnbr);
+        } else {
+          set_deadline_seconds(stimer_remaining(&locnbr->sendns));
+        }
         break;
       default:
         break;
@@ -399,19 +1297,117 @@ uip_ds6_periodic(void)
     }
   }
 
+#if UIP_CONF_ROUTER & UIP_ND6_SEND_RA
+  /* Solicited RAs, once the response window is over */
+  if(uip_ds6_if.ra_solicited != 0) {
+    if(!timer_expired(&uip_ds6_if.ra_window)) {
+      set_deadline_timer(&uip_ds6_if.ra_window);
+    } else if(uip_ds6_if.ra_solicited == UIP_DS6_RA_SOLICITED_MCAST) {
+      if(timer_expired(&uip_ds6_if.ra_mcast)) {
+        nd_tx_enqueue(UIP_DS6_ND_TX_RA, NULL);
+      } else {
+        set_deadline_timer(&uip_ds6_if.ra_mcast);
+      }
+    } else {
+      for(i = 0; i < uip_ds6_if.ra_solicited; i++) {
+        if(!uip_is_addr_unspecified(&uip_ds6_if.ra_dest[i])) {
+          nd_tx_enqueue(UIP_DS6_ND_TX_RA, &uip_ds6_if.ra_dest[i]);
+        }
+      }
+    }
+  }
+#endif /* UIP_CONF_ROUTER & UIP_ND6_SEND_RA */
+
+  /* Send what is due, within the limits of the token bucket */
+  nd_tx_run();
+}
+
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+/*---------------------------------------------------------------------------*/
+/** \brief Remove an entry of the 6LBR table */
+static void
+lbr_reg_rm(uip_ds6_lbr_reg_t *reg)
+{
+  uip_ds6_lbr_reg_t **prev;
+
+  for(prev = &lbr_reg_hash[LBR_REG_HASH(&reg->ipaddr)]; *prev != NULL;
+      prev = &(*prev)->hash_next) {
+    if(*prev == reg) {
+      *prev = reg->hash_next;
+      break;
+    }
+  }
+  reg->isused = 0;
+  reg->hash_next = lbr_reg_free;
+  lbr_reg_free = reg;
+  PERSIST_LBR(reg);
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Expire the entries of the 6LBR table, so that DARs only look up
+ * their own hash bucket */
+static void
+lbr_reg_periodic(void)
+{
+  for(loclbrreg = uip_ds6_lbr_reg_table;
+      loclbrreg < uip_ds6_lbr_reg_table + UIP_DS6_LBR_REG_NB; loclbrreg++) {
+    if(loclbrreg->isused) {
+      if(stimer_expired(&loclbrreg->lifetime)) {
+        lbr_reg_rm(loclbrreg);
+      } else {
+        set_deadline_seconds(stimer_remaining(&loclbrreg->lifetime));
+      }
+    }
+  }
+}
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_periodic(void)
+{
+  u8_t i;
+
+  /* Every structure below lowers this to the time at which it next needs
+   * processing. Anything that is due now but could not be processed (e.g.
+   * because we ran out of ND transmit tokens) sets it accordingly */
+  next_deadline = UIP_DS6_MAX_PERIOD;
+
+  for(i = 0; i < UIP_DS6_IF_NB; i++) {
+    uip_ds6_if_select(i);
+    if_periodic();
+  }
+
+#if UIP_DS6_QUEUE_NB > 0
+  if(queue_changed) {
+    queue_changed = 0;
+    queue_flush();
+  }
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+  lbr_reg_periodic();
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
 #if UIP_CONF_ROUTER & UIP_ND6_SEND_RA 
   /* Periodic RA sending */
   if(stimer_expired(&uip_ds6_timer_ra)) {
     uip_ds6_send_ra_periodic();
   }
+  set_deadline_seconds(stimer_remaining(&uip_ds6_timer_ra));
 #endif /* UIP_CONF_ROUTER & UIP_ND6_SEND_RA */
-  etimer_reset(&uip_ds6_timer_periodic);
+
+  /* Sleep until the earliest deadline */
+  if(next_deadline < UIP_DS6_PERIOD) {
+    next_deadline = UIP_DS6_PERIOD;
+  }
+  etimer_set(&uip_ds6_timer_periodic, (clock_time_t)next_deadline);
   return;
 }
 
 /*---------------------------------------------------------------------------*/
 u8_t
-uip_ds6_list_loop(uip_ds6_element_t * list, u8_t size,
+uip_ds6_list_loop(uip_ds6_element_t * list, u16_t size,
                   u16_t elementsize, uip_ipaddr_t * ipaddr,
                   u8_t ipaddrlen, uip_ds6_element_t ** out_element)
 {
@@ -434,106 +1430,742 @@ uip_ds6_list_loop(uip_ds6_element_t * list, u8_t size,
     }
   }
 
-  if(*out_element != NULL) {
-    return FREESPACE;
+  if(*out_element != NULL) {
+    return FREESPACE;
+  } else {
+    return NOSPACE;
+  }
+}
+
+#if UIP_DS6_IF_NB > 1
+/*---------------------------------------------------------------------------*/
+u8_t
+uip_ds6_if_list_loop(uip_ds6_element_t * list, u16_t size,
+                     u16_t elementsize, uip_ipaddr_t * ipaddr,
+                     u8_t ipaddrlen, uip_ds6_element_t ** out_element)
+{
+  uip_ds6_if_element_t *element;
+
+  *out_element = NULL;
+
+  for(element = (uip_ds6_if_element_t *)list;
+      element <
+      (uip_ds6_if_element_t *) ((u8_t *) list + (size * elementsize));
+      element = (uip_ds6_if_element_t *) ((u8_t *) element + elementsize)) {
+    if(element->isused) {
+      if(UIP_DS6_IF_MATCH(element) &&
+         uip_ipaddr_prefixcmp(&(element->ipaddr), ipaddr, ipaddrlen)) {
+        *out_element = (uip_ds6_element_t *)element;
+        return FOUND;
+      }
+    } else {
+      *out_element = (uip_ds6_element_t *)element;
+    }
+  }
+
+  if(*out_element != NULL) {
+    return FREESPACE;
+  } else {
+    return NOSPACE;
+  }
+}
+#endif /* UIP_DS6_IF_NB > 1 */
+
+/* Whether a used entry is in the CLOCK ring */
+#if UIP_CONF_ROUTER
+#define NBR_IN_GC_RING(n) ((n)->reg_state == REG_GARBAGE_COLLECTIBLE)
+#else /* UIP_CONF_ROUTER */
+#define NBR_IN_GC_RING(n) 1
+#endif /* UIP_CONF_ROUTER */
+
+/*---------------------------------------------------------------------------*/
+/** \brief Put nbr in the CLOCK ring, right behind the hand: it is the last
+ * entry considered for eviction */
+static void
+nbr_gc_add(uip_ds6_nbr_t *nbr)
+{
+  if(nbr_hand == NULL) {
+    nbr->gc_next = nbr;
+    nbr->gc_prev = nbr;
+    nbr_hand = nbr;
+  } else {
+    nbr->gc_next = nbr_hand;
+    nbr->gc_prev = nbr_hand->gc_prev;
+    nbr->gc_prev->gc_next = nbr;
+    nbr_hand->gc_prev = nbr;
+  }
+  nbr_gc_nb++;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Take nbr out of the CLOCK ring */
+static void
+nbr_gc_rm(uip_ds6_nbr_t *nbr)
+{
+  if(nbr->gc_next == nbr) {
+    nbr_hand = NULL;
+  } else {
+    nbr->gc_prev->gc_next = nbr->gc_next;
+    nbr->gc_next->gc_prev = nbr->gc_prev;
+    if(nbr_hand == nbr) {
+      nbr_hand = nbr->gc_next;
+    }
+  }
+  nbr_gc_nb--;
+}
+
+/*---------------------------------------------------------------------------*/
+uip_ds6_nbr_t *
+uip_ds6_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
+                u8_t isrouter, u8_t state)
+{
+  int r;
+
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  if(uip_ds6_nbr_lookup(ipaddr) != NULL) {
+    r = FOUND;
+  } else if(nbr_free != NULL) {
+    r = FREESPACE;
+    locnbr = nbr_free;
+    nbr_free = locnbr->hash_next;
+  } else {
+    r = NOSPACE;
+  }
+#else /* UIP_DS6_NBR_HASH_SIZE > 0 */
+  r = uip_ds6_list_loop
+     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
+      sizeof(uip_ds6_nbr_t), ipaddr, 128,
+      (uip_ds6_element_t **) &locnbr);
+  //  printf("r %d\n", r);
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+
+  if(r == FREESPACE) {
+    locnbr->isused = 1;
+    UIP_DS6_IF_SET(locnbr);
+    uip_ipaddr_copy(&(locnbr->ipaddr), ipaddr);
+    if(lladdr != NULL) {
+      memcpy(&(locnbr->lladdr), lladdr, UIP_LLADDR_LEN);
+    } else {
+      memset(&(locnbr->lladdr), 0, UIP_LLADDR_LEN);
+    }
+    locnbr->isrouter = isrouter;
+    locnbr->state = state;
+    /* timers are set separately, for now we put them in expired state */
+    stimer_set(&(locnbr->reachable), 0);
+    stimer_set(&(locnbr->sendns), 0);
+    locnbr->nscount = 0;
+#if UIP_CONF_ROUTER
+    /* Unregistered until the node sends us an ARO */
+    locnbr->reg_state = REG_GARBAGE_COLLECTIBLE;
+#endif /* UIP_CONF_ROUTER */
+    nbr_gc_add(locnbr);
+#if UIP_DS6_LINK_ESTIMATOR
+    locnbr->etx = UIP_DS6_LINK_ETX_INIT * UIP_DS6_LINK_ETX_DIVISOR;
+    locnbr->rssi = UIP_DS6_LINK_RSSI_UNKNOWN;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_DS6_LINK_NUD
+    locnbr->noack = 0;
+#endif /* UIP_DS6_LINK_NUD */
+#if UIP_DS6_NBR_HASH_SIZE > 0
+    locnbr->hash_next = nbr_hash[NBR_HASH(ipaddr)];
+    nbr_hash[NBR_HASH(ipaddr)] = locnbr;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+    PRINTF("Adding neighbor with ip addr");
+    PRINT6ADDR(ipaddr);
+    PRINTF("link addr");
+    PRINTLLADDR((&(locnbr->lladdr)));
+    PRINTF("state %u\n", state);
+    NEIGHBOR_STATE_CHANGED(locnbr);
+    UIP_DS6_TRACE_NBR(locnbr);
+    if(state != NBR_INCOMPLETE) {
+      UIP_DS6_QUEUE_WAKEUP();
+    }
+
+    locnbr->referenced = 1;
+    //    printf("add %p\n", locnbr);
+    return locnbr;
+  } else if(r == NOSPACE) {
+    /* We did not find any empty slot on the neighbor list, so we need
+       to remove one entry to make room. CLOCK, over the ring of entries
+       that are not registered with us: the hand gives the entries looked
+       up since its last pass a second chance, and stops on the first one
+       that was not. Whether an entry may be garbage-collected at all costs
+       a scan of the registrations with it as a router, so it is only
+       checked for entries that are not referenced. Two turns are enough:
+       the first one clears all reference bits. */
+    uip_ds6_nbr_t *n;
+    u16_t steps;
+    u8_t gc;
+#if UIP_DS6_IF_NB > 1
+    u8_t ifindex = uip_ds6_if_index;
+#endif /* UIP_DS6_IF_NB > 1 */
+
+    for(steps = 0; nbr_hand != NULL && steps < 2 * nbr_gc_nb; steps++) {
+      n = nbr_hand;
+      nbr_hand = n->gc_next;
+      if(n->referenced) {
+        n->referenced = 0;
+        continue;
+      }
+      /* Its default router entry and registrations are on its own
+       * interface */
+      uip_ds6_if_select(n->ifindex);
+      /* We do not want to remove any non-garbage-collectible entry */
+      if((gc = uip_ds6_is_nbr_garbage_collectible(n))) {
+        //      printf("rm3\n");
+        uip_ds6_nbr_rm(n);
+        locdefrt = uip_ds6_defrt_lookup(&n->ipaddr);
+        uip_ds6_defrt_rm(locdefrt);
+      }
+      uip_ds6_if_select(ifindex);
+      if(gc) {
+        return uip_ds6_nbr_add(ipaddr, lladdr, isrouter, state);
+      }
+    }
+  }
+  PRINTF("uip_ds6_nbr_add drop\n");
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
+{
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  uip_ds6_nbr_t **prev;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+
+  if((nbr == NULL) || (!nbr->isused)) {
+    return;
+  }
+  if(NBR_IN_GC_RING(nbr)) {
+    nbr_gc_rm(nbr);
+  }
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  for(prev = &nbr_hash[NBR_HASH(&nbr->ipaddr)]; *prev != NULL;
+      prev = &(*prev)->hash_next) {
+    if(*prev == nbr) {
+      *prev = nbr->hash_next;
+      break;
+    }
+  }
+  nbr->hash_next = nbr_free;
+  nbr_free = nbr;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+  if(nbr != NULL) {
+    nbr->isused = 0;
+    PERSIST_NBR(nbr);
+#if UIP_DS6_TRACE
+    uip_ds6_trace(UIP_DS6_TRACE_NBR_RM, nbr - uip_ds6_nbr_cache, 0);
+#endif /* UIP_DS6_TRACE */
+    //    NEIGHBOR_STATE_CHANGED(nbr);
+  }
+  return;
+}
+
+#if UIP_CONF_ROUTER
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_set_reg_state(uip_ds6_nbr_t *nbr, u8_t state)
+{
+  if(state == REG_GARBAGE_COLLECTIBLE) {
+    if(!NBR_IN_GC_RING(nbr)) {
+      nbr_gc_add(nbr);
+    }
+  } else if(NBR_IN_GC_RING(nbr)) {
+    nbr_gc_rm(nbr);
+  }
+  nbr->reg_state = state;
+}
+#endif /* UIP_CONF_ROUTER */
+
+/*---------------------------------------------------------------------------*/
+uip_ds6_nbr_t *
+uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
+{
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  for(locnbr = nbr_hash[NBR_HASH(ipaddr)]; locnbr != NULL;
+      locnbr = locnbr->hash_next) {
+    if(uip_ipaddr_cmp(&locnbr->ipaddr, ipaddr) && UIP_DS6_IF_MATCH(locnbr)) {
+      locnbr->referenced = 1;
+      return locnbr;
+    }
+  }
+  return NULL;
+#else /* UIP_DS6_NBR_HASH_SIZE > 0 */
+  if(uip_ds6_list_loop
+     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
+      sizeof(uip_ds6_nbr_t), ipaddr, 128,
+      (uip_ds6_element_t **) & locnbr) == FOUND) {
+    locnbr->referenced = 1;
+    return locnbr;
+  }
+  return NULL;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief The neighbor is known to be reachable: back to REACHABLE */
+static void
+nbr_confirm(uip_ds6_nbr_t *nbr)
+{
+  stimer_set(&nbr->reachable, uip_ds6_if.reachable_time / 1000);
+  nbr->nscount = 0;
+  if(nbr->state != NBR_REACHABLE) {
+    PRINTF("Reachability of");
+    PRINT6ADDR(&nbr->ipaddr);
+    PRINTF("confirmed\n");
+    nbr->state = NBR_REACHABLE;
+    NEIGHBOR_STATE_CHANGED(nbr);
+    UIP_DS6_TRACE_NBR(nbr);
+    UIP_DS6_QUEUE_WAKEUP();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_reachability_confirm(uip_ipaddr_t *src, uip_ipaddr_t *peer, u32_t flow)
+{
+  uip_ds6_route_t *rt;
+
+  /* Same next hop determination as tcpip_ipv6_output() */
+  if(!uip_ds6_is_addr_onlink(peer)) {
+    if((rt = uip_ds6_route_lookup(peer)) != NULL) {
+      peer = &rt->nexthop;
+    } else {
+#if UIP_DS6_DEFRT_FLOW_HASH
+      peer = uip_ds6_defrt_choose_flow(src, flow);
+#else /* UIP_DS6_DEFRT_FLOW_HASH */
+      peer = uip_ds6_defrt_choose();
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
+      if(peer == NULL) {
+        return;
+      }
+    }
+  }
+  if((locnbr = uip_ds6_nbr_lookup(peer)) == NULL ||
+     locnbr->state == NBR_INCOMPLETE) {
+    return;
+  }
+  nbr_confirm(locnbr);
+}
+
+#if UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Neighbor of the current interface with link-layer address lladdr.
+ * Addresses are formed from the link-layer address in 6LoWPAN-ND, so the
+ * candidates are looked up by IP address: the link-local one first, as
+ * routers are known by it, then one per prefix of our own addresses, for
+ * hosts registered with a global address.
+ */
+uip_ds6_nbr_t *
+uip_ds6_nbr_ll_lookup(uip_lladdr_t *lladdr)
+{
+  uip_ipaddr_t ipaddr;
+  uip_ds6_addr_t *addr;
+
+  uip_create_linklocal_prefix(&ipaddr);
+  uip_ds6_set_addr_iid(&ipaddr, lladdr);
+  if((locnbr = uip_ds6_nbr_lookup(&ipaddr)) != NULL &&
+     memcmp(&locnbr->lladdr, lladdr, UIP_LLADDR_LEN) == 0) {
+    return locnbr;
+  }
+  for(addr = uip_ds6_if.addr_list;
+      addr < uip_ds6_if.addr_list + UIP_DS6_ADDR_NB; addr++) {
+    if(addr->isused && !uip_is_addr_link_local(&addr->ipaddr)) {
+      memcpy(&ipaddr, &addr->ipaddr, 8);
+      uip_ds6_set_addr_iid(&ipaddr, lladdr);
+      if((locnbr = uip_ds6_nbr_lookup(&ipaddr)) != NULL &&
+         memcmp(&locnbr->lladdr, lladdr, UIP_LLADDR_LEN) == 0) {
+        return locnbr;
+      }
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_link_sent(uip_lladdr_t *lladdr, u8_t acked, u8_t transmissions)
+{
+#if UIP_DS6_LINK_ESTIMATOR
+  u16_t sample;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_DS6_LINK_NUD && UIP_DS6_IF_NB > 1
+  /* This may run inside tcpip_output() while another interface is being
+   * processed: select it again before returning */
+  u8_t ifindex = uip_ds6_if_index;
+#endif /* UIP_DS6_LINK_NUD && UIP_DS6_IF_NB > 1 */
+
+  if((locnbr = uip_ds6_nbr_ll_lookup(lladdr)) == NULL) {
+    return;
+  }
+#if UIP_DS6_LINK_ESTIMATOR
+  if(!acked) {
+    sample = UIP_DS6_LINK_NOACK_PENALTY;
+  } else {
+    sample = transmissions > 0 ? transmissions : 1;
+  }
+  sample *= UIP_DS6_LINK_ETX_DIVISOR;
+  locnbr->etx = locnbr->etx - (locnbr->etx >> UIP_DS6_LINK_EWMA_SHIFT) +
+    (sample >> UIP_DS6_LINK_EWMA_SHIFT);
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_DS6_LINK_NUD
+#if UIP_DS6_IF_NB > 1
+  /* Its default router entry, if any, is on its interface */
+  uip_ds6_if_select(locnbr->ifindex);
+#endif /* UIP_DS6_IF_NB > 1 */
+  if(acked) {
+    locnbr->noack = 0;
+    if(locnbr->state != NBR_INCOMPLETE) {
+      nbr_confirm(locnbr);
+    }
+  } else if(++locnbr->noack >= UIP_DS6_LINK_NOACK_MAX &&
+            (locdefrt = uip_ds6_defrt_lookup(&locnbr->ipaddr)) != NULL) {
+    /* Same as a NUD failure: the next packets go to another router, and
+     * RSs are sent if there is none left */
+    PRINTF("Router");
+    PRINT6ADDR(&locnbr->ipaddr);
+    PRINTF("did not ack %u frames, failing over\n", locnbr->noack);
+    uip_ds6_defrt_rm(locdefrt);
+    uip_ds6_nbr_rm(locnbr);
+    uip_ds6_reschedule(0);
+  }
+  uip_ds6_if_select(ifindex);
+#endif /* UIP_DS6_LINK_NUD */
+}
+#endif /* UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD */
+
+#if UIP_DS6_LINK_ESTIMATOR
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_link_received(uip_lladdr_t *lladdr, int16_t rssi)
+{
+  if((locnbr = uip_ds6_nbr_ll_lookup(lladdr)) == NULL) {
+    return;
+  }
+  if(locnbr->rssi == UIP_DS6_LINK_RSSI_UNKNOWN) {
+    locnbr->rssi = rssi;
+  } else {
+    locnbr->rssi += (rssi - locnbr->rssi) / (1 << UIP_DS6_LINK_EWMA_SHIFT);
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief Is the link to a cheaper than the link to b? Lower ETX first, then
+ * stronger RSSI */
+static u8_t
+link_better(uip_ds6_nbr_t *a, uip_ds6_nbr_t *b)
+{
+  if(a->etx != b->etx) {
+    return a->etx < b->etx;
+  }
+  return a->rssi > b->rssi;
+}
+
+/*---------------------------------------------------------------------------*/
+/** \brief ETX of the link to a default router, the worst if it has no NCE */
+static u16_t
+defrt_etx(uip_ds6_defrt_t *defrt)
+{
+  uip_ds6_nbr_t *nbr = uip_ds6_nbr_lookup(&defrt->ipaddr);
+
+  return nbr != NULL ? nbr->etx : 0xFFFF;
+}
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+
+#if UIP_CONF_ROUTER
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Processes an address registration (NS with ARO) received
+ * 									by a 6LR. The NCE of the registered address is created
+ * 									if needed, and becomes non garbage-collectible for the
+ * 									registration lifetime.
+ * 
+ * \param ipaddr		The address to register (source of the NS).
+ * \param lladdr		The link-layer address of the host (SLLAO).
+ * \param eui64			The EUI-64 of the host (ARO).
+ * \param lifetime	The registration lifetime (ARO), in units of 60 seconds.
+ * 									0 removes the registration.
+ * \param state			REG_REGISTERED, or REG_TENTATIVE while the registration
+ * 									waits for the 6LBR (the NCE is kept for
+ * 									UIP_DS6_TENTATIVE_REG_LIFETIME only).
+ * 
+ * \returns					The ARO status to put in the NA.
+ */
+u8_t
+uip_ds6_nbr_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
+                     uip_lladdr_t *eui64, u16_t lifetime, u8_t state)
+{
+  locnbr = uip_ds6_nbr_lookup(ipaddr);
+  if((locnbr != NULL) && (locnbr->reg_state != REG_GARBAGE_COLLECTIBLE) &&
+     (memcmp(&locnbr->eui64, eui64, UIP_LLADDR_LEN) != 0)) {
+    /* The address is registered by another node */
+    PRINTF("Registration of");
+    PRINT6ADDR(ipaddr);
+    PRINTF("is a duplicate\n");
+    return ARO_STATUS_DUPLICATE;
+  }
+  if(lifetime == 0) {
+    /* Deregistration. We keep the NCE (garbage-collectible) so that the NA
+     * can still be delivered */
+    if(locnbr != NULL) {
+      uip_ds6_nbr_set_reg_state(locnbr, REG_GARBAGE_COLLECTIBLE);
+      PERSIST_NBR(locnbr);
+    }
+    return ARO_STATUS_SUCCESS;
+  }
+  if(locnbr == NULL) {
+    /* Only garbage-collectible entries may be evicted to make room */
+    locnbr = uip_ds6_nbr_add(ipaddr, lladdr, 0, NBR_STALE);
+    if(locnbr == NULL) {
+      return ARO_STATUS_RTR_NC_FULL;
+    }
+  } else if(memcmp(&locnbr->lladdr, lladdr, UIP_LLADDR_LEN) != 0) {
+    memcpy(&locnbr->lladdr, lladdr, UIP_LLADDR_LEN);
+    locnbr->state = NBR_STALE;
+    UIP_DS6_TRACE_NBR(locnbr);
+  }
+  if(state == REG_TENTATIVE) {
+    if(locnbr->reg_state == REG_REGISTERED) {
+      /* Refresh: the current registration holds until the 6LBR answers */
+      return ARO_STATUS_SUCCESS;
+    }
+    stimer_set(&locnbr->reg_lifetime, UIP_DS6_TENTATIVE_REG_LIFETIME);
+  } else {
+    stimer_set(&locnbr->reg_lifetime, (unsigned long)lifetime * 60);
+  }
+  uip_ds6_nbr_set_reg_state(locnbr, state);
+  memcpy(&locnbr->eui64, eui64, UIP_LLADDR_LEN);
+  PERSIST_NBR(locnbr);
+  uip_ds6_reschedule(0);
+  return ARO_STATUS_SUCCESS;
+}
+
+#if UIP_ND6_MULTIHOP_DAD
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Sets the 6LBR registrations are checked with. As long as
+ * 									it is unspecified, or one of our addresses, the 6LR
+ * 									checks them against its own 6LBR table.
+ */
+void
+uip_ds6_set_lbr(uip_ipaddr_t *ipaddr)
+{
+  uip_ipaddr_copy(&lbr_ipaddr, ipaddr);
+}
+
+/*---------------------------------------------------------------------------*/
+static uip_ds6_dad_t *
+dad_lookup(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64)
+{
+  for(locdad = uip_ds6_dad_cache; locdad < uip_ds6_dad_cache + UIP_DS6_DAD_NB;
+      locdad++) {
+    if(locdad->isused && uip_ipaddr_cmp(&locdad->ipaddr, ipaddr) &&
+       (memcmp(&locdad->eui64, eui64, UIP_LLADDR_LEN) == 0)) {
+      return locdad;
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Applies the answer of the 6LBR to the NCE of the registered address */
+static u8_t
+dad_done(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64, u8_t status,
+         u16_t lifetime)
+{
+  locnbr = uip_ds6_nbr_lookup(ipaddr);
+  if(locnbr == NULL) {
+    return status;
+  }
+  if(status == ARO_STATUS_SUCCESS) {
+    if(lifetime == 0) {
+      return status;
+    }
+    return uip_ds6_nbr_register(ipaddr, &locnbr->lladdr, eui64, lifetime,
+                                REG_REGISTERED);
+  }
+  if((locnbr->reg_state != REG_GARBAGE_COLLECTIBLE) &&
+     (memcmp(&locnbr->eui64, eui64, UIP_LLADDR_LEN) == 0)) {
+    uip_ds6_nbr_rm(locnbr);
+  }
+  return status;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Processes an address registration on a 6LR doing
+ * 									multihop DAD. The registration is first checked
+ * 									against the neighbor cache, then with the 6LBR, unless
+ * 									the 6LBR already confirmed it and that confirmation is
+ * 									still valid.
+ * 
+ * \param ipaddr		The address to register (source of the NS).
+ * \param lladdr		The link-layer address of the host (SLLAO).
+ * \param eui64			The EUI-64 of the host (ARO).
+ * \param lifetime	The registration lifetime (ARO), in units of 60 seconds.
+ * 
+ * \returns					The ARO status to put in the NA, or REG_STATUS_PENDING
+ * 									if there is no NA to send yet. In that case uip_buf
+ * 									holds the DAR for the 6LBR, if one is needed.
+ */
+u8_t
+uip_ds6_dad_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
+                     uip_lladdr_t *eui64, u16_t lifetime)
+{
+  unsigned long remaining;
+  u8_t status;
+
+  locdad = dad_lookup(ipaddr, eui64);
+  if(locdad != NULL && !stimer_expired(&locdad->timer)) {
+    if(locdad->state == DAD_PENDING) {
+      /* The DAR is on its way, the host will retry */
+      uip_len = 0;
+      return REG_STATUS_PENDING;
+    }
+    remaining = stimer_remaining(&locdad->timer) / 60;
+    if(lifetime != 0 && remaining > 0) {
+      /* Confirmed by the 6LBR: no need to ask again within the lifetime it
+       * granted */
+      return uip_ds6_nbr_register(ipaddr, lladdr, eui64,
+                                  remaining < lifetime ? (u16_t)remaining : lifetime,
+                                  REG_REGISTERED);
+    }
+  }
+
+  status = uip_ds6_nbr_register(ipaddr, lladdr, eui64, lifetime,
+                                REG_TENTATIVE);
+  if(status != ARO_STATUS_SUCCESS) {
+    return status;
+  }
+
+  if(uip_is_addr_unspecified(&lbr_ipaddr) || uip_ds6_is_my_addr(&lbr_ipaddr)) {
+    /* We are the 6LBR, or stand in for it */
+    return dad_done(ipaddr, eui64, uip_ds6_lbr_register(ipaddr, eui64, lifetime),
+                    lifetime);
+  }
+
+  if(locdad == NULL) {
+    for(locdad = uip_ds6_dad_cache;
+        locdad < uip_ds6_dad_cache + UIP_DS6_DAD_NB; locdad++) {
+      if(!locdad->isused || stimer_expired(&locdad->timer)) {
+        break;
+      }
+    }
+    if(locdad == uip_ds6_dad_cache + UIP_DS6_DAD_NB) {
+      return dad_done(ipaddr, eui64, ARO_STATUS_RTR_NC_FULL, lifetime);
+    }
+  }
+  locdad->isused = 1;
+  locdad->state = DAD_PENDING;
+  uip_ipaddr_copy(&locdad->ipaddr, ipaddr);
+  memcpy(&locdad->eui64, eui64, UIP_LLADDR_LEN);
+  stimer_set(&locdad->timer, UIP_ND6_DAR_RETRANS_TIME);
+  /* ipaddr and lladdr may point into uip_buf */
+  uip_nd6_dar_output(&lbr_ipaddr, &locdad->ipaddr, &locdad->eui64, lifetime);
+  return REG_STATUS_PENDING;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Completes a registration with the answer (DAC) of the
+ * 									6LBR.
+ * 
+ * \returns					The ARO status to put in the NA for the host, or
+ * 									REG_STATUS_PENDING if we did not send that DAR.
+ */
+u8_t
+uip_ds6_dad_complete(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64, u8_t status,
+                     u16_t lifetime)
+{
+  locdad = dad_lookup(ipaddr, eui64);
+  if(locdad == NULL || locdad->state != DAD_PENDING) {
+    return REG_STATUS_PENDING;
+  }
+  if(status == ARO_STATUS_SUCCESS && lifetime != 0) {
+    locdad->state = DAD_CONFIRMED;
+    stimer_set(&locdad->timer, (unsigned long)lifetime * 60);
   } else {
-    return NOSPACE;
+    locdad->isused = 0;
   }
+  return dad_done(ipaddr, eui64, status, lifetime);
 }
 
 /*---------------------------------------------------------------------------*/
-uip_ds6_nbr_t *
-uip_ds6_nbr_add(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr,
-                u8_t isrouter, u8_t state)
+/**
+ * \brief						Checks a registration against the registrations of
+ * 									the whole 6LoWPAN, and records it (6LBR).
+ * 
+ * \returns					ARO_STATUS_DUPLICATE if another EUI-64 holds the
+ * 									address, ARO_STATUS_RTR_NC_FULL if the table is full,
+ * 									ARO_STATUS_SUCCESS otherwise.
+ */
+u8_t
+uip_ds6_lbr_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64,
+                     u16_t lifetime)
 {
-  int r;
-
-  r = uip_ds6_list_loop
-     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **) &locnbr);
-  //  printf("r %d\n", r);
-
-  if(r == FREESPACE) {
-    locnbr->isused = 1;
-    uip_ipaddr_copy(&(locnbr->ipaddr), ipaddr);
-    if(lladdr != NULL) {
-      memcpy(&(locnbr->lladdr), lladdr, UIP_LLADDR_LEN);
-    } else {
-      memset(&(locnbr->lladdr), 0, UIP_LLADDR_LEN);
+  for(loclbrreg = lbr_reg_hash[LBR_REG_HASH(ipaddr)]; loclbrreg != NULL;
+      loclbrreg = loclbrreg->hash_next) {
+    if(uip_ipaddr_cmp(&loclbrreg->ipaddr, ipaddr)) {
+      break;
     }
-    locnbr->isrouter = isrouter;
-    locnbr->state = state;
-    /* timers are set separately, for now we put them in expired state */
-    stimer_set(&(locnbr->reachable), 0);
-    stimer_set(&(locnbr->sendns), 0);
-    locnbr->nscount = 0;
-    PRINTF("Adding neighbor with ip addr");
-    PRINT6ADDR(ipaddr);
-    PRINTF("link addr");
-    PRINTLLADDR((&(locnbr->lladdr)));
-    PRINTF("state %u\n", state);
-    NEIGHBOR_STATE_CHANGED(locnbr);
-
-    locnbr->last_lookup = clock_time();
-    //    printf("add %p\n", locnbr);
-    return locnbr;
-  } else if(r == NOSPACE) {
-    /* We did not find any empty slot on the neighbor list, so we need
-       to remove one old entry to make room. */
-    uip_ds6_nbr_t *n, *oldest;
-    clock_time_t oldest_time;
-
-    oldest = NULL;
-    oldest_time = clock_time();
-
-    for(n = uip_ds6_nbr_cache;
-        n < &uip_ds6_nbr_cache[UIP_DS6_NBR_NB];
-        n++) {
-      if(n->isused) {
-        if((n->last_lookup < oldest_time) && (uip_ds6_is_nbr_garbage_collectible(n))) {
-        	/* We do not want to remove any non-garbage-collectible entry */
-          oldest = n;
-          oldest_time = n->last_lookup;
-        }
-      }
+  }
+  if(loclbrreg != NULL && stimer_expired(&loclbrreg->lifetime)) {
+    /* Not swept by uip_ds6_periodic() yet: the address is free */
+    memcpy(&loclbrreg->eui64, eui64, UIP_LLADDR_LEN);
+  }
+  if(loclbrreg != NULL) {
+    if(memcmp(&loclbrreg->eui64, eui64, UIP_LLADDR_LEN) != 0) {
+      return ARO_STATUS_DUPLICATE;
     }
-    if(oldest != NULL) {
-      //      printf("rm3\n");
-      uip_ds6_nbr_rm(oldest);
-      locdefrt = uip_ds6_defrt_lookup(&oldest->ipaddr);
-      uip_ds6_defrt_rm(locdefrt);
-      uip_ds6_reg_cleanup_defrt(locdefrt);
-			return uip_ds6_nbr_add(ipaddr, lladdr, isrouter, state);
+    if(lifetime == 0) {
+      lbr_reg_rm(loclbrreg);
+    } else {
+      stimer_set(&loclbrreg->lifetime, (unsigned long)lifetime * 60);
+      PERSIST_LBR(loclbrreg);
     }
+    return ARO_STATUS_SUCCESS;
   }
-  PRINTF("uip_ds6_nbr_add drop\n");
-  return NULL;
-}
-
-/*---------------------------------------------------------------------------*/
-void
-uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
-{
-  if(nbr != NULL) {
-    nbr->isused = 0;
-    //    NEIGHBOR_STATE_CHANGED(nbr);
+  if(lifetime == 0) {
+    return ARO_STATUS_SUCCESS;
   }
-  return;
+  loclbrreg = uip_ds6_lbr_reg_add(ipaddr, eui64);
+  if(loclbrreg == NULL) {
+    return ARO_STATUS_RTR_NC_FULL;
+  }
+  stimer_set(&loclbrreg->lifetime, (unsigned long)lifetime * 60);
+  PERSIST_LBR(loclbrreg);
+  return ARO_STATUS_SUCCESS;
 }
 
 /*---------------------------------------------------------------------------*/
-uip_ds6_nbr_t *
-uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr)
+/**
+ * \brief						Takes a free entry of the 6LBR table for ipaddr. The
+ * 									caller sets its lifetime.
+ * 
+ * \returns					The entry, or NULL if the table is full.
+ */
+uip_ds6_lbr_reg_t *
+uip_ds6_lbr_reg_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64)
 {
-  if(uip_ds6_list_loop
-     ((uip_ds6_element_t *) uip_ds6_nbr_cache, UIP_DS6_NBR_NB,
-      sizeof(uip_ds6_nbr_t), ipaddr, 128,
-      (uip_ds6_element_t **) & locnbr) == FOUND) {
-    return locnbr;
+  uip_ds6_lbr_reg_t *reg = lbr_reg_free;
+
+  if(reg == NULL) {
+    return NULL;
   }
-  return NULL;
+  lbr_reg_free = reg->hash_next;
+  reg->isused = 1;
+  uip_ipaddr_copy(&reg->ipaddr, ipaddr);
+  memcpy(&reg->eui64, eui64, UIP_LLADDR_LEN);
+  reg->hash_next = lbr_reg_hash[LBR_REG_HASH(ipaddr)];
+  lbr_reg_hash[LBR_REG_HASH(ipaddr)] = reg;
+  return reg;
 }
+#endif /* UIP_ND6_MULTIHOP_DAD */
+#endif /* UIP_CONF_ROUTER */
 /*---------------------------------------------------------------------------*/
 /**
  * \brief						Adds a registration to the registrations list. It also 
@@ -567,18 +2199,29 @@ uip_ds6_reg_add(uip_ds6_addr_t* addr, uip_ds6_defrt_t* defrt, u8_t state) {
 	/* If there was an entry not in use, use it; otherwise overwrite
 	 * our canditate entry in Garbage-collectible state*/
 	if (candidate != NULL) {
+		if (candidate->isused) {
+			/* Unlink it from its current router and address first */
+			UIP_ND6_STAT(++uip_nd6_stats.reg_evictions);
+			uip_ds6_reg_rm(candidate);
+		}
 		candidate->isused = 1;
 		candidate->addr = addr;
 		candidate->defrt = defrt;
 		candidate->state = state;
+		UIP_DS6_TRACE_REG(candidate);
   	timer_set(&candidate->registration_timer, 0);
   	candidate->reg_count = 0;
+  	candidate->in_progress = 0;
 		if(candidate->state == REG_GARBAGE_COLLECTIBLE) {
 			stimer_set(&candidate->reg_lifetime, UIP_DS6_GARBAGE_COLLECTIBLE_REG_LIFETIME);
 		} else if (candidate->state == REG_TENTATIVE) {
 			stimer_set(&candidate->reg_lifetime, UIP_DS6_TENTATIVE_REG_LIFETIME);
 		}
 		defrt->registrations++;
+		candidate->defrt_next = defrt->reg_list;
+		defrt->reg_list = candidate;
+		candidate->addr_next = addr->reg_list;
+		addr->reg_list = candidate;
 		return candidate;
 	}
 	return NULL;
@@ -596,11 +2239,48 @@ uip_ds6_reg_add(uip_ds6_addr_t* addr, uip_ds6_defrt_t* defrt, u8_t state) {
 void 
 uip_ds6_reg_rm(uip_ds6_reg_t* reg){
 	
+	uip_ds6_reg_t** prev;
+
+#if UIP_DS6_TRACE
+	uip_ds6_trace(UIP_DS6_TRACE_REG_RM, reg - uip_ds6_reg_list, 0);
+#endif /* UIP_DS6_TRACE */
+	for (prev = &reg->defrt->reg_list; *prev != NULL; prev = &(*prev)->defrt_next) {
+		if (*prev == reg) {
+			*prev = reg->defrt_next;
+			break;
+		}
+	}
+	for (prev = &reg->addr->reg_list; *prev != NULL; prev = &(*prev)->addr_next) {
+		if (*prev == reg) {
+			*prev = reg->addr_next;
+			break;
+		}
+	}
 	reg->defrt->registrations--;
 	reg->isused = 0;
+	uip_ds6_reg_done(reg);
 	  
 }
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Ends the registration in progress of reg, if any, so 
+ * 									that other registrations can proceed.
+ * 
+ * \param reg				The registration that received its NA (or was given up).
+ */ 
+
+void 
+uip_ds6_reg_done(uip_ds6_reg_t* reg){
+	
+	if (reg->in_progress) {
+		reg->in_progress = 0;
+		UIP_DS6_IF_OF(reg->defrt).registrations_in_progress--;
+		UIP_DS6_QUEUE_WAKEUP();
+		uip_ds6_reschedule(0);
+	}
+}
+
 /*---------------------------------------------------------------------------*/
 /**
  * \brief						Looks for a registration in the registrations list.
@@ -616,9 +2296,9 @@ uip_ds6_reg_lookup(uip_ds6_addr_t* addr, uip_ds6_defrt_t* defrt){
 	
 	uip_ds6_reg_t* reg;
 	
-	for (reg = uip_ds6_reg_list; 
-			reg < uip_ds6_reg_list + UIP_DS6_REG_LIST_SIZE; reg++) {
-		if ((reg->isused) && (reg->addr == addr) && (reg->defrt == defrt)) {
+	/* An address has at most UIP_DS6_REGS_PER_ADDR registrations */
+	for (reg = addr->reg_list; reg != NULL; reg = reg->addr_next) {
+		if (reg->defrt == defrt) {
 			return reg;
 		}
 	}	
@@ -636,13 +2316,12 @@ uip_ds6_reg_lookup(uip_ds6_addr_t* addr, uip_ds6_defrt_t* defrt){
 void 
 uip_ds6_reg_cleanup_defrt(uip_ds6_defrt_t* defrt) {
 	
-	uip_ds6_reg_t* reg;
-
-	for (reg = uip_ds6_reg_list; 
-			reg < uip_ds6_reg_list + UIP_DS6_REG_LIST_SIZE; reg++) {
-		if ((reg->isused) && (reg->defrt == defrt)) {
-			uip_ds6_reg_rm(reg);
-		}
+	if (defrt == NULL) {
+		return;
+	}
+	/* uip_ds6_reg_rm() unlinks the head */
+	while (defrt->reg_list != NULL) {
+		uip_ds6_reg_rm(defrt->reg_list);
 	}
 }
 
@@ -663,16 +2342,18 @@ void
 uip_ds6_reg_cleanup_addr(uip_ds6_addr_t* addr) {
 	
 	uip_ds6_reg_t* reg;	
+	uip_ds6_reg_t* next;	
 	
-	for (reg = uip_ds6_reg_list; 
-			reg < uip_ds6_reg_list + UIP_DS6_REG_LIST_SIZE; reg++) {
-		if ((reg->isused) && (reg->addr == addr)) {
-			if (reg->state != REG_REGISTERED) {
-				uip_ds6_reg_rm(reg);
-			} else {
-				/* Mark it as TO_BE_UNREGISTERED */
-				reg->state = REG_TO_BE_UNREGISTERED;
-			}
+	for (reg = addr->reg_list; reg != NULL; reg = next) {
+		/* uip_ds6_reg_rm() unlinks reg */
+		next = reg->addr_next;
+		if (reg->state != REG_REGISTERED) {
+			uip_ds6_reg_rm(reg);
+		} else {
+			/* Mark it as TO_BE_UNREGISTERED */
+			reg->state = REG_TO_BE_UNREGISTERED;
+			UIP_DS6_TRACE_REG(reg);
+			uip_ds6_reschedule(0);
 		}
 	}
 }
@@ -711,13 +2392,19 @@ u8_t uip_ds6_is_nbr_garbage_collectible(uip_ds6_nbr_t *nbr) {
 	uip_ds6_reg_t* reg;	
 	uip_ds6_defrt_t* defrt;
 	
+#if UIP_CONF_ROUTER
+	/* Registered (or tentative) NCEs are never garbage-collected */
+	if (nbr->reg_state != REG_GARBAGE_COLLECTIBLE) {
+		return 0;
+	}
+#endif /* UIP_CONF_ROUTER */
 	defrt = uip_ds6_defrt_lookup(&nbr->ipaddr);
+	if (defrt == NULL) {
+		return 1;
+	}
 	
-	for (reg = uip_ds6_reg_list; 
-			reg < uip_ds6_reg_list + UIP_DS6_REG_LIST_SIZE; reg++) {
-		if ((reg->isused) && 
-				(reg->defrt == defrt) && 
-				(reg->state != REG_GARBAGE_COLLECTIBLE)) {
+	for (reg = defrt->reg_list; reg != NULL; reg = reg->defrt_next) {
+		if (reg->state != REG_GARBAGE_COLLECTIBLE) {
 			return 0;
 		}
 	}
@@ -746,11 +2433,15 @@ uip_ds6_context_add(uip_nd6_opt_6co *context_option,
 																						u16_t defrt_lifetime) {
 	uip_ds6_addr_context_t* context;	
 	
+	if((context_option->res1_c_cid & UIP_ND6_RA_CID) >= SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) {
+		return NULL;
+	}
 	context = &uip_ds6_addr_context_table[context_option->res1_c_cid & UIP_ND6_RA_CID];
 	if(context->state != NOT_IN_USE) {
 		/* Context aready exists */
 		return NULL;
 	}
+  UIP_DS6_CONTEXT_WRITE_BEGIN(context);
   context->length = context_option->preflen;
   context->context_id = context_option->res1_c_cid & UIP_ND6_RA_CID;
   uip_ipaddr_copy(&context->prefix, &context_option->prefix);
@@ -759,6 +2450,8 @@ uip_ds6_context_add(uip_nd6_opt_6co *context_option,
   } else {
   	context->state = IN_USE_UNCOMPRESS_ONLY;
   }
+  UIP_DS6_CONTEXT_WRITE_END(context);
+  UIP_DS6_TRACE_CONTEXT(context);
   /* Prevent overflow in case we need to set the lifetime to "twice the
    * Default Router Lifetime" */
   stimer_set(&context->vlifetime, uip_ntohs(context_option->lifetime));
@@ -775,7 +2468,8 @@ uip_ds6_context_add(uip_nd6_opt_6co *context_option,
  */
 void 
 uip_ds6_context_rm(uip_ds6_addr_context_t *context){
-	context->state = NOT_IN_USE;
+	UIP_DS6_CONTEXT_SET_STATE(context, NOT_IN_USE);
+	UIP_DS6_TRACE_CONTEXT(context);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -790,7 +2484,8 @@ uip_ds6_context_rm(uip_ds6_addr_context_t *context){
 uip_ds6_addr_context_t*
 uip_ds6_context_lookup_by_id(u8_t context_id){
 
-	if (uip_ds6_addr_context_table[context_id].state != NOT_IN_USE){
+	if ((context_id < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) &&
+			(uip_ds6_addr_context_table[context_id].state != NOT_IN_USE)){
 		return &uip_ds6_addr_context_table[context_id]; 
 	} else {
 		return NULL;
@@ -823,20 +2518,225 @@ uip_ds6_addr_context_t *uip_ds6_context_lookup_by_prefix(uip_ipaddr_t *prefix) {
   return NULL;
 }
 
+#if defined(SICSLOWPAN_CONF_THREADS) && SICSLOWPAN_CONF_THREADS
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief 						Copies a context for a radio thread, consistently
+ * 										with the changes the IP thread makes to it (see
+ * 										UIP_DS6_CONTEXT_WRITE_BEGIN()).
+ * 
+ * \param context_id 	The context id of the context to copy.
+ * \param copy				Where to copy it.
+ * 
+ * \returns			 			copy if the context is in use, otherwise NULL.
+ */
+uip_ds6_addr_context_t *
+uip_ds6_context_read(u8_t context_id, uip_ds6_addr_context_t *copy)
+{
+	uip_ds6_addr_context_t *context;
+	u32_t seq;
+
+	if (context_id >= SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) {
+		return NULL;
+	}
+	context = &uip_ds6_addr_context_table[context_id];
+	do {
+		seq = __atomic_load_n(&context->seq, __ATOMIC_ACQUIRE);
+		memcpy(copy, context, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || __atomic_load_n(&context->seq, __ATOMIC_RELAXED) != seq);
+	return copy->state != NOT_IN_USE ? copy : NULL;
+}
+#endif /* SICSLOWPAN_CONF_THREADS */
+
+#if UIP_CONF_ROUTER
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Sets a context a router advertises in its RAs (6CO).
+ * 									A context is first advertised with C=0 for
+ * 									UIP_ND6_MIN_CONTEXT_CHANGE_DELAY, so that every host
+ * 									can decompress with it before anybody compresses with
+ * 									it. Turning compression off is immediate.
+ * 
+ * \param lifetime	Valid lifetime to advertise, in units of 60 seconds.
+ * \param compress	Whether the context is to be used for compression.
+ * 
+ * \returns					The context, or NULL if the context id is out of range
+ * 									or still in use for another prefix (withdraw it first).
+ */
+uip_ds6_addr_context_t *
+uip_ds6_context_set(u8_t context_id, uip_ipaddr_t *prefix, u8_t length,
+                    u16_t lifetime, u8_t compress)
+{
+  u8_t state;
+
+  if(context_id >= SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) {
+    return NULL;
+  }
+  loccontext = &uip_ds6_addr_context_table[context_id];
+  state = loccontext->state;
+  if(loccontext->state != NOT_IN_USE) {
+    if((loccontext->length != length) ||
+       !uip_ipaddr_prefixcmp(&loccontext->prefix, prefix, length)) {
+      return NULL;
+    }
+    if(loccontext->state == EXPIRED || loccontext->pending == CONTEXT_TO_REMOVE) {
+      /* Revived before it was removed: hosts still have it */
+      UIP_DS6_CONTEXT_SET_STATE(loccontext, IN_USE_UNCOMPRESS_ONLY);
+      loccontext->pending = CONTEXT_STABLE;
+    }
+  } else {
+    /* Not cleared with memset(): seq must keep counting */
+    loccontext->defrt = NULL;
+    loccontext->defrt_lifetime = 0;
+    stimer_set(&loccontext->vlifetime, 0);
+    UIP_DS6_CONTEXT_WRITE_BEGIN(loccontext);
+    loccontext->context_id = context_id;
+    loccontext->length = length;
+    uip_ipaddr_copy(&loccontext->prefix, prefix);
+    loccontext->state = IN_USE_UNCOMPRESS_ONLY;
+    UIP_DS6_CONTEXT_WRITE_END(loccontext);
+    loccontext->pending = CONTEXT_STABLE;
+  }
+  if(!compress) {
+    UIP_DS6_CONTEXT_SET_STATE(loccontext, IN_USE_UNCOMPRESS_ONLY);
+    loccontext->pending = CONTEXT_STABLE;
+  } else if(loccontext->state == IN_USE_UNCOMPRESS_ONLY &&
+            loccontext->pending != CONTEXT_TO_COMPRESS) {
+    loccontext->pending = CONTEXT_TO_COMPRESS;
+    stimer_set(&loccontext->vlifetime, UIP_ND6_MIN_CONTEXT_CHANGE_DELAY);
+  }
+  if(loccontext->state != state) {
+    UIP_DS6_TRACE_CONTEXT(loccontext);
+  }
+  if(loccontext->state != state || loccontext->lifetime != lifetime) {
+    RA_TRICKLE_RESET();
+  }
+  loccontext->lifetime = lifetime;
+  uip_ds6_reschedule(0);
+  return loccontext;
+}
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Withdraws a context a router advertises. It is
+ * 									advertised with C=0 for UIP_ND6_MIN_CONTEXT_CHANGE_DELAY,
+ * 									then with a lifetime of 0 for as long, and only then
+ * 									removed.
+ */
+void
+uip_ds6_context_withdraw(uip_ds6_addr_context_t *context)
+{
+  if(context->state == NOT_IN_USE || context->state == EXPIRED ||
+     context->pending == CONTEXT_TO_REMOVE) {
+    return;
+  }
+  if(context->state == IN_USE_COMPRESS) {
+    RA_TRICKLE_RESET();
+  }
+  UIP_DS6_CONTEXT_SET_STATE(context, IN_USE_UNCOMPRESS_ONLY);
+  context->pending = CONTEXT_TO_REMOVE;
+  UIP_DS6_TRACE_CONTEXT(context);
+  stimer_set(&context->vlifetime, UIP_ND6_MIN_CONTEXT_CHANGE_DELAY);
+  uip_ds6_reschedule(0);
+}
+#endif /* UIP_CONF_ROUTER */
 
 #endif /* CONF_6LOWPAN_ND_6CO */
+#if CONF_6LOWPAN_ND_ABRO
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Searches for an authoritative border router. Entries
+ * 									whose lifetime expired are removed on the way.
+ * 
+ * \returns					The entry if found, otherwise NULL.
+ */
+uip_ds6_abr_t *
+uip_ds6_abr_lookup(uip_ipaddr_t *ipaddr)
+{
+  for(locabr = uip_ds6_abr_list; locabr < uip_ds6_abr_list + UIP_DS6_ABR_NB;
+      locabr++) {
+    if(locabr->isused && stimer_expired(&locabr->lifetime)) {
+      locabr->isused = 0;
+    }
+    if(locabr->isused && uip_ipaddr_cmp(&locabr->ipaddr, ipaddr)) {
+      return locabr;
+    }
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief						Processes the ABRO of a border router: records its
+ * 									version and lifetime, unless we already know a newer
+ * 									version (versions compare in serial number arithmetic).
+ * 									When the list is full, the entry closest to expiry is
+ * 									replaced.
+ * 
+ * \param lifetime	The valid lifetime, in units of 60 seconds. 0 means
+ * 									UIP_ND6_ABRO_DEF_LIFETIME.
+ * 
+ * \returns					1 if the information versioned by this ABRO is current,
+ * 									0 if it is older than what we already have.
+ */
+u8_t
+uip_ds6_abr_update(uip_ipaddr_t *ipaddr, u32_t version, u16_t lifetime)
+{
+  uip_ds6_abr_t *abr;
+
+  if(lifetime == 0) {
+    lifetime = UIP_ND6_ABRO_DEF_LIFETIME;
+  }
+  abr = uip_ds6_abr_lookup(ipaddr);
+  if(abr != NULL) {
+    if((u32_t)(version - abr->version) > 0x7FFFFFFF) {
+      PRINTF("ABRO version %lu is older than %lu\n", (unsigned long)version,
+             (unsigned long)abr->version);
+      return 0;
+    }
+    if(version != abr->version) {
+      RA_TRICKLE_RESET();
+    }
+  } else {
+    for(locabr = uip_ds6_abr_list; locabr < uip_ds6_abr_list + UIP_DS6_ABR_NB;
+        locabr++) {
+      if(!locabr->isused) {
+        abr = locabr;
+        break;
+      }
+      if(abr == NULL || stimer_remaining(&locabr->lifetime) <
+         stimer_remaining(&abr->lifetime)) {
+        abr = locabr;
+      }
+    }
+    abr->isused = 1;
+    uip_ipaddr_copy(&abr->ipaddr, ipaddr);
+    RA_TRICKLE_RESET();
+  }
+  abr->version = version;
+  stimer_set(&abr->lifetime, (unsigned long)lifetime * 60);
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+  /* Registrations are checked with the 6LBR we advertise */
+  uip_ds6_set_lbr(ipaddr);
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+  return 1;
+}
+#endif /* CONF_6LOWPAN_ND_ABRO */
 /*---------------------------------------------------------------------------*/
 uip_ds6_defrt_t *
 uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
 {
-  if(uip_ds6_list_loop
+  if(uip_ds6_if_list_loop
      ((uip_ds6_element_t *) uip_ds6_defrt_list, UIP_DS6_DEFRT_NB,
       sizeof(uip_ds6_defrt_t), ipaddr, 128,
       (uip_ds6_element_t **) & locdefrt) == FREESPACE) {
     locdefrt->isused = 1;
+    UIP_DS6_IF_SET(locdefrt);
     locdefrt->sending_rs = 0;
     locdefrt->rscount = 0;
+    locdefrt->registrations = 0;
+    locdefrt->reg_list = NULL;
     uip_ipaddr_copy(&(locdefrt->ipaddr), ipaddr);
     if(interval != 0) {
       stimer_set(&(locdefrt->lifetime), interval);
@@ -845,9 +2745,13 @@ uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
       locdefrt->isinfinite = 1;
     }
 
+#if UIP_DS6_TRACE
+    uip_ds6_trace(UIP_DS6_TRACE_DEFRT_ADD, locdefrt - uip_ds6_defrt_list, 0);
+#endif /* UIP_DS6_TRACE */
     PRINTF("Adding defrouter with ip addr");
     PRINT6ADDR(&locdefrt->ipaddr);
     PRINTF("\n");
+    UIP_DS6_QUEUE_WAKEUP();
     return locdefrt;
   }
   return NULL;
@@ -858,7 +2762,22 @@ void
 uip_ds6_defrt_rm(uip_ds6_defrt_t * defrt)
 {
   if(defrt != NULL) {
+#if UIP_DS6_CONV_STATS
+    conv_lost(defrt);
+#endif /* UIP_DS6_CONV_STATS */
+    /* Registrations with a router that is gone are meaningless */
+    uip_ds6_reg_cleanup_defrt(defrt);
     defrt->isused = 0;
+    /* Packets held for it may go to another router */
+    UIP_DS6_QUEUE_WAKEUP();
+#if UIP_DS6_TRACE
+    uip_ds6_trace(UIP_DS6_TRACE_DEFRT_RM, defrt - uip_ds6_defrt_list, 0);
+#endif /* UIP_DS6_TRACE */
+#if UIP_DS6_LINK_ESTIMATOR
+    if(defrt == UIP_DS6_IF_OF(defrt).preferred_defrt) {
+      UIP_DS6_IF_OF(defrt).preferred_defrt = NULL;
+    }
+#endif /* UIP_DS6_LINK_ESTIMATOR */
   }
   return;
 }
@@ -867,7 +2786,7 @@ uip_ds6_defrt_rm(uip_ds6_defrt_t * defrt)
 uip_ds6_defrt_t *
 uip_ds6_defrt_lookup(uip_ipaddr_t * ipaddr)
 {
-  if(uip_ds6_list_loop((uip_ds6_element_t *) uip_ds6_defrt_list,
+  if(uip_ds6_if_list_loop((uip_ds6_element_t *) uip_ds6_defrt_list,
 		       UIP_DS6_DEFRT_NB, sizeof(uip_ds6_defrt_t), ipaddr, 128,
 		       (uip_ds6_element_t **) & locdefrt) == FOUND) {
     return locdefrt;
@@ -880,11 +2799,15 @@ uip_ipaddr_t *
 uip_ds6_defrt_choose(void)
 {
   uip_ds6_nbr_t *bestnbr;
+#if UIP_DS6_LINK_ESTIMATOR
+  uip_ds6_defrt_t *best = NULL;
+  uip_ds6_nbr_t *best_nbr = NULL;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
 
   locipaddr = NULL;
   for(locdefrt = uip_ds6_defrt_list;
       locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-    if(locdefrt->isused) {
+    if(locdefrt->isused && UIP_DS6_IF_MATCH(locdefrt)) {
       PRINTF("Defrt, IP address ");
       PRINT6ADDR(&locdefrt->ipaddr);
       PRINTF("\n");
@@ -893,7 +2816,15 @@ uip_ds6_defrt_choose(void)
         PRINTF("Defrt found, IP address ");
         PRINT6ADDR(&locdefrt->ipaddr);
         PRINTF("\n");
+#if UIP_DS6_LINK_ESTIMATOR
+        PRINTF("ETX %u, RSSI %d\n", bestnbr->etx, bestnbr->rssi);
+        if(best == NULL || link_better(bestnbr, best_nbr)) {
+          best = locdefrt;
+          best_nbr = bestnbr;
+        }
+#else /* UIP_DS6_LINK_ESTIMATOR */
         return &locdefrt->ipaddr;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
       } else {
         locipaddr = &locdefrt->ipaddr;
         PRINTF("Defrt INCOMPLETE found, IP address ");
@@ -902,6 +2833,20 @@ uip_ds6_defrt_choose(void)
       }
     }
   }
+#if UIP_DS6_LINK_ESTIMATOR
+  if(best != NULL) {
+    /* Stay with the current router unless the best one is clearly better */
+    locdefrt = uip_ds6_if.preferred_defrt;
+    if(locdefrt != NULL && locdefrt != best && locdefrt->isused &&
+       (bestnbr = uip_ds6_nbr_lookup(&locdefrt->ipaddr)) != NULL &&
+       bestnbr->state != NBR_INCOMPLETE &&
+       bestnbr->etx <= best_nbr->etx + UIP_DS6_LINK_ETX_HYSTERESIS) {
+      best = locdefrt;
+    }
+    uip_ds6_if.preferred_defrt = best;
+    return &best->ipaddr;
+  }
+#endif /* UIP_DS6_LINK_ESTIMATOR */
   return locipaddr;
 }
 /*---------------------------------------------------------------------------*/
@@ -916,11 +2861,25 @@ uip_ds6_defrt_choose_min_reg(uip_ds6_addr_t* addr)
 {
 	u8_t min = 0;
 	uip_ds6_defrt_t* min_defrt = NULL;
+#if UIP_DS6_LINK_ESTIMATOR
+	u16_t min_etx = 0;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
 	
   for(locdefrt = uip_ds6_defrt_list;
       locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-    if (locdefrt->isused) {
+    if (locdefrt->isused && UIP_DS6_IF_MATCH(locdefrt)) {
     	if (NULL == uip_ds6_reg_lookup(addr, locdefrt)) {
+#if UIP_DS6_LINK_ESTIMATOR
+	      /* Among the routers with the fewest registrations, the cheapest */
+	      if ((min_defrt == NULL) ||
+	      		(uip_ds6_get_registrations(locdefrt) < min) ||
+	      		((uip_ds6_get_registrations(locdefrt) == min) &&
+	      		 (defrt_etx(locdefrt) < min_etx))) {
+	      	min_defrt = locdefrt;
+	      	min = uip_ds6_get_registrations(locdefrt);
+	      	min_etx = defrt_etx(locdefrt);
+	      }
+#else /* UIP_DS6_LINK_ESTIMATOR */
 	      if ((min_defrt == NULL) || 
 	      		((min_defrt != NULL) && (uip_ds6_get_registrations(locdefrt) < min))) {
 	      	min_defrt = locdefrt;
@@ -930,12 +2889,68 @@ uip_ds6_defrt_choose_min_reg(uip_ds6_addr_t* addr)
 	      		return min_defrt;
 	      	}		
 	      }
+#endif /* UIP_DS6_LINK_ESTIMATOR */
     	}  
     }
   }
   return min_defrt;
 }
 
+#if UIP_DS6_DEFRT_FLOW_HASH
+/*---------------------------------------------------------------------------*/
+/** \brief Weight of a router for a flow (rendezvous hashing): the flow goes
+ * to the router with the highest weight */
+static u32_t
+flow_weight(u32_t flow, uip_ds6_defrt_t *defrt)
+{
+  u32_t h = flow;
+  u8_t i;
+
+  for(i = 0; i < 16; i++) {
+    h = (h ^ defrt->ipaddr.u8[i]) * 16777619UL;
+  }
+  /* Final mix, so that close hashes get unrelated weights */
+  h ^= h >> 16;
+  h *= 0x7feb352dUL;
+  h ^= h >> 15;
+  h *= 0x846ca68bUL;
+  h ^= h >> 16;
+  return h;
+}
+
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+uip_ds6_defrt_choose_flow(uip_ipaddr_t *src, u32_t flow)
+{
+  uip_ds6_reg_t *reg;
+  uip_ds6_nbr_t *nbr;
+  uip_ds6_defrt_t *best = NULL;
+  u32_t weight, best_weight = 0;
+
+  locaddr = uip_ds6_addr_lookup(src);
+  if(locaddr != NULL) {
+    for(reg = locaddr->reg_list; reg != NULL; reg = reg->addr_next) {
+      if(reg->state != REG_REGISTERED || !reg->defrt->isused) {
+        continue;
+      }
+      nbr = uip_ds6_nbr_lookup(&reg->defrt->ipaddr);
+      if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+        continue;
+      }
+      weight = flow_weight(flow, reg->defrt);
+      if(best == NULL || weight > best_weight) {
+        best = reg->defrt;
+        best_weight = weight;
+      }
+    }
+  }
+  if(best == NULL) {
+    return uip_ds6_defrt_choose();
+  }
+  return &best->ipaddr;
+}
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
+
 #if UIP_CONF_ROUTER
 /*---------------------------------------------------------------------------*/
 uip_ds6_prefix_t *
@@ -943,17 +2958,21 @@ uip_ds6_prefix_add(uip_ipaddr_t * ipaddr, u8_t ipaddrlen,
                    u8_t advertise, u8_t flags, unsigned long vtime,
                    unsigned long ptime)
 {
-  if(uip_ds6_list_loop
+  if(uip_ds6_if_list_loop
      ((uip_ds6_element_t *) uip_ds6_prefix_list, UIP_DS6_PREFIX_NB,
       sizeof(uip_ds6_prefix_t), ipaddr, ipaddrlen,
       (uip_ds6_element_t **) & locprefix) == FREESPACE) {
     locprefix->isused = 1;
+    UIP_DS6_IF_SET(locprefix);
     uip_ipaddr_copy(&(locprefix->ipaddr), ipaddr);
     locprefix->length = ipaddrlen;
     locprefix->advertise = advertise;
     locprefix->l_a_reserved = flags;
     locprefix->vlifetime = vtime;
     locprefix->plifetime = ptime;
+    if(advertise) {
+      RA_TRICKLE_RESET();
+    }
     PRINTF("Adding prefix ");
     PRINT6ADDR(&locprefix->ipaddr);
     PRINTF("length %u, flags %x, Valid lifetime %lx, Preffered lifetime %lx\n",
@@ -971,11 +2990,12 @@ uip_ds6_prefix_t *
 uip_ds6_prefix_add(uip_ipaddr_t * ipaddr, u8_t ipaddrlen,
                    unsigned long interval)
 {
-  if(uip_ds6_list_loop
+  if(uip_ds6_if_list_loop
      ((uip_ds6_element_t *) uip_ds6_prefix_list, UIP_DS6_PREFIX_NB,
       sizeof(uip_ds6_prefix_t), ipaddr, ipaddrlen,
       (uip_ds6_element_t **) & locprefix) == FREESPACE) {
     locprefix->isused = 1;
+    UIP_DS6_IF_SET(locprefix);
     uip_ipaddr_copy(&(locprefix->ipaddr), ipaddr);
     locprefix->length = ipaddrlen;
     if(interval != 0) {
@@ -998,6 +3018,11 @@ uip_ds6_prefix_rm(uip_ds6_prefix_t * prefix)
 {
   if(prefix != NULL) {
     prefix->isused = 0;
+#if UIP_CONF_ROUTER
+    if(prefix->advertise) {
+      RA_TRICKLE_RESET();
+    }
+#endif /* UIP_CONF_ROUTER */
   }
   return;
 }
@@ -1005,7 +3030,7 @@ uip_ds6_prefix_rm(uip_ds6_prefix_t * prefix)
 uip_ds6_prefix_t *
 uip_ds6_prefix_lookup(uip_ipaddr_t * ipaddr, u8_t ipaddrlen)
 {
-  if(uip_ds6_list_loop((uip_ds6_element_t *)uip_ds6_prefix_list,
+  if(uip_ds6_if_list_loop((uip_ds6_element_t *)uip_ds6_prefix_list,
 		       UIP_DS6_PREFIX_NB, sizeof(uip_ds6_prefix_t),
 		       ipaddr, ipaddrlen,
 		       (uip_ds6_element_t **)&locprefix) == FOUND) {
@@ -1041,6 +3066,8 @@ uip_ds6_addr_add(uip_ipaddr_t * ipaddr, unsigned long vlifetime, u8_t type)
 		locaddr->state = ADDR_TENTATIVE;	
 	}
     locaddr->type = type;
+    locaddr->defrt = NULL;
+    locaddr->reg_list = NULL;
     if(vlifetime == 0) {
       locaddr->isinfinite = 1;
     } else {
@@ -1066,6 +3093,15 @@ void
 uip_ds6_addr_rm(uip_ds6_addr_t * addr)
 {
   if(addr != NULL) {
+    /* Its registrations cannot outlive it: the slot may be reused by
+     * uip_ds6_addr_add() before they would be sent again */
+    while(addr->reg_list != NULL) {
+      uip_ds6_reg_rm(addr->reg_list);
+    }
+#if UIP_DS6_CONV_STATS
+    /* A removed address does not recover */
+    conv_found(addr);
+#endif /* UIP_DS6_CONV_STATS */
     addr->isused = 0;
   }
   return;
@@ -1245,6 +3281,7 @@ uip_ds6_route_add(uip_ipaddr_t * ipaddr, u8_t length, uip_ipaddr_t * nexthop,
       sizeof(uip_ds6_route_t), ipaddr, length,
       (uip_ds6_element_t **) & locroute) == FREESPACE) {
     locroute->isused = 1;
+    UIP_DS6_IF_SET(locroute);
     uip_ipaddr_copy(&(locroute->ipaddr), ipaddr);
     locroute->length = length;
     uip_ipaddr_copy(&(locroute->nexthop), nexthop);
@@ -1333,6 +3370,23 @@ uip_ds6_set_addr_iid(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr)
 #endif
 }
 
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_set_lladdr_from_iid(uip_lladdr_t * lladdr, uip_ipaddr_t * ipaddr)
+{
+  /* Inverse of uip_ds6_set_addr_iid() */
+#if (UIP_LLADDR_LEN == 8)
+  memcpy(lladdr, ipaddr->u8 + 8, UIP_LLADDR_LEN);
+  lladdr->addr[0] ^= 0x02;
+#elif (UIP_LLADDR_LEN == 6)
+  memcpy(lladdr, ipaddr->u8 + 8, 3);
+  memcpy((u8_t *) lladdr + 3, ipaddr->u8 + 13, 3);
+  lladdr->addr[0] ^= 0x02;
+#else
+#error uip-ds6.c cannot build link-layer address when UIP_LLADDR_LEN is not 6 or 8
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 u8_t
 get_match_length(uip_ipaddr_t * src, uip_ipaddr_t * dst)
@@ -1365,37 +3419,94 @@ get_match_length(uip_ipaddr_t * src, uip_ipaddr_t * dst)
 #if UIP_ND6_SEND_RA
 /*---------------------------------------------------------------------------*/
 void
-uip_ds6_send_ra_solicited(void)
+uip_ds6_send_ra_solicited(uip_ipaddr_t *src)
 {
-  /* We have a pb here: RA timer max possible value is 1800s,
-   * hence we have to use stimers. However, when receiving a RS, we
-   * should delay the reply by a random value between 0 and 500ms timers.
-   * stimers are in seconds, hence we cannot do this. Therefore we just send
-   * the RA (setting the timer to 0 below). We keep the code logic for
-   * the days contiki will support appropriate timers */
-  rand_time = 0;
-  PRINTF("Solicited RA, random time %u\n", rand_time);
+  clock_time_t delay;
+  u8_t i;
+
+  if(uip_ds6_if.ra_solicited == 0) {
+    /* First RS of a window: the answer is delayed by a random time (in
+     * clock ticks, the RA timer is in seconds), and shared by the RSs that
+     * arrive meanwhile */
+    delay = (clock_time_t)(((u32_t)(random_rand() %
+                                    (UIP_ND6_MAX_RA_DELAY_TIME_MS + 1)) *
+                            CLOCK_SECOND) / 1000);
+    PRINTF("Solicited RA in %u ticks\n", (unsigned)delay);
+    timer_set(&uip_ds6_if.ra_window, delay);
+    uip_ds6_reschedule(delay);
+  }
 
-  if(stimer_remaining(&uip_ds6_timer_ra) > rand_time) {
-    if(stimer_elapsed(&uip_ds6_timer_ra) < UIP_ND6_MIN_DELAY_BETWEEN_RAS) {
-      /* Ensure that the RAs are rate limited */
-/*      stimer_set(&uip_ds6_timer_ra, rand_time +
-                 UIP_ND6_MIN_DELAY_BETWEEN_RAS -
-                 stimer_elapsed(&uip_ds6_timer_ra));
-  */ } else {
-      stimer_set(&uip_ds6_timer_ra, rand_time);
+  if(uip_ds6_if.ra_solicited == UIP_DS6_RA_SOLICITED_MCAST) {
+    return;
+  }
+  if(src == NULL) {
+    uip_ds6_if.ra_solicited = UIP_DS6_RA_SOLICITED_MCAST;
+    return;
+  }
+  for(i = 0; i < uip_ds6_if.ra_solicited; i++) {
+    if(uip_ipaddr_cmp(&uip_ds6_if.ra_dest[i], src)) {
+      return;
     }
   }
+  if(uip_ds6_if.ra_solicited < UIP_DS6_RA_SOLICITED_NB) {
+    uip_ipaddr_copy(&uip_ds6_if.ra_dest[uip_ds6_if.ra_solicited], src);
+    uip_ds6_if.ra_solicited++;
+  } else {
+    /* Too many hosts to answer them one by one */
+    uip_ds6_if.ra_solicited = UIP_DS6_RA_SOLICITED_MCAST;
+  }
+}
+
+#if UIP_ND6_RA_TRICKLE
+/*---------------------------------------------------------------------------*/
+/** \brief Start a Trickle interval of trickle_i seconds, its RA being due at
+ * a random time of its second half (UIP_ND6_RA_TRICKLE_IMIN >= 2) */
+static void
+trickle_start(void)
+{
+  u16_t t;
+
+  t = trickle_i / 2 + random_rand() % (trickle_i - trickle_i / 2);
+  trickle_rest = trickle_i - t;
+  trickle_c = 0;
+  trickle_sent = 0;
+  PRINTF("Trickle interval %u, RA in %u\n", trickle_i, t);
+  stimer_set(&uip_ds6_timer_ra, t);
 }
+#endif /* UIP_ND6_RA_TRICKLE */
 
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_send_ra_periodic(void)
 {
+#if UIP_ND6_RA_TRICKLE
+  if(trickle_i == 0) {
+    /* We have a link local address by now */
+    trickle_i = UIP_ND6_RA_TRICKLE_IMIN;
+    trickle_start();
+  } else if(!trickle_sent) {
+    trickle_sent = 1;
+    if(trickle_c < UIP_ND6_RA_TRICKLE_K) {
+      PRINTF("Sending periodic RA\n");
+      ra_output_periodic();
+    } else {
+      PRINTF("Periodic RA suppressed, %u consistent RAs heard\n", trickle_c);
+    }
+    stimer_set(&uip_ds6_timer_ra, trickle_rest);
+  } else {
+    /* End of the interval */
+    if(trickle_i < UIP_ND6_MAX_RA_INTERVAL / 2) {
+      trickle_i *= 2;
+    } else {
+      trickle_i = UIP_ND6_MAX_RA_INTERVAL;
+    }
+    trickle_start();
+  }
+#else /* UIP_ND6_RA_TRICKLE */
   if(racount > 0) {
     /* send previously scheduled RA */
-    uip_nd6_ra_output(NULL);
     PRINTF("Sending periodic RA\n");
+    ra_output_periodic();
   }
 
   rand_time = UIP_ND6_MIN_RA_INTERVAL + random_rand() %
@@ -1411,44 +3522,85 @@ uip_ds6_send_ra_periodic(void)
   }
   PRINTF("Random time 3 = %u\n", rand_time);
   stimer_set(&uip_ds6_timer_ra, rand_time);
+#endif /* UIP_ND6_RA_TRICKLE */
+}
+
+#if UIP_ND6_RA_TRICKLE
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_ra_trickle_reset(void)
+{
+  /* Nothing to do before the first interval, or within an interval of
+   * the smallest size (RFC 6206) */
+  if(trickle_i == 0 || trickle_i == UIP_ND6_RA_TRICKLE_IMIN) {
+    return;
+  }
+  PRINTF("Trickle reset\n");
+  trickle_i = UIP_ND6_RA_TRICKLE_IMIN;
+  trickle_start();
+  uip_ds6_reschedule(stimer_remaining(&uip_ds6_timer_ra) * CLOCK_SECOND);
+}
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_ra_trickle_heard(u8_t consistent)
+{
+  if(!consistent) {
+    uip_ds6_ra_trickle_reset();
+  } else if(trickle_c < 0xFF) {
+    trickle_c++;
+  }
 }
+#endif /* UIP_ND6_RA_TRICKLE */
 
 #endif /* UIP_ND6_SEND_RA */
 #else /* UIP_CONF_ROUTER */
 /*---------------------------------------------------------------------------*/
 
 /**
- * This function calculates the c-th term of the binary exponential backoff. 
- * The result is multiplied by factor k and truncated to trunc if greater.
+ * This function calculates the c-th term of the truncated binary exponential
+ * backoff, in clock ticks: k * 2^c seconds, truncated to trunc seconds. The
+ * result is drawn at random between k and that bound (full jitter), so
+ * that hosts which started together do not stay in step.
  */
-u16_t
+clock_time_t
 beb_next(u16_t c, u16_t k, u16_t trunc)
 {
-	u16_t result;
+	u32_t bound;
 	
-	result = (random_rand() % (2<<(c - 1) - 1)) * k;
-	return (result < trunc ? result : trunc);
+	bound = (u32_t)k << (c < 10 ? c : 10);
+	if (bound > trunc) {
+		bound = trunc;
+	}
+	bound *= CLOCK_SECOND;
+	return (clock_time_t)(k * CLOCK_SECOND +
+	                      (((u32_t)random_rand() << 16) | random_rand()) %
+	                      (bound - k * CLOCK_SECOND + 1));
 }
 
 /**
- * Returns the retransmission interval for a certain retransmission attempt
- * as specified in I.D.ietf-6lowpan-nd.
+ * Returns the retransmission interval (in clock ticks) for a certain
+ * retransmission attempt as specified in I.D.ietf-6lowpan-nd.
  */ 
-u16_t 
+clock_time_t
 rs_rtx_time(u16_t rtx_count) 
 {
 	if (rtx_count < UIP_ND6_MAX_RTR_SOLICITATIONS) {
-		return UIP_ND6_RTR_SOLICITATION_INTERVAL;
-	} else if (rtx_count > 10){
-		return UIP_ND6_MAX_RTR_SOLICITATION_INTERVAL;
+		return UIP_ND6_RTR_SOLICITATION_INTERVAL * CLOCK_SECOND;
 	} else {
 		/* Do binary exponential backoff */
-		return beb_next(rtx_count, 
+		return beb_next(rtx_count - UIP_ND6_MAX_RTR_SOLICITATIONS + 1, 
 				 		UIP_ND6_RTR_SOLICITATION_INTERVAL, 
 				 		UIP_ND6_MAX_RTR_SOLICITATION_INTERVAL);
 	}
 }
 
+void
+uip_ds6_rs_suppress(void)
+{
+  timer_set(&rs_suppress, UIP_ND6_RTR_SOLICITATION_INTERVAL * CLOCK_SECOND);
+}
+
 void
 uip_ds6_send_rs(uip_ds6_defrt_t *defrt)
 {
@@ -1468,7 +3620,8 @@ uip_ds6_send_rs(uip_ds6_defrt_t *defrt)
   } else {
     for(locdefrt = uip_ds6_defrt_list;
         locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-      if((locdefrt->isused) && (locdefrt->sending_rs)) {
+      if((locdefrt->isused) && (locdefrt->sending_rs) &&
+         UIP_DS6_IF_MATCH(locdefrt)) {
         unicast_rs = 1;
         break;
       }
@@ -1479,25 +3632,35 @@ uip_ds6_send_rs(uip_ds6_defrt_t *defrt)
     if (locdefrt->rscount < UIP_ND6_MAX_RTR_SOLICITATIONS) {
       /* Unicast RS and update count and timer */
       uip_nd6_rs_output(&locdefrt->ipaddr);
+      uip_ds6_rs_stats.rs_ucast++;
       locdefrt->rscount = locdefrt->rscount > 10 ? locdefrt->rscount : locdefrt->rscount + 1;
-      timer_set(&uip_ds6_timer_rs, rs_rtx_time(locdefrt->rscount) * CLOCK_SECOND);
+      timer_set(&uip_ds6_timer_rs, rs_rtx_time(locdefrt->rscount));
       return;
     } else {
       /* Switch to multicast */
       locdefrt->sending_rs = 0;
-      rscount = locdefrt->rscount;
+      uip_ds6_rscount = locdefrt->rscount;
       locdefrt->rscount = 0;
     }
 	}
+	if (!timer_expired(&rs_suppress)) {
+	  /* A router answered somebody else lately, and its RA reached us: skip
+	   * this RS, without backing off further */
+	  timer_set(&rs_suppress, 0);
+	  uip_ds6_rs_stats.rs_suppressed++;
+	  timer_set(&uip_ds6_timer_rs, rs_rtx_time(uip_ds6_rscount));
+	  return;
+	}
 	/* Multicast RS and update RS count and timer */
 	uip_nd6_rs_output(NULL);
+	uip_ds6_rs_stats.rs_mcast++;
 	if(uip_ds6_defrt_choose() == NULL) {
-	 	rscount = rscount > 10 ? rscount : rscount + 1;
+	 	uip_ds6_rscount = uip_ds6_rscount > 10 ? uip_ds6_rscount : uip_ds6_rscount + 1;
 	} else {
-   	rscount = 0;
+   	uip_ds6_rscount = 0;
   }
   /* Make sure we do not send rs more frequently than UIP_ND6_RTR_SOLICITATION_INTERVAL */
-	timer_set(&uip_ds6_timer_rs, rs_rtx_time(rscount) * CLOCK_SECOND);
+	timer_set(&uip_ds6_timer_rs, rs_rtx_time(uip_ds6_rscount));
 }
 
 #endif /* UIP_CONF_ROUTER */
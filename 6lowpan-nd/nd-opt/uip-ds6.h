@@ -54,6 +54,16 @@
  * - the number of elements assigned by the system (name suffixed by _NBS)
  * - the total number of elements is the sum (name suffixed by _NB)
 */
+/* Interfaces. Each one has its own uip_ds6_netif_t (ND parameters, address
+ * lists, registrations in progress, solicited RAs) and its own entries in
+ * the neighbor cache, default router list, prefix list and routing table.
+ * The neighbor cache must then be hashed. */
+#ifdef UIP_DS6_CONF_IF_NB
+#define UIP_DS6_IF_NB UIP_DS6_CONF_IF_NB
+#else
+#define UIP_DS6_IF_NB 1
+#endif
+
 /* Neighbor cache */
 #define UIP_DS6_NBR_NBS 0
 #ifndef UIP_CONF_DS6_NBR_NBU
@@ -62,6 +72,80 @@
 #define UIP_DS6_NBR_NBU UIP_CONF_DS6_NBR_NBU
 #endif
 #define UIP_DS6_NBR_NB UIP_DS6_NBR_NBS + UIP_DS6_NBR_NBU
+/* Number of buckets of the neighbor cache hash index. A 6LR keeps one NCE
+ * per registered host, so with large caches linear lookups are too slow.
+ * 0 disables the index. */
+#ifdef UIP_DS6_CONF_NBR_HASH_SIZE
+#define UIP_DS6_NBR_HASH_SIZE UIP_DS6_CONF_NBR_HASH_SIZE
+#elif UIP_CONF_ROUTER
+#define UIP_DS6_NBR_HASH_SIZE 64
+#else
+#define UIP_DS6_NBR_HASH_SIZE 0
+#endif
+#if UIP_DS6_IF_NB > 1 && UIP_DS6_NBR_HASH_SIZE == 0
+#error "UIP_DS6_IF_NB > 1 needs the neighbor cache hash index"
+#endif
+
+/* Link estimator: per neighbor ETX (from the MAC transmission reports)
+ * and RSSI (from received frames), both exponentially weighted moving
+ * averages with a weight of 1/2^UIP_DS6_LINK_EWMA_SHIFT for new samples.
+ * Default routers are ranked by ETX. ETX is in units of
+ * 1/UIP_DS6_LINK_ETX_DIVISOR transmission; a router is only preferred to
+ * the current one if its ETX is lower by more than
+ * UIP_DS6_LINK_ETX_HYSTERESIS. */
+#ifdef UIP_DS6_CONF_LINK_ESTIMATOR
+#define UIP_DS6_LINK_ESTIMATOR UIP_DS6_CONF_LINK_ESTIMATOR
+#else
+#define UIP_DS6_LINK_ESTIMATOR 1
+#endif
+#define UIP_DS6_LINK_ETX_DIVISOR 8
+#define UIP_DS6_LINK_EWMA_SHIFT 2
+#ifdef UIP_DS6_CONF_LINK_ETX_INIT
+#define UIP_DS6_LINK_ETX_INIT UIP_DS6_CONF_LINK_ETX_INIT
+#else
+#define UIP_DS6_LINK_ETX_INIT 2 /* transmissions */
+#endif
+#ifdef UIP_DS6_CONF_LINK_NOACK_PENALTY
+#define UIP_DS6_LINK_NOACK_PENALTY UIP_DS6_CONF_LINK_NOACK_PENALTY
+#else
+#define UIP_DS6_LINK_NOACK_PENALTY 10 /* transmissions */
+#endif
+#ifdef UIP_DS6_CONF_LINK_ETX_HYSTERESIS
+#define UIP_DS6_LINK_ETX_HYSTERESIS UIP_DS6_CONF_LINK_ETX_HYSTERESIS
+#else
+#define UIP_DS6_LINK_ETX_HYSTERESIS (UIP_DS6_LINK_ETX_DIVISOR / 2)
+#endif
+#define UIP_DS6_LINK_RSSI_UNKNOWN (-32767 - 1)
+
+/* MAC feedback to NUD: an acked unicast frame confirms the reachability of
+ * the neighbor, and UIP_DS6_LINK_NOACK_MAX unacked frames in a row make a
+ * default router unreachable at once, without NS probes */
+#ifdef UIP_DS6_CONF_LINK_NUD
+#define UIP_DS6_LINK_NUD UIP_DS6_CONF_LINK_NUD
+#else
+#define UIP_DS6_LINK_NUD 1
+#endif
+#ifdef UIP_DS6_CONF_LINK_NOACK_MAX
+#define UIP_DS6_LINK_NOACK_MAX UIP_DS6_CONF_LINK_NOACK_MAX
+#else
+#define UIP_DS6_LINK_NOACK_MAX 3
+#endif
+
+/* Packets whose next hop can not be resolved yet (no NCE for it, or no
+ * default router at all) or can not take them yet (being probed, or the
+ * source address being registered with it) are held for up to
+ * UIP_DS6_QUEUE_LIFETIME, and sent once the next hop is ready. 0 disables
+ * the queue. */
+#ifdef UIP_DS6_CONF_QUEUE_NB
+#define UIP_DS6_QUEUE_NB UIP_DS6_CONF_QUEUE_NB
+#else
+#define UIP_DS6_QUEUE_NB 2
+#endif
+#ifdef UIP_DS6_CONF_QUEUE_LIFETIME
+#define UIP_DS6_QUEUE_LIFETIME UIP_DS6_CONF_QUEUE_LIFETIME
+#else
+#define UIP_DS6_QUEUE_LIFETIME (5 * CLOCK_SECOND)
+#endif
 
 /* Default router list */
 #define UIP_DS6_DEFRT_NBS 0
@@ -147,12 +231,121 @@
 #endif
 
 #ifdef UIP_DS6_CONF_REGS_PER_ADDR
-#define UIP_DS6_REGS_PER_ADDR UID_DS6_CONF_REGS_PER_ADDR
+#define UIP_DS6_REGS_PER_ADDR UIP_DS6_CONF_REGS_PER_ADDR
 #else
 #define UIP_DS6_REGS_PER_ADDR UIP_DS6_DEFRT_NB 
 #endif
 #define UIP_DS6_REG_LIST_SIZE UIP_DS6_REGS_PER_ADDR * UIP_DS6_ADDR_NB
 
+/* Off-link traffic of an address registered with several routers is spread
+ * over them by flow (addresses, protocol and ports), with rendezvous hashing:
+ * a new router only takes over the flows it wins, the others stay put */
+#ifdef UIP_DS6_CONF_DEFRT_FLOW_HASH
+#define UIP_DS6_DEFRT_FLOW_HASH UIP_DS6_CONF_DEFRT_FLOW_HASH
+#else
+#define UIP_DS6_DEFRT_FLOW_HASH 0
+#endif
+
+/* Maximum number of registrations (NS with ARO waiting for the NA) that can
+ * be in progress at the same time, across all addresses and routers. At most
+ * one of them is with any given router, so that an error NA, which carries
+ * no registered address, is matched to the right one */
+#ifdef UIP_DS6_CONF_MAX_REGS_IN_PROGRESS
+#define UIP_DS6_MAX_REGS_IN_PROGRESS UIP_DS6_CONF_MAX_REGS_IN_PROGRESS
+#else
+#define UIP_DS6_MAX_REGS_IN_PROGRESS 1
+#endif
+
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+/* Multihop DAD transactions a 6LR remembers (DAR sent or DAC received),
+ * so that refreshes of a confirmed registration need no new DAR */
+#ifdef UIP_DS6_CONF_DAD_NB
+#define UIP_DS6_DAD_NB UIP_DS6_CONF_DAD_NB
+#else
+#define UIP_DS6_DAD_NB 4
+#endif
+/* Registrations the 6LBR keeps for the whole 6LoWPAN. A 6LR that has no
+ * 6LBR to talk to checks its registrations against this table itself */
+#ifdef UIP_DS6_CONF_LBR_REG_NB
+#define UIP_DS6_LBR_REG_NB UIP_DS6_CONF_LBR_REG_NB
+#else
+#define UIP_DS6_LBR_REG_NB 16
+#endif
+/* Number of buckets of the 6LBR table hash index, which every DAR looks up */
+#ifdef UIP_DS6_CONF_LBR_REG_HASH_SIZE
+#define UIP_DS6_LBR_REG_HASH_SIZE UIP_DS6_CONF_LBR_REG_HASH_SIZE
+#else
+#define UIP_DS6_LBR_REG_HASH_SIZE 16
+#endif
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
+#if CONF_6LOWPAN_ND_ABRO
+/* Border routers whose ABRO version we track. Hosts only accept prefixes
+ * and contexts from RAs carrying the newest version of their ABRO; routers
+ * advertise an ABRO for each entry */
+#ifdef UIP_DS6_CONF_ABR_NB
+#define UIP_DS6_ABR_NB UIP_DS6_CONF_ABR_NB
+#else
+#define UIP_DS6_ABR_NB 2
+#endif
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
+/* Routers only: registrations (NCEs of registered hosts and the 6LBR table)
+ * are mirrored in a memory-mapped file, with their lifetimes as absolute
+ * deadlines, and adopted again by uip_ds6_init(). A restarting Linux-hosted
+ * 6LBR thus needs no new registration from its hosts. Needs POSIX mmap. */
+#ifdef UIP_DS6_CONF_PERSIST
+#define UIP_DS6_PERSIST UIP_DS6_CONF_PERSIST
+#else
+#define UIP_DS6_PERSIST 0
+#endif
+#ifdef UIP_DS6_CONF_PERSIST_FILE
+#define UIP_DS6_PERSIST_FILE UIP_DS6_CONF_PERSIST_FILE
+#else
+#define UIP_DS6_PERSIST_FILE "uip-ds6.db"
+#endif
+/* To be increased each time the file layout changes */
+#define UIP_DS6_PERSIST_VERSION 1
+
+/* Node instances: the state of the node (DS6 tables and timers, 6LoWPAN
+ * fragmentation) lives in a uip_ds6_instance_t instead of globals, and
+ * uip_ds6_instance points to the current one, so that a simulator can run
+ * many nodes in one process. See uip_ds6_instance_select(). */
+#ifdef UIP_DS6_CONF_INSTANCES
+#define UIP_DS6_INSTANCES UIP_DS6_CONF_INSTANCES
+#else
+#define UIP_DS6_INSTANCES 0
+#endif
+#if UIP_DS6_INSTANCES && UIP_DS6_PERSIST
+#error "UIP_DS6_PERSIST saves the state of a single node"
+#endif
+
+/* Convergence metrics, to benchmark networks of simulated nodes: time to
+ * the first registration, ND messages and bytes sent, registration
+ * refreshes, and time to register again after losing a router.
+ * uip_ds6_conv_json() reports them. Needs snprintf(). */
+#ifdef UIP_DS6_CONF_CONV_STATS
+#define UIP_DS6_CONV_STATS UIP_DS6_CONF_CONV_STATS
+#else
+#define UIP_DS6_CONV_STATS 0
+#endif
+
+/* Trace ring: binary records of the state changes of neighbors,
+ * registrations, default routers and contexts, and of fragment drops,
+ * each with its clock time. The last UIP_DS6_TRACE_SIZE records are kept
+ * and read with uip_ds6_trace_read(). Writers never block, and may be
+ * 6LoWPAN radio threads (SICSLOWPAN_THREADS). */
+#ifdef UIP_DS6_CONF_TRACE
+#define UIP_DS6_TRACE UIP_DS6_CONF_TRACE
+#else
+#define UIP_DS6_TRACE 0
+#endif
+#ifdef UIP_DS6_CONF_TRACE_SIZE
+#define UIP_DS6_TRACE_SIZE UIP_DS6_CONF_TRACE_SIZE
+#else
+#define UIP_DS6_TRACE_SIZE 64
+#endif
+
 
 /*--------------------------------------------------*/
 /** \brief Possible states for the nbr cache entries */
@@ -162,6 +355,17 @@
 #define  REG_TENTATIVE 1
 #define  REG_REGISTERED 2
 #define  REG_TO_BE_UNREGISTERED 3 /* Auxiliar registration entry state */
+/* Not an ARO status: the registration waits for the DAC of the 6LBR */
+#define  REG_STATUS_PENDING 0xFF
+
+/** \brief Possible states for a multihop DAD transaction */
+#define  DAD_PENDING 0
+#define  DAD_CONFIRMED 1
+
+/** \brief Pending change of a context advertised by a router */
+#define  CONTEXT_STABLE 0
+#define  CONTEXT_TO_COMPRESS 1
+#define  CONTEXT_TO_REMOVE 2
 
 
 #define  NBR_INCOMPLETE 0
@@ -181,29 +385,106 @@
 #define  ADDR_MANUAL 3
 
 /** \brief General DS6 definitions */
-#define UIP_DS6_PERIOD   (CLOCK_SECOND/10)  /** Period for uip-ds6 periodic task*/
+#define UIP_DS6_PERIOD   (CLOCK_SECOND/10)  /** Minimum period for uip-ds6 periodic task*/
+/* uip_ds6_periodic() is not run at a fixed rate: it re-arms its timer for
+ * the earliest pending deadline found in the data structures. This is the
+ * longest time we ever sleep; later deadlines are just recomputed on wakeup.
+ * Keep it below the clock_time_t range of the platform. */
+#ifdef UIP_DS6_CONF_MAX_PERIOD
+#define UIP_DS6_MAX_PERIOD UIP_DS6_CONF_MAX_PERIOD
+#else
+#define UIP_DS6_MAX_PERIOD (60 * CLOCK_SECOND)
+#endif
 #define FOUND 0
 #define FREESPACE 1
 #define NOSPACE 2
 
+/* ND transmit scheduler. The registration NSs, NUD probes and RSs that
+ * uip_ds6_periodic() finds due are sent under the control of a token bucket
+ * of UIP_DS6_ND_TX_BURST tokens, refilled at UIP_DS6_ND_TX_RATE tokens per
+ * second. Each class has its own queue (of UIP_DS6_ND_TX_QUEUE_LEN entries),
+ * and queues are served round-robin so that no class starves the others. */
+#ifdef UIP_DS6_CONF_ND_TX_RATE
+#define UIP_DS6_ND_TX_RATE UIP_DS6_CONF_ND_TX_RATE
+#else
+#define UIP_DS6_ND_TX_RATE 10
+#endif
+#ifdef UIP_DS6_CONF_ND_TX_BURST
+#define UIP_DS6_ND_TX_BURST UIP_DS6_CONF_ND_TX_BURST
+#else
+#define UIP_DS6_ND_TX_BURST 3
+#endif
+#ifdef UIP_DS6_CONF_ND_TX_QUEUE_LEN
+#define UIP_DS6_ND_TX_QUEUE_LEN UIP_DS6_CONF_ND_TX_QUEUE_LEN
+#else
+#define UIP_DS6_ND_TX_QUEUE_LEN 4
+#endif
+/** \brief ND transmit classes */
+#define UIP_DS6_ND_TX_REG 0
+#define UIP_DS6_ND_TX_NUD 1
+#define UIP_DS6_ND_TX_RS 2
+#define UIP_DS6_ND_TX_RA 3
+#define UIP_DS6_ND_TX_CLASSES 4
+
+/* Solicited RAs. RSs received within UIP_ND6_MAX_RA_DELAY_TIME_MS of each
+ * other are answered together. Up to UIP_DS6_RA_SOLICITED_NB hosts are
+ * answered by unicast, beyond that (or for a RS from an unspecified
+ * address) a single multicast RA is sent, no sooner than
+ * UIP_ND6_MIN_DELAY_BETWEEN_RAS after the previous one. */
+#ifdef UIP_DS6_CONF_RA_SOLICITED_NB
+#define UIP_DS6_RA_SOLICITED_NB UIP_DS6_CONF_RA_SOLICITED_NB
+#else
+#define UIP_DS6_RA_SOLICITED_NB 4
+#endif
+#define UIP_DS6_RA_SOLICITED_MCAST 0xFF
+
 
 /*--------------------------------------------------*/
 /** \brief An entry in the nbr cache */
 typedef struct uip_ds6_nbr {
   u8_t isused;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;  /**< interface the entry belongs to */
+#endif /* UIP_DS6_IF_NB > 1 */
   uip_ipaddr_t ipaddr;
   uip_lladdr_t lladdr;
   struct stimer reachable;
-  clock_time_t last_lookup;
+  u8_t referenced; /**< CLOCK reference bit, set on lookup */
+  /* Ring of the entries CLOCK may evict: unregistered ones on a 6LR, all of
+   * them on a host */
+  struct uip_ds6_nbr *gc_next;
+  struct uip_ds6_nbr *gc_prev;
   struct stimer sendns;
   u8_t nscount;
   u8_t isrouter;
   u8_t state;
+#if UIP_CONF_ROUTER
+  /* 6lowpan-nd registration of the neighbor's address with us (6LR) */
+  u8_t reg_state;
+  struct stimer reg_lifetime;
+  uip_lladdr_t eui64;
+#endif /* UIP_CONF_ROUTER */
+#if UIP_DS6_LINK_ESTIMATOR
+  u16_t etx;     /**< in units of 1/UIP_DS6_LINK_ETX_DIVISOR transmission */
+  int16_t rssi;  /**< UIP_DS6_LINK_RSSI_UNKNOWN until a frame is received */
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_DS6_LINK_NUD
+  u8_t noack;    /**< unicast frames in a row the neighbor did not ack */
+#endif /* UIP_DS6_LINK_NUD */
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  /* Next entry in the same hash bucket, or in the free list */
+  struct uip_ds6_nbr *hash_next;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
 } uip_ds6_nbr_t;
 
+struct uip_ds6_reg;
+
 /** \brief An entry in the default router list */
 typedef struct uip_ds6_defrt {
   u8_t isused;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;  /**< interface the entry belongs to */
+#endif /* UIP_DS6_IF_NB > 1 */
   uip_ipaddr_t ipaddr;
   struct stimer lifetime;
   u8_t isinfinite;
@@ -213,12 +494,17 @@ typedef struct uip_ds6_defrt {
   u8_t rscount;
   /* The number of registrations with a router */
   u8_t registrations;
+  /* Registrations with this router, linked through defrt_next */
+  struct uip_ds6_reg *reg_list;
 } uip_ds6_defrt_t;
 
 /** \brief A prefix list entry */
 #if UIP_CONF_ROUTER
 typedef struct uip_ds6_prefix {
   u8_t isused;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;  /**< interface the entry belongs to */
+#endif /* UIP_DS6_IF_NB > 1 */
   uip_ipaddr_t ipaddr;
   u8_t length;
   u8_t advertise;
@@ -229,6 +515,9 @@ typedef struct uip_ds6_prefix {
 #else /* UIP_CONF_ROUTER */
 typedef struct uip_ds6_prefix {
   u8_t isused;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;  /**< interface the entry belongs to */
+#endif /* UIP_DS6_IF_NB > 1 */
   uip_ipaddr_t ipaddr;
   u8_t length;
   struct stimer vlifetime;
@@ -248,6 +537,8 @@ typedef struct uip_ds6_addr {
   struct stimer vlifetime;
   /* The router that announced the prefix of this address */
   uip_ds6_defrt_t* defrt;
+  /* Registrations of this address, linked through addr_next */
+  struct uip_ds6_reg *reg_list;
 } uip_ds6_addr_t;
 
 /** \brief Anycast address  */
@@ -271,6 +562,11 @@ typedef struct uip_ds6_reg {
   struct stimer reg_lifetime;
   struct timer registration_timer;
   u8_t reg_count;
+  /* Set while a NS with ARO for this registration waits for the NA */
+  u8_t in_progress;
+  /* Next registration with the same router / of the same address */
+  struct uip_ds6_reg *defrt_next;
+  struct uip_ds6_reg *addr_next;
 } uip_ds6_reg_t;
 
 #if CONF_6LOWPAN_ND_6CO
@@ -286,6 +582,11 @@ typedef enum uip_ds6_context_state {
 } uip_ds6_context_state_t;
  
 typedef struct uip_ds6_addr_context {
+#if defined(SICSLOWPAN_CONF_THREADS) && SICSLOWPAN_CONF_THREADS
+  /* Odd while state, length or prefix are being written, see
+   * uip_ds6_context_read() */
+  u32_t seq;
+#endif /* SICSLOWPAN_CONF_THREADS */
   uip_ds6_context_state_t state;
   u8_t length;
   u8_t context_id;
@@ -300,7 +601,36 @@ typedef struct uip_ds6_addr_context {
    * need to keep the default router lifetime. Moreover, we can not use the
    * corresponding value in "defrt" because that router may have been deleted */
   u16_t defrt_lifetime;
+#if UIP_CONF_ROUTER
+  /* The contexts a router advertises have no deadline, vlifetime times the
+   * pending change instead */
+  u16_t lifetime; /**< advertised valid lifetime, in units of 60 seconds */
+  u8_t pending;
+#endif /* UIP_CONF_ROUTER */
 } uip_ds6_addr_context_t;
+
+/* With SICSLOWPAN_CONF_THREADS, radio threads decompress with contexts the
+ * IP thread changes. The IP thread writes state, length and prefix between
+ * UIP_DS6_CONTEXT_WRITE_BEGIN() and UIP_DS6_CONTEXT_WRITE_END(), which make
+ * seq odd then even again; radio threads take a copy with
+ * uip_ds6_context_read() and retry if seq changed meanwhile (seqlock).
+ * UIP_DS6_CONTEXT_SET_STATE() writes the state alone. */
+#if defined(SICSLOWPAN_CONF_THREADS) && SICSLOWPAN_CONF_THREADS
+#define UIP_DS6_CONTEXT_WRITE_BEGIN(c) do { \
+    __atomic_store_n(&(c)->seq, (c)->seq + 1, __ATOMIC_RELAXED); \
+    __atomic_thread_fence(__ATOMIC_RELEASE); \
+  } while(0)
+#define UIP_DS6_CONTEXT_WRITE_END(c) \
+  __atomic_store_n(&(c)->seq, (c)->seq + 1, __ATOMIC_RELEASE)
+#else
+#define UIP_DS6_CONTEXT_WRITE_BEGIN(c)
+#define UIP_DS6_CONTEXT_WRITE_END(c)
+#endif
+#define UIP_DS6_CONTEXT_SET_STATE(c, s) do { \
+    UIP_DS6_CONTEXT_WRITE_BEGIN(c); \
+    (c)->state = (s); \
+    UIP_DS6_CONTEXT_WRITE_END(c); \
+  } while(0)
 #endif /* CONF_6LOWPAN_ND_6CO */
 
 /** \brief define some additional RPL related route state and
@@ -328,6 +658,9 @@ typedef struct rpl_route_entry {
 /** \brief An entry in the routing table */
 typedef struct uip_ds6_route {
   u8_t isused;
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;  /**< interface the entry belongs to */
+#endif /* UIP_DS6_IF_NB > 1 */
   uip_ipaddr_t ipaddr;
   u8_t length;
   u8_t metric;
@@ -344,7 +677,17 @@ typedef struct uip_ds6_netif {
   u32_t base_reachable_time; /* in msec */
   u32_t reachable_time;      /* in msec */
   u32_t retrans_timer;       /* in msec */
-  uip_ds6_reg_t* registration_in_progress;
+  u8_t registrations_in_progress;
+#if UIP_DS6_LINK_ESTIMATOR
+  /** The router uip_ds6_defrt_choose() returned last, for hysteresis */
+  uip_ds6_defrt_t *preferred_defrt;
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_CONF_ROUTER && UIP_ND6_SEND_RA
+  struct timer ra_window;    /**< solicited RAs are due when it expires */
+  struct timer ra_mcast;     /**< no multicast RA before it expires */
+  u8_t ra_solicited;         /**< hosts to answer, or UIP_DS6_RA_SOLICITED_MCAST */
+  uip_ipaddr_t ra_dest[UIP_DS6_RA_SOLICITED_NB];
+#endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA */
   uip_ds6_addr_t addr_list[UIP_DS6_ADDR_NB];
 #if UIP_DS6_AADDR_NB > 0 /* Some compilers interpret zero-length vectors as
                             incomplete types */
@@ -353,27 +696,335 @@ typedef struct uip_ds6_netif {
   uip_ds6_maddr_t maddr_list[UIP_DS6_MADDR_NB];
 } uip_ds6_netif_t;
 
+#if CONF_6LOWPAN_ND_ABRO
+/** \brief An authoritative border router (ABRO) */
+typedef struct uip_ds6_abr {
+  u8_t isused;
+  uip_ipaddr_t ipaddr;
+  u32_t version;
+  struct stimer lifetime;
+} uip_ds6_abr_t;
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+/** \brief A multihop DAD transaction of a 6LR, keyed by EUI-64 and address */
+typedef struct uip_ds6_dad {
+  u8_t isused;
+  u8_t state;
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t eui64;
+  /* DAD_PENDING: time before the DAR may be sent again.
+   * DAD_CONFIRMED: registration lifetime granted by the 6LBR */
+  struct stimer timer;
+} uip_ds6_dad_t;
+
+/** \brief A registration in the 6LBR table */
+typedef struct uip_ds6_lbr_reg {
+  u8_t isused;
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t eui64;
+  struct stimer lifetime;
+  /* Next entry in its hash bucket, or in the free list */
+  struct uip_ds6_lbr_reg *hash_next;
+} uip_ds6_lbr_reg_t;
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
+/** \brief ND transmit scheduler counters, per class */
+typedef struct uip_ds6_nd_tx_stats {
+  u8_t depth[UIP_DS6_ND_TX_CLASSES];     /**< entries left queued by the last run */
+  u16_t sent[UIP_DS6_ND_TX_CLASSES];     /**< messages sent */
+  u16_t deferred[UIP_DS6_ND_TX_CLASSES]; /**< runs that left due messages for a later one */
+} uip_ds6_nd_tx_stats_t;
+
+#if !UIP_CONF_ROUTER
+/** \brief Router discovery counters, to measure convergence */
+typedef struct uip_ds6_rs_stats {
+  u16_t rs_mcast;      /**< multicast RSs sent */
+  u16_t rs_ucast;      /**< unicast RSs sent */
+  u16_t rs_suppressed; /**< multicast RSs not sent, as a RA was overheard */
+  u16_t ra_received;   /**< RAs received */
+} uip_ds6_rs_stats_t;
+#endif /* !UIP_CONF_ROUTER */
+
+#if UIP_DS6_TRACE
+/** \brief Trace events. id is the index of the entry in its table, arg its
+ * new state (nbr, reg, context) */
+#define UIP_DS6_TRACE_NBR_STATE     1
+#define UIP_DS6_TRACE_NBR_RM        2
+#define UIP_DS6_TRACE_REG_STATE     3
+#define UIP_DS6_TRACE_REG_RM        4
+#define UIP_DS6_TRACE_DEFRT_ADD     5
+#define UIP_DS6_TRACE_DEFRT_RM      6
+#define UIP_DS6_TRACE_CONTEXT_STATE 7 /* id: context id */
+#define UIP_DS6_TRACE_FRAG_DROPPED  8 /* id: datagram tag, arg: reason */
+/** \brief Reasons of UIP_DS6_TRACE_FRAG_DROPPED */
+#define UIP_DS6_TRACE_FRAG_TIMEOUT   0 /* reassembly timed out */
+#define UIP_DS6_TRACE_FRAG_MISMATCH  1 /* not part of the datagram being reassembled */
+#define UIP_DS6_TRACE_FRAG_TRUNCATED 2 /* headers longer than the frame */
+#define UIP_DS6_TRACE_FRAG_NOBUF     3 /* no queuebuf to send a fragment */
+#define UIP_DS6_TRACE_FRAG_RING_FULL 4 /* radio thread to IP layer ring full */
+
+/** \brief A trace record */
+typedef struct uip_ds6_trace_rec {
+  u32_t seq;   /**< number of the record + 1, 0 while it is written */
+  u32_t time;  /**< clock_time() */
+  u16_t id;
+  u8_t event;
+  u8_t arg;
+} uip_ds6_trace_rec_t;
+#endif /* UIP_DS6_TRACE */
+
+#if UIP_DS6_CONV_STATS
+/** \brief An address the loss of a router left without registration */
+typedef struct uip_ds6_conv_lost {
+  uip_ds6_addr_t *addr;       /**< NULL if the entry is free */
+  uip_ipaddr_t defrt;         /**< the router it was registered with */
+} uip_ds6_conv_lost_t;
+
+/** \brief Convergence metrics. Times are in clock ticks since uip_ds6_init() */
+typedef struct uip_ds6_conv_stats {
+  clock_time_t start;         /**< clock_time() at uip_ds6_init() */
+  clock_time_t first_reg;     /**< first successful registration */
+  clock_time_t lost;          /**< when lost_addr last became non empty */
+  clock_time_t recovery_last; /**< time until all of lost_addr registered again */
+  clock_time_t recovery_max;
+  uip_ds6_conv_lost_t lost_addr[UIP_DS6_ADDR_NB];
+  u8_t registered;            /**< first_reg is set */
+  u8_t recovering;            /**< entries of lost_addr in use */
+  u16_t losses;               /**< routers lost while registered with them */
+  u32_t refreshes;            /**< registrations renewed */
+  uip_nd6_count_t tx[UIP_ND6_STATS_TYPES]; /**< by UIP_ND6_STATS_* kind */
+} uip_ds6_conv_stats_t;
+#endif /* UIP_DS6_CONV_STATS */
+
 /** \brief Generic type for a DS6, to use a common loop though all DS */
 typedef struct uip_ds6_element {
   u8_t isused;
   uip_ipaddr_t ipaddr;
 } uip_ds6_element_t;
 
+#if UIP_DS6_IF_NB > 1
+/** \brief Generic type for a DS6 whose entries belong to an interface */
+typedef struct uip_ds6_if_element {
+  u8_t isused;
+  u8_t ifindex;
+  uip_ipaddr_t ipaddr;
+} uip_ds6_if_element_t;
+
+/* uip_ds6_if is the current interface: the one the packet being processed
+ * was received on or is sent on, or the one uip_ds6_periodic() processes */
+#define uip_ds6_if (uip_ds6_if_list[uip_ds6_if_index])
+#define uip_ds6_if_select(i) (uip_ds6_if_index = (i))
+#define UIP_DS6_IF_SET(e) ((e)->ifindex = uip_ds6_if_index)
+#define UIP_DS6_IF_MATCH(e) ((e)->ifindex == uip_ds6_if_index)
+/* The interface entry e belongs to, whichever is current */
+#define UIP_DS6_IF_OF(e) (uip_ds6_if_list[(e)->ifindex])
+#else /* UIP_DS6_IF_NB > 1 */
+#define uip_ds6_if_select(i)
+#define UIP_DS6_IF_SET(e)
+#define UIP_DS6_IF_MATCH(e) 1
+#define UIP_DS6_IF_OF(e) uip_ds6_if
+#endif /* UIP_DS6_IF_NB > 1 */
+
+
+#if UIP_DS6_QUEUE_NB > 0
+#include "net/uip-packetqueue.h"
+
+/** \brief A packet waiting for its next hop, see uip_ds6_queue_add() */
+typedef struct uip_ds6_queue {
+  struct uip_packetqueue_handle handle;
+  uip_ipaddr_t nexthop; /**< unspecified: any default router */
+#if UIP_DS6_IF_NB > 1
+  u8_t ifindex;
+#endif /* UIP_DS6_IF_NB > 1 */
+} uip_ds6_queue_t;
+#endif /* UIP_DS6_QUEUE_NB > 0 */
 
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_INSTANCES
+#include "sys/etimer.h"
+#include "net/rime.h"
+
+/**
+ * \brief The state of a node.
+ *
+ * The first fields are the DS6 globals, which are macros for the fields of
+ * the current instance: code using uip_ds6_nbr_cache, uip_ds6_if, ... is
+ * the same with and without instances. Then come the private state of
+ * uip-ds6.c and of sicslowpan.c, used the same way there. What only lives
+ * for the processing of one packet or one uip_ds6_periodic() invocation,
+ * uip_buf included, is shared by all the instances.
+ */
+typedef struct uip_ds6_instance {
+  struct uip_ds6_instance *next; /**< instances uip_ds6_init() has seen */
+  uip_lladdr_t lladdr;           /**< link layer address of the node */
+#if UIP_DS6_IF_NB > 1
+  uip_ds6_netif_t if_list[UIP_DS6_IF_NB];
+  u8_t if_index;
+#else /* UIP_DS6_IF_NB > 1 */
+  uip_ds6_netif_t netif;
+#endif /* UIP_DS6_IF_NB > 1 */
+  uip_ds6_nbr_t nbr_cache[UIP_DS6_NBR_NB];
+  uip_ds6_reg_t reg_list[UIP_DS6_REG_LIST_SIZE];
+#if CONF_6LOWPAN_ND_6CO
+  uip_ds6_addr_context_t addr_context_table[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+#endif /* CONF_6LOWPAN_ND_6CO */
+  uip_ds6_defrt_t defrt_list[UIP_DS6_DEFRT_NB];
+#if CONF_6LOWPAN_ND_ABRO
+  uip_ds6_abr_t abr_list[UIP_DS6_ABR_NB];
+#endif /* CONF_6LOWPAN_ND_ABRO */
+  uip_ds6_prefix_t prefix_list[UIP_DS6_PREFIX_NB];
+  uip_ds6_route_t routing_table[UIP_DS6_ROUTE_NB];
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+  uip_ds6_dad_t dad_cache[UIP_DS6_DAD_NB];
+  uip_ds6_lbr_reg_t lbr_reg_table[UIP_DS6_LBR_REG_NB];
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+  struct etimer timer_periodic;
+  uip_ds6_nd_tx_stats_t nd_tx_stats;
+#if UIP_CONF_ROUTER
+  struct stimer timer_ra;
+#else /* UIP_CONF_ROUTER */
+  struct timer timer_rs;
+  u8_t rscount;
+  uip_ds6_rs_stats_t rs_stats;
+#endif /* UIP_CONF_ROUTER */
+#if UIP_DS6_CONV_STATS
+  uip_ds6_conv_stats_t conv_stats;
+#endif /* UIP_DS6_CONV_STATS */
+#if UIP_ND6_STATS
+  uip_nd6_stats_t nd6_stats;
+#endif /* UIP_ND6_STATS */
+
+  /* uip-ds6.c */
+#if UIP_CONF_ROUTER && UIP_ND6_SEND_RA
+#if UIP_ND6_RA_TRICKLE
+  u16_t trickle_i;
+  u16_t trickle_rest;
+  u8_t trickle_c;
+  u8_t trickle_sent;
+#else /* UIP_ND6_RA_TRICKLE */
+  u8_t racount;
+  u16_t rand_time;
+#endif /* UIP_ND6_RA_TRICKLE */
+#endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA */
+#if !UIP_CONF_ROUTER
+  struct timer rs_suppress;
+#endif /* !UIP_CONF_ROUTER */
+  u8_t nd_tx_tokens;
+  clock_time_t nd_tx_refill_time;
+  u8_t nd_tx_rr;
+  u16_t nd_tx_start[UIP_DS6_ND_TX_CLASSES];
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+  uip_ipaddr_t lbr_ipaddr;
+  uip_ds6_lbr_reg_t *lbr_reg_hash[UIP_DS6_LBR_REG_HASH_SIZE];
+  uip_ds6_lbr_reg_t *lbr_reg_free;
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+#if UIP_DS6_QUEUE_NB > 0
+  uip_ds6_queue_t queue[UIP_DS6_QUEUE_NB];
+  u8_t queue_changed;
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+  uip_ds6_nbr_t *nbr_hand;
+  u16_t nbr_gc_nb;
+#if UIP_DS6_NBR_HASH_SIZE > 0
+  uip_ds6_nbr_t *nbr_hash[UIP_DS6_NBR_HASH_SIZE];
+  uip_ds6_nbr_t *nbr_free;
+#endif /* UIP_DS6_NBR_HASH_SIZE > 0 */
+
+  /* sicslowpan.c */
+  u16_t lowpan_tag;
+#if SICSLOWPAN_CONF_FRAG
+  uip_buf_t lowpan_buf;
+  u16_t lowpan_len;
+  u16_t lowpan_processed_len;
+  u16_t lowpan_reass_tag;
+  rimeaddr_t lowpan_frag_sender;
+  struct timer lowpan_reass_timer;
+#endif /* SICSLOWPAN_CONF_FRAG */
+} uip_ds6_instance_t;
+
+/** \brief The current instance */
+extern uip_ds6_instance_t *uip_ds6_instance;
+
+#if UIP_DS6_IF_NB > 1
+#define uip_ds6_if_list (uip_ds6_instance->if_list)
+#define uip_ds6_if_index (uip_ds6_instance->if_index)
+#else /* UIP_DS6_IF_NB > 1 */
+#define uip_ds6_if (uip_ds6_instance->netif)
+#endif /* UIP_DS6_IF_NB > 1 */
+#define uip_ds6_nbr_cache (uip_ds6_instance->nbr_cache)
+#define uip_ds6_reg_list (uip_ds6_instance->reg_list)
+#define uip_ds6_addr_context_table (uip_ds6_instance->addr_context_table)
+#define uip_ds6_defrt_list (uip_ds6_instance->defrt_list)
+#define uip_ds6_abr_list (uip_ds6_instance->abr_list)
+#define uip_ds6_prefix_list (uip_ds6_instance->prefix_list)
+#define uip_ds6_routing_table (uip_ds6_instance->routing_table)
+#define uip_ds6_dad_cache (uip_ds6_instance->dad_cache)
+#define uip_ds6_lbr_reg_table (uip_ds6_instance->lbr_reg_table)
+#define uip_ds6_timer_periodic (uip_ds6_instance->timer_periodic)
+#define uip_ds6_nd_tx_stats (uip_ds6_instance->nd_tx_stats)
+#define uip_ds6_timer_ra (uip_ds6_instance->timer_ra)
+#define uip_ds6_timer_rs (uip_ds6_instance->timer_rs)
+#define uip_ds6_rscount (uip_ds6_instance->rscount)
+#define uip_ds6_rs_stats (uip_ds6_instance->rs_stats)
+#define uip_ds6_conv_stats (uip_ds6_instance->conv_stats)
+#define uip_nd6_stats (uip_ds6_instance->nd6_stats)
+
+/**
+ * \brief Make inst the current instance: the one the next calls into the
+ * stack (uip_ds6_init(), tcpip_input(), uip_ds6_periodic(), ...) work on.
+ * Also sets uip_lladdr and rimeaddr_node_addr to the address of the node.
+ *
+ * A new instance is zeroed, its lladdr set, then selected and initialized
+ * with uip_ds6_init(). The periodic timer of each instance is an etimer of
+ * the tcpip process, which selects the instance when it expires. A
+ * discrete-event driver not running the Contiki scheduler can instead read
+ * the deadline of the node with etimer_expiration_time(&uip_ds6_timer_periodic)
+ * and call uip_ds6_periodic() itself.
+ */
+void uip_ds6_instance_select(uip_ds6_instance_t *inst);
+
+/**
+ * \brief If timer is the periodic timer of an instance, select it.
+ * \return 1 if an instance was selected, 0 otherwise
+ */
+u8_t uip_ds6_instance_timer(void *timer);
+
+#else /* UIP_DS6_INSTANCES */
+#if UIP_DS6_IF_NB > 1
+extern uip_ds6_netif_t uip_ds6_if_list[UIP_DS6_IF_NB];
+extern u8_t uip_ds6_if_index;
+#else /* UIP_DS6_IF_NB > 1 */
 extern uip_ds6_netif_t uip_ds6_if;
+#endif /* UIP_DS6_IF_NB > 1 */
+extern uip_ds6_nbr_t uip_ds6_nbr_cache[UIP_DS6_NBR_NB];
+extern uip_ds6_reg_t uip_ds6_reg_list[UIP_DS6_REG_LIST_SIZE];
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+extern uip_ds6_lbr_reg_t uip_ds6_lbr_reg_table[UIP_DS6_LBR_REG_NB];
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
 extern struct etimer uip_ds6_timer_periodic;
+extern uip_ds6_nd_tx_stats_t uip_ds6_nd_tx_stats;
 extern uip_ds6_defrt_t uip_ds6_defrt_list[UIP_DS6_DEFRT_NB];
+#if CONF_6LOWPAN_ND_ABRO
+extern uip_ds6_abr_t uip_ds6_abr_list[UIP_DS6_ABR_NB];
+#endif /* CONF_6LOWPAN_ND_ABRO */
 #if CONF_6LOWPAN_ND_6CO & SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-extern uip_ds6_addr_context_t uip_ds6_addr_context_list[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+extern uip_ds6_addr_context_t uip_ds6_addr_context_table[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
 #endif /* CONF_6LOWPAN_ND_6CO & SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 
 #if UIP_CONF_ROUTER
 extern uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];
 #else /* UIP_CONF_ROUTER */
 extern struct timer uip_ds6_timer_rs;
-extern u8_t rscount;
+extern u8_t uip_ds6_rscount;
+extern uip_ds6_rs_stats_t uip_ds6_rs_stats;
 #endif /* UIP_CONF_ROUTER */
+#if UIP_DS6_CONV_STATS
+extern uip_ds6_conv_stats_t uip_ds6_conv_stats;
+#endif /* UIP_DS6_CONV_STATS */
+#if UIP_ND6_STATS
+extern uip_nd6_stats_t uip_nd6_stats;
+#endif /* UIP_ND6_STATS */
+#endif /* UIP_DS6_INSTANCES */
 
 
 /*---------------------------------------------------------------------------*/
@@ -383,12 +1034,32 @@ void uip_ds6_init(void);
 /** \brief Periodic processing of data structures */
 void uip_ds6_periodic(void);
 
+/** \brief Make sure uip_ds6_periodic() runs at most ticks from now. To be
+ * called whenever a state change creates a deadline earlier than the one the
+ * periodic timer is armed for */
+void uip_ds6_reschedule(clock_time_t ticks);
+
 /** \brief Generic loop routine on an abstract data structure, which generalizes
  * all data structures used in DS6 */
-u8_t uip_ds6_list_loop(uip_ds6_element_t *list, u8_t size,
+u8_t uip_ds6_list_loop(uip_ds6_element_t *list, u16_t size,
                           u16_t elementsize, uip_ipaddr_t *ipaddr,
                           u8_t ipaddrlen,
                           uip_ds6_element_t **out_element);
+#if UIP_DS6_IF_NB > 1
+/** \brief Same as uip_ds6_list_loop(), on a list of uip_ds6_if_element_t:
+ * the entries of other interfaces are neither found nor free */
+u8_t uip_ds6_if_list_loop(uip_ds6_element_t *list, u16_t size,
+                          u16_t elementsize, uip_ipaddr_t *ipaddr,
+                          u8_t ipaddrlen,
+                          uip_ds6_element_t **out_element);
+/**
+ * \brief Set the output function of interface ifindex. tcpip_output()
+ * calls the one of the current interface.
+ */
+void tcpip_if_set_outputfunc(u8_t ifindex, u8_t (*f)(uip_lladdr_t *));
+#else /* UIP_DS6_IF_NB > 1 */
+#define uip_ds6_if_list_loop uip_ds6_list_loop
+#endif /* UIP_DS6_IF_NB > 1 */
 
 /** \name Neighbor Cache basic routines */
 /** @{ */
@@ -396,6 +1067,126 @@ uip_ds6_nbr_t *uip_ds6_nbr_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
                                u8_t isrouter, u8_t state);
 void uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr);
 uip_ds6_nbr_t *uip_ds6_nbr_lookup(uip_ipaddr_t *ipaddr);
+#if UIP_CONF_ROUTER
+/** \brief Set the registration state of nbr (6LR). Only unregistered
+ * entries may be evicted to make room in the cache */
+void uip_ds6_nbr_set_reg_state(uip_ds6_nbr_t *nbr, u8_t state);
+#endif /* UIP_CONF_ROUTER */
+/**
+ * \brief Upper-layer reachability confirmation (RFC 4861 7.3.1): traffic to
+ * peer makes forward progress, e.g. a TCP ACK for new data or a UDP reply
+ * was received. The NCE of the next hop to peer becomes REACHABLE again,
+ * so that it is not probed. With UIP_DS6_DEFRT_FLOW_HASH, src and flow (as
+ * hashed by tcpip_ipv6_output()) tell which router the traffic went
+ * through; they are unused otherwise.
+ */
+void uip_ds6_reachability_confirm(uip_ipaddr_t *src, uip_ipaddr_t *peer,
+                                  u32_t flow);
+#if UIP_DS6_QUEUE_NB > 0
+/**
+ * \brief Hold the packet in uip_buf until nexthop can be resolved. A NULL
+ * nexthop waits for any default router.
+ */
+void uip_ds6_queue_add(uip_ipaddr_t *nexthop);
+/**
+ * \brief Hold the packet in uip_buf if nbr can not take it yet: while its
+ * reachability is probed, or while the source address is being registered
+ * with it. \return 1 if the packet was queued
+ */
+u8_t uip_ds6_queue_hold(uip_ds6_nbr_t *nbr);
+/** \brief Something may now resolve: look at the queue on the next run */
+void uip_ds6_queue_wakeup(void);
+#define UIP_DS6_QUEUE_WAKEUP() uip_ds6_queue_wakeup()
+#else /* UIP_DS6_QUEUE_NB > 0 */
+#define UIP_DS6_QUEUE_WAKEUP()
+#endif /* UIP_DS6_QUEUE_NB > 0 */
+
+#if UIP_DS6_TRACE
+/** \brief Add a record to the trace ring */
+void uip_ds6_trace(u8_t event, u16_t id, u8_t arg);
+/**
+ * \brief Copy up to max trace records to out, oldest first. *cursor counts
+ * the records the reader went past: start from 0, each call advances it.
+ * Records overwritten before they were read are skipped.
+ * \return the number of records copied
+ */
+u16_t uip_ds6_trace_read(uip_ds6_trace_rec_t *out, u16_t max, u32_t *cursor);
+#define UIP_DS6_TRACE_NBR(n) \
+  uip_ds6_trace(UIP_DS6_TRACE_NBR_STATE, (n) - uip_ds6_nbr_cache, (n)->state)
+#define UIP_DS6_TRACE_REG(r) \
+  uip_ds6_trace(UIP_DS6_TRACE_REG_STATE, (r) - uip_ds6_reg_list, (r)->state)
+#define UIP_DS6_TRACE_CONTEXT(c) \
+  uip_ds6_trace(UIP_DS6_TRACE_CONTEXT_STATE, (c)->context_id, (c)->state)
+#define UIP_DS6_TRACE_FRAG_DROP(tag, reason) \
+  uip_ds6_trace(UIP_DS6_TRACE_FRAG_DROPPED, (tag), (reason))
+#else /* UIP_DS6_TRACE */
+#define UIP_DS6_TRACE_NBR(n)
+#define UIP_DS6_TRACE_REG(r)
+#define UIP_DS6_TRACE_CONTEXT(c)
+#define UIP_DS6_TRACE_FRAG_DROP(tag, reason)
+#endif /* UIP_DS6_TRACE */
+
+#if UIP_DS6_CONV_STATS
+/** \brief Account for a ND message of UIP_ND6_STATS_* kind, len bytes
+ * long, sent */
+void uip_ds6_conv_sent(u8_t kind, u16_t len);
+/** \brief A registration of addr succeeded. refresh: it renewed one in
+ * place. Recovery from the loss of a router ends when every address that
+ * lost its registration with it has registered again */
+void uip_ds6_conv_registered(uip_ds6_addr_t *addr, u8_t refresh);
+/**
+ * \brief Write the convergence metrics of the node in buf, as a JSON
+ * object, for a benchmark driver to collect. As snprintf(), returns the
+ * length the object needs.
+ */
+int uip_ds6_conv_json(char *buf, int size);
+#define UIP_DS6_CONV_REGISTERED(addr, refresh) \
+  uip_ds6_conv_registered(addr, refresh)
+#else /* UIP_DS6_CONV_STATS */
+#define UIP_DS6_CONV_REGISTERED(addr, refresh)
+#endif /* UIP_DS6_CONV_STATS */
+#if UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD
+uip_ds6_nbr_t *uip_ds6_nbr_ll_lookup(uip_lladdr_t *lladdr);
+/** \brief Account for the outcome of a unicast transmission to lladdr */
+void uip_ds6_link_sent(uip_lladdr_t *lladdr, u8_t acked, u8_t transmissions);
+#endif /* UIP_DS6_LINK_ESTIMATOR || UIP_DS6_LINK_NUD */
+#if UIP_DS6_LINK_ESTIMATOR
+/** \brief Account for a frame received from lladdr */
+void uip_ds6_link_received(uip_lladdr_t *lladdr, int16_t rssi);
+#endif /* UIP_DS6_LINK_ESTIMATOR */
+#if UIP_CONF_ROUTER
+u8_t uip_ds6_nbr_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
+                          uip_lladdr_t *eui64, u16_t lifetime, u8_t state);
+#endif /* UIP_CONF_ROUTER */
+
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+/** \name Multihop DAD routines */
+/** @{ */
+void uip_ds6_set_lbr(uip_ipaddr_t *ipaddr);
+u8_t uip_ds6_dad_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
+                          uip_lladdr_t *eui64, u16_t lifetime);
+u8_t uip_ds6_dad_complete(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64,
+                          u8_t status, u16_t lifetime);
+u8_t uip_ds6_lbr_register(uip_ipaddr_t *ipaddr, uip_lladdr_t *eui64,
+                          u16_t lifetime);
+uip_ds6_lbr_reg_t *uip_ds6_lbr_reg_add(uip_ipaddr_t *ipaddr,
+                                       uip_lladdr_t *eui64);
+/** @} */
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
+#if UIP_CONF_ROUTER && UIP_DS6_PERSIST
+/** \name Persistent registrations (uip-ds6-persist.c) */
+/** @{ */
+/** \brief Map the file and adopt the registrations it holds */
+void uip_ds6_persist_init(void);
+/** \brief Save the registration state of a NCE */
+void uip_ds6_persist_nbr(uip_ds6_nbr_t *nbr);
+#if UIP_ND6_MULTIHOP_DAD
+/** \brief Save an entry of the 6LBR table */
+void uip_ds6_persist_lbr(uip_ds6_lbr_reg_t *reg);
+#endif /* UIP_ND6_MULTIHOP_DAD */
+/** @} */
+#endif /* UIP_CONF_ROUTER && UIP_DS6_PERSIST */
 
 /** \name 6lowpan-nd registration basic routines */
 /** @{ */
@@ -405,6 +1196,7 @@ void uip_ds6_reg_rm(uip_ds6_reg_t* reg);
 uip_ds6_reg_t *uip_ds6_reg_lookup(uip_ds6_addr_t* addr, uip_ds6_defrt_t* defrt);
 void uip_ds6_reg_cleanup_defrt(uip_ds6_defrt_t* defrt);
 void uip_ds6_reg_cleanup_addr(uip_ds6_addr_t* addr);
+void uip_ds6_reg_done(uip_ds6_reg_t* reg);
 /** @} */
 
 /** \name Default router list basic routines */
@@ -421,14 +1213,39 @@ uip_ds6_addr_context_t *uip_ds6_context_add(uip_nd6_opt_6co *context_option,
 void uip_ds6_context_rm(uip_ds6_addr_context_t *context);
 uip_ds6_addr_context_t *uip_ds6_context_lookup_by_id(u8_t context_id);
 uip_ds6_addr_context_t *uip_ds6_context_lookup_by_prefix(uip_ipaddr_t *prefix);
+#if defined(SICSLOWPAN_CONF_THREADS) && SICSLOWPAN_CONF_THREADS
+/** \brief Radio threads: copy the context with id context_id into copy.
+ * Returns copy, or NULL if the context is not in use */
+uip_ds6_addr_context_t *uip_ds6_context_read(u8_t context_id,
+                                             uip_ds6_addr_context_t *copy);
+#endif /* SICSLOWPAN_CONF_THREADS */
+#if UIP_CONF_ROUTER
+uip_ds6_addr_context_t *uip_ds6_context_set(u8_t context_id,
+                                            uip_ipaddr_t *prefix, u8_t length,
+                                            u16_t lifetime, u8_t compress);
+void uip_ds6_context_withdraw(uip_ds6_addr_context_t *context);
+#endif /* UIP_CONF_ROUTER */
 /** @} */
 #endif /* CONF_6LOWPAN_ND_6CO */
 
+#if CONF_6LOWPAN_ND_ABRO
+/** \name Authoritative border router list basic routines */
+/** @{ */
+u8_t uip_ds6_abr_update(uip_ipaddr_t *ipaddr, u32_t version, u16_t lifetime);
+uip_ds6_abr_t *uip_ds6_abr_lookup(uip_ipaddr_t *ipaddr);
+/** @} */
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
 uip_ds6_defrt_t *uip_ds6_defrt_add(uip_ipaddr_t *ipaddr,
                                    unsigned long interval);
 void uip_ds6_defrt_rm(uip_ds6_defrt_t *defrt);
 uip_ds6_defrt_t *uip_ds6_defrt_lookup(uip_ipaddr_t *ipaddr);
 uip_ipaddr_t *uip_ds6_defrt_choose(void);
+#if UIP_DS6_DEFRT_FLOW_HASH
+/** \brief The reachable router src is registered with that wins flow, or
+ * uip_ds6_defrt_choose() if there is none */
+uip_ipaddr_t *uip_ds6_defrt_choose_flow(uip_ipaddr_t *src, u32_t flow);
+#endif /* UIP_DS6_DEFRT_FLOW_HASH */
 
 /** @} */
 
@@ -491,6 +1308,9 @@ void uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop);
 /** \brief set the last 64 bits of an IP address based on the MAC address */
 void uip_ds6_set_addr_iid(uip_ipaddr_t * ipaddr, uip_lladdr_t * lladdr);
 
+/** \brief set a MAC address from the last 64 bits of an IP address */
+void uip_ds6_set_lladdr_from_iid(uip_lladdr_t * lladdr, uip_ipaddr_t * ipaddr);
+
 /** \brief Get the number of matching bits of two addresses */
 u8_t get_match_length(uip_ipaddr_t * src, uip_ipaddr_t * dst);
 /** \brief Source address selection, see RFC 3484 */
@@ -498,15 +1318,30 @@ void uip_ds6_select_src(uip_ipaddr_t * src, uip_ipaddr_t * dst);
 
 #if UIP_CONF_ROUTER
 #if UIP_ND6_SEND_RA
-/** \brief Send a RA as an asnwer to a RS */
-void uip_ds6_send_ra_solicited(void);
+/** \brief Schedule a RA as an answer to a RS from src (NULL if the RA must
+ * be multicast) */
+void uip_ds6_send_ra_solicited(uip_ipaddr_t *src);
 
 /** \brief Send a periodic RA */
 void uip_ds6_send_ra_periodic(void);
+
+#if UIP_ND6_RA_TRICKLE
+/** \brief Restart Trickle from its smallest interval, when what we
+ * advertise changes or a neighbor router advertises something else */
+void uip_ds6_ra_trickle_reset(void);
+
+/** \brief Account for a RA heard from a neighbor router */
+void uip_ds6_ra_trickle_heard(u8_t consistent);
+#endif /* UIP_ND6_RA_TRICKLE */
 #endif /* UIP_ND6_SEND_RA */
 #else /* UIP_CONF_ROUTER */
 /** \brief Trigger start sending RSs */
 void uip_ds6_send_rs(uip_ds6_defrt_t *defrt);
+
+/** \brief A RA from a router was received: a multicast RS due within
+ * UIP_ND6_RTR_SOLICITATION_INTERVAL is suppressed, as the routers in range
+ * are answering */
+void uip_ds6_rs_suppress(void);
 #endif /* UIP_CONF_ROUTER */
 
 /** \brief Compute the reachable time based on base reachable time, see RFC 4861*/
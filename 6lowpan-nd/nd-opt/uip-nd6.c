@@ -74,12 +74,6 @@
 #include "nd-opt/uip-ds6.h"
 #include "lib/random.h"
 
-/*------------------------------------------------------------------*/
-#if UIP_CONF_ROUTER
-//TODO: Implement 6LoWPAN-ND optimizations for 6LRs and/or 6LBRs
-#error 6LoWPAN-ND optimizations not yet supported for routers.
-#endif /* UIP_CONF_ROUTER */
-
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -121,31 +115,165 @@ void uip_log(char *msg);
 #define UIP_ND6_RA_BUF            ((uip_nd6_ra *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 #define UIP_ND6_NS_BUF            ((uip_nd6_ns *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 #define UIP_ND6_NA_BUF            ((uip_nd6_na *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define UIP_ND6_DAR_BUF           ((uip_nd6_dar *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 /** @} */
 /** Pointer to ND option */
 #define UIP_ND6_OPT_HDR_BUF  ((uip_nd6_opt_hdr *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_PREFIX_BUF ((uip_nd6_opt_prefix_info *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_MTU_BUF ((uip_nd6_opt_mtu *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_ABRO_BUF ((uip_nd6_opt_abro *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CO_BUF ((uip_nd6_opt_6co *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 /** @} */
 
-static u8_t nd6_opt_offset;                     /** Offset from the end of the icmpv6 header to the option in uip_buf*/
+static u16_t nd6_opt_offset;                     /** Offset from the end of the icmpv6 header to the option in uip_buf*/
 static u8_t *nd6_opt_llao;   /**  Pointer to llao option in uip_buf */
 static uip_nd6_opt_aro *nd6_opt_aro;   /**  Pointer to aro option in uip_buf */
 #if !UIP_CONF_ROUTER            // TBD see if we move it to ra_input
 static uip_nd6_opt_prefix_info *nd6_opt_prefix_info; /**  Pointer to prefix information option in uip_buf */
 static uip_ipaddr_t ipaddr;
-static uip_ds6_prefix_t *prefix; /**  Pointer to a prefix list entry */
 #endif /* !UIP_CONF_ROUTER */
+static uip_ds6_prefix_t *prefix; /**  Pointer to a prefix list entry */
 #if CONF_6LOWPAN_ND_6CO
 static uip_nd6_opt_6co *nd6_opt_6co; /**  Pointer to a 6lowpan context option in uip_buf */
 static uip_ds6_addr_context_t *context; /**  Pointer to a Context Table entry */
 #endif /* CONF_6LOWPAN_ND_6CO */
+#if CONF_6LOWPAN_ND_ABRO
+static uip_ds6_abr_t *abr; /**  Pointer to an authoritative border router entry */
+#endif /* CONF_6LOWPAN_ND_ABRO */
 static uip_ds6_nbr_t *nbr; /**  Pointer to a nbr cache entry*/
 static uip_ds6_defrt_t *defrt; /**  Pointer to a router list entry */
 static uip_ds6_addr_t *addr; /**  Pointer to an interface address */
 static uip_ds6_reg_t *reg; /**  Pointer to aregistration list entry */
 
 
+#if UIP_ND6_STATS
+#if !UIP_DS6_INSTANCES
+uip_nd6_stats_t uip_nd6_stats;
+#endif /* !UIP_DS6_INSTANCES */
+
+/* count an ARO status we sent or received */
+#define ARO_STAT(dir, status) \
+  (++uip_nd6_stats.dir[(status) < UIP_ND6_STATS_ARO_OTHER ? (status) : \
+                       UIP_ND6_STATS_ARO_OTHER])
+
+/*------------------------------------------------------------------*/
+/* count the ND message of that kind in uip_buf in msg, and its options
+ * in opt */
+static void
+nd6_count(u8_t kind, uip_nd6_count_t *msg, uip_nd6_count_t *opt)
+{
+  static const u8_t hdr_len[UIP_ND6_STATS_TYPES] = {
+    UIP_ND6_RS_LEN, UIP_ND6_RA_LEN, UIP_ND6_NS_LEN, UIP_ND6_NA_LEN,
+    UIP_ND6_DAR_LEN, UIP_ND6_DAR_LEN
+  };
+  u16_t offset;
+  u16_t len;
+
+  if(kind == UIP_ND6_STATS_TYPES) {
+    return;
+  }
+  offset = hdr_len[kind];
+  msg[kind].pkts++;
+  msg[kind].bytes += uip_len;
+
+  while(uip_l3_icmp_hdr_len + offset + UIP_ND6_OPT_HDR_LEN <= uip_len) {
+    len = uip_buf[uip_l2_l3_icmp_hdr_len + offset + UIP_ND6_OPT_LEN_OFFSET] << 3;
+    if(len == 0) {
+      /* Malformed, the input function drops it */
+      return;
+    }
+    switch(uip_buf[uip_l2_l3_icmp_hdr_len + offset + UIP_ND6_OPT_TYPE_OFFSET]) {
+    case UIP_ND6_OPT_ARO:
+      kind = UIP_ND6_STATS_ARO;
+      break;
+    case UIP_ND6_OPT_6CO:
+      kind = UIP_ND6_STATS_6CO;
+      break;
+    case UIP_ND6_OPT_ABRO:
+      kind = UIP_ND6_STATS_ABRO;
+      break;
+    case UIP_ND6_OPT_PREFIX_INFO:
+      kind = UIP_ND6_STATS_PIO;
+      break;
+    default:
+      kind = UIP_ND6_STATS_OPTS;
+      break;
+    }
+    if(kind < UIP_ND6_STATS_OPTS) {
+      opt[kind].pkts++;
+      opt[kind].bytes += len;
+    }
+    offset += len;
+  }
+}
+
+/*------------------------------------------------------------------*/
+void
+uip_nd6_stats_snapshot(uip_nd6_stats_t *s, u8_t reset)
+{
+  memcpy(s, &uip_nd6_stats, sizeof(uip_nd6_stats_t));
+  if(reset) {
+    memset(&uip_nd6_stats, 0, sizeof(uip_nd6_stats_t));
+  }
+}
+#endif /* UIP_ND6_STATS */
+
+#if UIP_ND6_STATS || UIP_DS6_CONV_STATS
+/*------------------------------------------------------------------*/
+/* UIP_ND6_STATS_* kind of the ND message in uip_buf, UIP_ND6_STATS_TYPES
+ * if it is none. Both sets of counters use it, so that they agree */
+static u8_t
+nd6_kind(void)
+{
+  switch(UIP_ICMP_BUF->type) {
+  case ICMP6_RS:
+    return UIP_ND6_STATS_RS;
+  case ICMP6_RA:
+    return UIP_ND6_STATS_RA;
+  case ICMP6_NS:
+    return UIP_ND6_STATS_NS;
+  case ICMP6_NA:
+    return UIP_ND6_STATS_NA;
+  case ICMP6_DAR:
+    return UIP_ND6_STATS_DAR;
+  case ICMP6_DAC:
+    return UIP_ND6_STATS_DAC;
+  default:
+    return UIP_ND6_STATS_TYPES;
+  }
+}
+#endif /* UIP_ND6_STATS || UIP_DS6_CONV_STATS */
+
+/*------------------------------------------------------------------*/
+/* account for the ND message just built in uip_buf */
+static void
+nd6_sent(void)
+{
+#if UIP_ND6_STATS || UIP_DS6_CONV_STATS
+  u8_t kind = nd6_kind();
+#endif /* UIP_ND6_STATS || UIP_DS6_CONV_STATS */
+
+  UIP_STAT(++uip_stat.nd6.sent);
+#if UIP_DS6_CONV_STATS
+  if(kind < UIP_ND6_STATS_TYPES) {
+    uip_ds6_conv_sent(kind, uip_len);
+  }
+#endif /* UIP_DS6_CONV_STATS */
+#if UIP_ND6_STATS
+  nd6_count(kind, uip_nd6_stats.sent, uip_nd6_stats.opt_sent);
+#endif /* UIP_ND6_STATS */
+}
+
+/* account for the ND message received in uip_buf */
+static void
+nd6_recv(void)
+{
+  UIP_STAT(++uip_stat.nd6.recv);
+#if UIP_ND6_STATS
+  nd6_count(nd6_kind(), uip_nd6_stats.recv, uip_nd6_stats.opt_recv);
+#endif /* UIP_ND6_STATS */
+}
+
 /*------------------------------------------------------------------*/
 /* create a llao */ 
 static void
@@ -167,6 +295,65 @@ create_aro(u8_t* aro, u16_t lifetime) {
     ((uip_nd6_opt_aro*)aro)->lifetime = uip_htons(lifetime);
   memcpy(&(((uip_nd6_opt_aro*)aro)->eui64), &uip_lladdr, UIP_LLADDR_LEN);
 }
+
+/* 
+ * create a NA in uip_buf, the caller sets the source and destination
+ * addresses. If eui64 is not NULL, the NA carries an ARO with the
+ * registration status (6LR answering a registration)
+ */
+static void
+create_na(u8_t flags, uip_ipaddr_t *tgt, u8_t status, u16_t lifetime,
+          uip_lladdr_t *eui64)
+{
+  uip_nd6_opt_aro *aro;
+
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
+
+  UIP_ICMP_BUF->type = ICMP6_NA;
+  UIP_ICMP_BUF->icode = 0;
+
+  UIP_ND6_NA_BUF->flagsreserved = flags;
+  memcpy(&UIP_ND6_NA_BUF->tgtipaddr, tgt, sizeof(uip_ipaddr_t));
+
+  create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NA_LEN],
+              UIP_ND6_OPT_TLLAO);
+
+  uip_len =
+    UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
+  if(eui64 != NULL) {
+    aro = (uip_nd6_opt_aro *)&uip_buf[uip_l2_l3_icmp_hdr_len +
+                                     UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN];
+    aro->type = UIP_ND6_OPT_ARO;
+    aro->len = UIP_ND6_OPT_ARO_LEN >> 3;
+    aro->status = status;
+    UIP_ND6_STAT(ARO_STAT(aro_sent, status));
+    aro->reserved1 = 0;
+    aro->reserved2 = 0;
+    aro->lifetime = uip_htons(lifetime);
+    memcpy(&aro->eui64, eui64, UIP_LLADDR_LEN);
+    uip_len += UIP_ND6_OPT_ARO_LEN;
+    UIP_IP_BUF->len[1] += UIP_ND6_OPT_ARO_LEN;
+  }
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  nd6_sent();
+  PRINTF("Sending NA to");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("from");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("with target address");
+  PRINT6ADDR(&UIP_ND6_NA_BUF->tgtipaddr);
+  PRINTF("\n");
+}
 /*------------------------------------------------------------------*/
 
 void
@@ -180,9 +367,16 @@ uip_nd6_ns_input(void)
   PRINTF("with target address");
   PRINT6ADDR((uip_ipaddr_t *) (&UIP_ND6_NS_BUF->tgtipaddr));
   PRINTF("\n");
-  UIP_STAT(++uip_stat.nd6.recv);
+  nd6_recv();
 
   u8_t flags;
+#if UIP_CONF_ROUTER
+  /* ARO to put in the NA, if the NS was a registration */
+  u8_t aro_reply = 0;
+  u8_t aro_status = ARO_STATUS_SUCCESS;
+  u16_t aro_lifetime = 0;
+  uip_lladdr_t aro_eui64;
+#endif /* UIP_CONF_ROUTER */
 
 #if UIP_CONF_IPV6_CHECKS
   if((UIP_IP_BUF->ttl != UIP_ND6_HOP_LIMIT) ||
@@ -195,6 +389,7 @@ uip_nd6_ns_input(void)
 
   /* Options processing */
   nd6_opt_llao = NULL;
+  nd6_opt_aro = NULL;
   nd6_opt_offset = UIP_ND6_NS_LEN;
   while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
 #if UIP_CONF_IPV6_CHECKS
@@ -206,50 +401,112 @@ uip_nd6_ns_input(void)
     switch (UIP_ND6_OPT_HDR_BUF->type) {
     case UIP_ND6_OPT_SLLAO:
       nd6_opt_llao = &uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset];
+      break;
+#if UIP_CONF_ROUTER
+    case UIP_ND6_OPT_ARO:
+      nd6_opt_aro = (uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF;
+      break;
+#endif /* UIP_CONF_ROUTER */
+    default:
+      PRINTF("ND option not supported in NS");
+      break;
+    }
+    nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
+  }
+
+  addr = uip_ds6_addr_lookup(&UIP_ND6_NS_BUF->tgtipaddr);
+
+#if UIP_CONF_ROUTER
+  /* Address registration (I-D.ietf-6lowpan-nd): the host registers its
+   * source address with us, the target of the NS. The ARO is only valid
+   * together with a SLLAO and a specified source address */
+  if((nd6_opt_aro != NULL) && (addr != NULL)) {
+    if((nd6_opt_llao == NULL) || (nd6_opt_aro->len != 2) ||
+       uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+       uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+      PRINTF("NS with ARO received is bad\n");
+      goto discard;
+    }
+    /* The NA overwrites the NS in uip_buf */
+    aro_lifetime = uip_ntohs(nd6_opt_aro->lifetime);
+    memcpy(&aro_eui64, &nd6_opt_aro->eui64, UIP_LLADDR_LEN);
+#if UIP_ND6_MULTIHOP_DAD
+    /* Link-local addresses are formed from the EUI-64, hence unique: only
+     * the other ones need to be checked with the 6LBR */
+    if(!uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) {
+      aro_status = uip_ds6_dad_register(&UIP_IP_BUF->srcipaddr,
+                                        (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                        &aro_eui64, aro_lifetime);
+    } else {
+      aro_status = uip_ds6_nbr_register(&UIP_IP_BUF->srcipaddr,
+                                        (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                        &aro_eui64, aro_lifetime, REG_REGISTERED);
+    }
+    if(aro_status == REG_STATUS_PENDING) {
+      /* uip_buf holds the DAR, if one had to be sent. The NA is sent when
+       * the DAC comes back */
+      return;
+    }
+#else /* UIP_ND6_MULTIHOP_DAD */
+    aro_status = uip_ds6_nbr_register(&UIP_IP_BUF->srcipaddr,
+                                      (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+                                      &aro_eui64, aro_lifetime, REG_REGISTERED);
+#endif /* UIP_ND6_MULTIHOP_DAD */
+    if(aro_status == ARO_STATUS_SUCCESS) {
+      uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
+    } else {
+      /* The host can not use its source address: answer to the link-local
+       * address formed from its EUI-64 */
+      uip_create_linklocal_prefix(&UIP_IP_BUF->destipaddr);
+      uip_ds6_set_addr_iid(&UIP_IP_BUF->destipaddr, &aro_eui64);
+    }
+    uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr);
+    flags = UIP_ND6_NA_FLAG_SOLICITED | UIP_ND6_NA_FLAG_OVERRIDE;
+    aro_reply = 1;
+    goto send_na;
+  }
+#endif /* UIP_CONF_ROUTER */
+
+  if(nd6_opt_llao != NULL) {
 #if UIP_CONF_IPV6_CHECKS
-      /* There must be NO option in a DAD NS */
-      if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-        PRINTF("NS received is bad\n");
-        goto discard;
-      } else {
+    /* There must be NO option in a DAD NS */
+    if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+      PRINTF("NS received is bad\n");
+      goto discard;
+    } else {
 #endif /*UIP_CONF_IPV6_CHECKS */
-        nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
+      nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
 #if UIP_CONF_ROUTER      
-        if(nbr == NULL) {
-  /* Hosts only maintain NCEs for routers in 6lowpan-nd */
-          uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,
-        (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-        0, NBR_STALE);
-        } else {
+      if(nbr == NULL) {
+/* Hosts only maintain NCEs for routers in 6lowpan-nd */
+        uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,
+      (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+      0, NBR_STALE);
+      } else {
 #else
-        if(nbr != NULL) {
+      if(nbr != NULL) {
 #endif /* UIP_CONF_ROUTER */
-          if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-        &nbr->lladdr, UIP_LLADDR_LEN) != 0) {
-            memcpy(&nbr->lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-       UIP_LLADDR_LEN);
-            nbr->state = NBR_STALE;
+        if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+      &nbr->lladdr, UIP_LLADDR_LEN) != 0) {
+          memcpy(&nbr->lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+     UIP_LLADDR_LEN);
+          nbr->state = NBR_STALE;
+          UIP_DS6_TRACE_NBR(nbr);
 #if UIP_CONF_ROUTER
-    /* Hosts can not have NCEs in INCOMPLETE state in 6lowpan-nd */
-          } else {
-            if(nbr->state == NBR_INCOMPLETE) {
-              nbr->state = NBR_STALE;
-            }
-#endif /* UIP_CONF_ROUTER */
+  /* Hosts can not have NCEs in INCOMPLETE state in 6lowpan-nd */
+        } else {
+          if(nbr->state == NBR_INCOMPLETE) {
+            nbr->state = NBR_STALE;
+            UIP_DS6_TRACE_NBR(nbr);
           }
+#endif /* UIP_CONF_ROUTER */
         }
-#if UIP_CONF_IPV6_CHECKS
       }
-#endif /*UIP_CONF_IPV6_CHECKS */
-      break;
-    default:
-      PRINTF("ND option not supported in NS");
-      break;
+#if UIP_CONF_IPV6_CHECKS
     }
-    nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
+#endif /*UIP_CONF_IPV6_CHECKS */
   }
 
-  addr = uip_ds6_addr_lookup(&UIP_ND6_NS_BUF->tgtipaddr);
   if(addr != NULL) {
     if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
       goto discard;
@@ -272,7 +529,7 @@ uip_nd6_ns_input(void)
       uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
       uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr);
       flags = UIP_ND6_NA_FLAG_SOLICITED | UIP_ND6_NA_FLAG_OVERRIDE;
-      goto create_na;
+      goto send_na;
     }
 #endif /* UIP_CONF_ROUTER */
     /* NUD CASE */
@@ -280,7 +537,7 @@ uip_nd6_ns_input(void)
       uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
       uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr);
       flags = UIP_ND6_NA_FLAG_SOLICITED | UIP_ND6_NA_FLAG_OVERRIDE;
-      goto create_na;
+      goto send_na;
     } else {
 #if UIP_CONF_IPV6_CHECKS
       PRINTF("NS received is bad\n");
@@ -292,39 +549,14 @@ uip_nd6_ns_input(void)
   }
 
 
-create_na:
-  uip_ext_len = 0;
-  UIP_IP_BUF->vtc = 0x60;
-  UIP_IP_BUF->tcflow = 0;
-  UIP_IP_BUF->flow = 0;
-  UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
-  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
-  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
-  UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
-
-  UIP_ICMP_BUF->type = ICMP6_NA;
-  UIP_ICMP_BUF->icode = 0;
-
-  UIP_ND6_NA_BUF->flagsreserved = flags;
-  memcpy(&UIP_ND6_NA_BUF->tgtipaddr, &addr->ipaddr, sizeof(uip_ipaddr_t));
-
-  create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NA_LEN],
-              UIP_ND6_OPT_TLLAO);
-
-  UIP_ICMP_BUF->icmpchksum = 0;
-  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
-
-  uip_len =
-    UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_LLAO_LEN;
-
-  UIP_STAT(++uip_stat.nd6.sent);
-  PRINTF("Sending NA to");
-  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
-  PRINTF("from");
-  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
-  PRINTF("with target address");
-  PRINT6ADDR(&UIP_ND6_NA_BUF->tgtipaddr);
-  PRINTF("\n");
+send_na:
+#if UIP_CONF_ROUTER
+  /* Echo the ARO with the registration status */
+  create_na(flags, &addr->ipaddr, aro_status, aro_lifetime,
+            aro_reply ? &aro_eui64 : NULL);
+#else /* UIP_CONF_ROUTER */
+  create_na(flags, &addr->ipaddr, 0, 0, NULL);
+#endif /* UIP_CONF_ROUTER */
   return;
 
 discard:
@@ -378,7 +610,7 @@ uip_nd6_ns_output(uip_ipaddr_t * src, uip_ipaddr_t * dest, uip_ipaddr_t * tgt,
   UIP_ICMP_BUF->icmpchksum = 0;
   UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 
-  UIP_STAT(++uip_stat.nd6.sent);
+  nd6_sent();
   PRINTF("Sending NS to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("from");
@@ -389,6 +621,153 @@ uip_nd6_ns_output(uip_ipaddr_t * src, uip_ipaddr_t * dest, uip_ipaddr_t * tgt,
   return;
 }
 
+#if UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD
+/*------------------------------------------------------------------*/
+/* create a DAR or DAC in uip_buf, the caller sets the destination address */
+static void
+create_dar(u8_t type, u8_t status, u16_t lifetime, uip_lladdr_t *eui64,
+           uip_ipaddr_t *regipaddr)
+{
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = UIP_ND6_MULTIHOP_HOPLIMIT;
+  uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+
+  UIP_ICMP_BUF->type = type;
+  UIP_ICMP_BUF->icode = 0;
+  UIP_ND6_DAR_BUF->status = status;
+  UIP_ND6_DAR_BUF->reserved = 0;
+  UIP_ND6_DAR_BUF->lifetime = uip_htons(lifetime);
+  memcpy(&UIP_ND6_DAR_BUF->eui64, eui64, UIP_LLADDR_LEN);
+  uip_ipaddr_copy(&UIP_ND6_DAR_BUF->regipaddr, regipaddr);
+
+  uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_DAR_LEN;
+  UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
+  UIP_IP_BUF->len[1] = uip_len - UIP_IPH_LEN;
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  nd6_sent();
+}
+
+/*------------------------------------------------------------------*/
+void
+uip_nd6_dar_output(uip_ipaddr_t *lbr, uip_ipaddr_t *regipaddr,
+                   uip_lladdr_t *eui64, u16_t lifetime)
+{
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, lbr);
+  create_dar(ICMP6_DAR, ARO_STATUS_SUCCESS, lifetime, eui64, regipaddr);
+
+  PRINTF("Sending DAR to");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("for");
+  PRINT6ADDR(&UIP_ND6_DAR_BUF->regipaddr);
+  PRINTF("\n");
+}
+
+/*------------------------------------------------------------------*/
+void
+uip_nd6_dar_input(void)
+{
+  u8_t status;
+  u16_t lifetime;
+  uip_lladdr_t eui64;
+  uip_ipaddr_t regipaddr;
+
+  PRINTF("Received DAR from");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("for");
+  PRINT6ADDR(&UIP_ND6_DAR_BUF->regipaddr);
+  PRINTF("\n");
+  nd6_recv();
+
+#if UIP_CONF_IPV6_CHECKS
+  if((UIP_ICMP_BUF->icode != 0) ||
+     (uip_len < uip_l3_icmp_hdr_len + UIP_ND6_DAR_LEN) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_ND6_DAR_BUF->regipaddr) ||
+     uip_is_addr_unspecified(&UIP_ND6_DAR_BUF->regipaddr)) {
+    PRINTF("DAR received is bad\n");
+    uip_len = 0;
+    return;
+  }
+#endif /* UIP_CONF_IPV6_CHECKS */
+
+  /* The DAC overwrites the DAR in uip_buf */
+  lifetime = uip_ntohs(UIP_ND6_DAR_BUF->lifetime);
+  memcpy(&eui64, &UIP_ND6_DAR_BUF->eui64, UIP_LLADDR_LEN);
+  uip_ipaddr_copy(&regipaddr, &UIP_ND6_DAR_BUF->regipaddr);
+  status = uip_ds6_lbr_register(&regipaddr, &eui64, lifetime);
+
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
+  create_dar(ICMP6_DAC, status, lifetime, &eui64, &regipaddr);
+
+  PRINTF("Sending DAC to");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("with status %u\n", status);
+}
+
+/*------------------------------------------------------------------*/
+void
+uip_nd6_dac_input(void)
+{
+  u8_t status;
+  u16_t lifetime;
+  uip_lladdr_t eui64;
+  uip_ipaddr_t regipaddr;
+
+  PRINTF("Received DAC from");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("for");
+  PRINT6ADDR(&UIP_ND6_DAR_BUF->regipaddr);
+  PRINTF("\n");
+  nd6_recv();
+
+#if UIP_CONF_IPV6_CHECKS
+  if((UIP_ICMP_BUF->icode != 0) ||
+     (uip_len < uip_l3_icmp_hdr_len + UIP_ND6_DAR_LEN) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("DAC received is bad\n");
+    goto discard;
+  }
+#endif /* UIP_CONF_IPV6_CHECKS */
+
+  /* The NA overwrites the DAC in uip_buf */
+  status = UIP_ND6_DAR_BUF->status;
+  lifetime = uip_ntohs(UIP_ND6_DAR_BUF->lifetime);
+  memcpy(&eui64, &UIP_ND6_DAR_BUF->eui64, UIP_LLADDR_LEN);
+  uip_ipaddr_copy(&regipaddr, &UIP_ND6_DAR_BUF->regipaddr);
+  status = uip_ds6_dad_complete(&regipaddr, &eui64, status, lifetime);
+  if(status == REG_STATUS_PENDING) {
+    /* We did not ask for it */
+    goto discard;
+  }
+
+  /* The host registered with us through our link-local address, the one
+   * in our RAs: answer from it */
+  addr = uip_ds6_get_link_local(-1);
+  if(addr == NULL) {
+    goto discard;
+  }
+  if(status == ARO_STATUS_SUCCESS) {
+    uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &regipaddr);
+  } else {
+    uip_create_linklocal_prefix(&UIP_IP_BUF->destipaddr);
+    uip_ds6_set_addr_iid(&UIP_IP_BUF->destipaddr, &eui64);
+  }
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &addr->ipaddr);
+  create_na(UIP_ND6_NA_FLAG_SOLICITED | UIP_ND6_NA_FLAG_OVERRIDE,
+            &addr->ipaddr, status, lifetime, &eui64);
+  return;
+
+discard:
+  uip_len = 0;
+  return;
+}
+#endif /* UIP_CONF_ROUTER && UIP_ND6_MULTIHOP_DAD */
+
 
 
 /*------------------------------------------------------------------*/
@@ -402,7 +781,7 @@ uip_nd6_na_input(void)
   PRINTF("with target address");
   PRINT6ADDR((uip_ipaddr_t *) (&UIP_ND6_NA_BUF->tgtipaddr));
   PRINTF("\n");
-  UIP_STAT(++uip_stat.nd6.recv);
+  nd6_recv();
 
   /* 
    * booleans. the three last one are not 0 or 1 but 0 or 0x80, 0x40, 0x20
@@ -426,10 +805,8 @@ uip_nd6_na_input(void)
     }
     defrt = uip_ds6_defrt_lookup(&UIP_IP_BUF->srcipaddr);
     if (defrt != NULL) {
+      /* This also deletes all registrations with that router */
       uip_ds6_defrt_rm(defrt);
-      /* Since we are deleting a default router, we must delete also all
-       * registrations with that router. */
-      uip_ds6_reg_cleanup_defrt(defrt);
       /* We will also need to start sending RS, as specified in I-D.ietf-6lowpan-nd
        * for a router that has become unreachable */
       uip_ds6_send_rs(NULL);
@@ -495,50 +872,69 @@ uip_nd6_na_input(void)
                         UIP_LLADDR_LEN);
       }
       if(nd6_opt_aro != NULL) {
-        reg = uip_ds6_if.registration_in_progress;
+        UIP_ND6_STAT(ARO_STAT(aro_recv, nd6_opt_aro->status));
+        /* Find the registration this NA answers: the router is the target and
+         * the source of the NA, and the registered address its destination */
+        reg = NULL;
+        defrt = uip_ds6_defrt_lookup(&UIP_ND6_NA_BUF->tgtipaddr);
+        if((defrt != NULL) &&
+           uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &defrt->ipaddr) &&
+           (memcmp(&nd6_opt_aro->eui64, &uip_lladdr, UIP_LLADDR_LEN) == 0)) {
+          /* At most one registration per router is in progress (see
+           * UIP_DS6_MAX_REGS_IN_PROGRESS), so an error sent to our
+           * link-local address can only be for it */
+          for(reg = defrt->reg_list; reg != NULL; reg = reg->defrt_next) {
+            if(reg->in_progress &&
+               (uip_ipaddr_cmp(&reg->addr->ipaddr, &UIP_IP_BUF->destipaddr) ||
+                /* Errors are sent to our link-local address */
+                ((nd6_opt_aro->status != ARO_STATUS_SUCCESS) &&
+                 uip_is_addr_link_local(&UIP_IP_BUF->destipaddr)))) {
+              break;
+            }
+          }
+        }
         if (reg != NULL) {
           if ((nd6_opt_aro->lifetime == 0) && (reg->state == REG_TO_BE_UNREGISTERED)) {
             /* If the lifetime is 0, this means that the unregistration was successful;
              * we can delete the registration entry safely */
             uip_ds6_reg_rm(reg); /* Remove entry */
           } else {
-            addr = uip_ds6_addr_lookup(&UIP_IP_BUF->destipaddr);
+            addr = reg->addr;
             switch(nd6_opt_aro->status) {
             case ARO_STATUS_SUCCESS:
-              /* Make sure this is actually the address we are registerig */
-              if (reg->addr == addr) {
-                /* Clear the NS count */
-                addr->state = ADDR_PREFERRED;
-                reg->state = REG_REGISTERED;
-                reg->reg_count = 0;
-                stimer_set(&reg->reg_lifetime, uip_ntohs(nd6_opt_aro->lifetime) * 60);
-                uip_ds6_if.registration_in_progress = NULL;
-              }
+              /* Clear the NS count */
+              addr->state = ADDR_PREFERRED;
+              UIP_DS6_CONV_REGISTERED(addr, reg->state == REG_REGISTERED);
+              reg->state = REG_REGISTERED;
+              UIP_DS6_TRACE_REG(reg);
+              reg->reg_count = 0;
+              stimer_set(&reg->reg_lifetime, uip_ntohs(nd6_opt_aro->lifetime) * 60);
+              uip_ds6_reg_done(reg);
               break;
             case ARO_STATUS_DUPLICATE:
-              /* Remove the address */
+              /* Remove the address. Its registrations, this one included, go
+               * with it and let other registrations occur; those held by
+               * other routers are left to expire, as the address can no
+               * longer be used to withdraw them */
               uip_ds6_addr_rm(addr);
-              /* Clear registration_in_progress so that other registrations can occur */
-              uip_ds6_if.registration_in_progress = NULL;
-              /* If we have registered the address with any other router, we must void
-               * such registrations by sending a ns with ARO with 0 lifetime */
-              uip_ds6_reg_cleanup_addr(addr);
               break;
             case ARO_STATUS_RTR_NC_FULL:
                /* Remove entry. uip_ds6_periodic will try with other def. router
                 * if possible */
               uip_ds6_reg_rm(reg);
-              uip_ds6_if.registration_in_progress = NULL;
               break;
             default:
               break;
             }
           }
+          /* Registration state changed, uip_ds6_periodic() has work to do */
+          uip_ds6_reschedule(0);
         }
       }
       if(!is_override && is_llchange) {
         if(nbr->state == NBR_REACHABLE) {
           nbr->state = NBR_STALE;
+          UIP_DS6_TRACE_NBR(nbr);
         }
         goto discard;
       } else {
@@ -549,17 +945,23 @@ uip_nd6_na_input(void)
           }
           if(is_solicited) {
             nbr->state = NBR_REACHABLE;
+            UIP_DS6_TRACE_NBR(nbr);
+            UIP_DS6_QUEUE_WAKEUP();
             /* reachable time is stored in ms */
             stimer_set(&(nbr->reachable), uip_ds6_if.reachable_time / 1000);
           } else {
             if(nd6_opt_llao != 0 && is_llchange) {
               nbr->state = NBR_STALE;
+              UIP_DS6_TRACE_NBR(nbr);
             }
           }
         }
       }
     }
 
+  /* The reachable timer may have been (re)started */
+  uip_ds6_reschedule(0);
+
 discard:
   uip_len = 0;
   return;
@@ -578,7 +980,7 @@ uip_nd6_rs_input(void)
   PRINTF("to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("\n");
-  UIP_STAT(++uip_stat.nd6.recv);
+  nd6_recv();
 
 
 #if UIP_CONF_IPV6_CHECKS
@@ -607,7 +1009,7 @@ uip_nd6_rs_input(void)
 #endif /*UIP_CONF_IPV6_CHECKS */
     switch (UIP_ND6_OPT_HDR_BUF->type) {
     case UIP_ND6_OPT_SLLAO:
-      nd6_opt_llao = UIP_ND6_OPT_HDR_BUF;
+      nd6_opt_llao = (u8_t *)UIP_ND6_OPT_HDR_BUF;
       break;
     default:
       PRINTF("ND option not supported in RS\n");
@@ -626,7 +1028,7 @@ uip_nd6_rs_input(void)
       if((nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr)) == NULL) {
         /* we need to add the neighbor */
         uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,
-                        &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET], 0, NBR_STALE);
+                        (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET], 0, NBR_STALE);
       } else {
         /* If LL address changed, set neighbor state to stale */
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
@@ -634,6 +1036,7 @@ uip_nd6_rs_input(void)
           memcpy(&nbr->lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
      UIP_LLADDR_LEN);
           nbr->state = NBR_STALE;
+          UIP_DS6_TRACE_NBR(nbr);
         }
         nbr->isrouter = 0;
       }
@@ -642,8 +1045,13 @@ uip_nd6_rs_input(void)
 #endif /*UIP_CONF_IPV6_CHECKS */
   }
 
-  /* Schedule a solicited RA */
-  uip_ds6_send_ra_solicited();
+  /* Schedule a solicited RA, unicast if we know how to reach the host */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr) == NULL) {
+    uip_ds6_send_ra_solicited(NULL);
+  } else {
+    uip_ds6_send_ra_solicited(&UIP_IP_BUF->srcipaddr);
+  }
 
 discard:
   uip_len = 0;
@@ -690,7 +1098,7 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
   /* Prefix list */
   for(prefix = uip_ds6_prefix_list;
       prefix < uip_ds6_prefix_list + UIP_DS6_PREFIX_NB; prefix++) {
-    if((prefix->isused) && (prefix->advertise)) {
+    if((prefix->isused) && (prefix->advertise) && UIP_DS6_IF_MATCH(prefix)) {
       UIP_ND6_OPT_PREFIX_BUF->type = UIP_ND6_OPT_PREFIX_INFO;
       UIP_ND6_OPT_PREFIX_BUF->len = UIP_ND6_OPT_PREFIX_INFO_LEN / 8;
       UIP_ND6_OPT_PREFIX_BUF->preflen = prefix->length;
@@ -719,6 +1127,47 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
 
   uip_len += UIP_ND6_OPT_MTU_LEN;
   nd6_opt_offset += UIP_ND6_OPT_MTU_LEN;
+
+#if CONF_6LOWPAN_ND_6CO
+  /* Contexts. Those being withdrawn are advertised with a lifetime of 0 */
+  for(context = uip_ds6_addr_context_table;
+      context < uip_ds6_addr_context_table + SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS;
+      context++) {
+    if(context->state != NOT_IN_USE) {
+      UIP_ND6_OPT_6CO_BUF->type = UIP_ND6_OPT_6CO;
+      UIP_ND6_OPT_6CO_BUF->len = UIP_ND6_OPT_6CO_LEN >> 3;
+      UIP_ND6_OPT_6CO_BUF->preflen = context->length;
+      UIP_ND6_OPT_6CO_BUF->res1_c_cid = context->context_id & UIP_ND6_RA_CID;
+      if(context->state == IN_USE_COMPRESS) {
+        UIP_ND6_OPT_6CO_BUF->res1_c_cid |= UIP_ND6_RA_FLAG_COMPRESSION;
+      }
+      UIP_ND6_OPT_6CO_BUF->reserved2 = 0;
+      UIP_ND6_OPT_6CO_BUF->lifetime =
+        context->state == EXPIRED ? 0 : uip_htons(context->lifetime);
+      uip_ipaddr_copy(&UIP_ND6_OPT_6CO_BUF->prefix, &context->prefix);
+      uip_len += UIP_ND6_OPT_6CO_LEN;
+      nd6_opt_offset += UIP_ND6_OPT_6CO_LEN;
+    }
+  }
+#endif /* CONF_6LOWPAN_ND_6CO */
+
+#if CONF_6LOWPAN_ND_ABRO
+  /* Authoritative border routers, with the lifetime they have left */
+  for(abr = uip_ds6_abr_list; abr < uip_ds6_abr_list + UIP_DS6_ABR_NB; abr++) {
+    if((abr->isused) && !stimer_expired(&abr->lifetime)) {
+      UIP_ND6_OPT_ABRO_BUF->type = UIP_ND6_OPT_ABRO;
+      UIP_ND6_OPT_ABRO_BUF->len = UIP_ND6_OPT_ABRO_LEN >> 3;
+      UIP_ND6_OPT_ABRO_BUF->version_low = uip_htons(abr->version & 0xFFFF);
+      UIP_ND6_OPT_ABRO_BUF->version_high = uip_htons(abr->version >> 16);
+      UIP_ND6_OPT_ABRO_BUF->lifetime =
+        uip_htons((stimer_remaining(&abr->lifetime) + 59) / 60);
+      uip_ipaddr_copy(&UIP_ND6_OPT_ABRO_BUF->address, &abr->ipaddr);
+      uip_len += UIP_ND6_OPT_ABRO_LEN;
+      nd6_opt_offset += UIP_ND6_OPT_ABRO_LEN;
+    }
+  }
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
   UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
   UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
 
@@ -726,7 +1175,7 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
   UIP_ICMP_BUF->icmpchksum = 0;
   UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 
-  UIP_STAT(++uip_stat.nd6.sent);
+  nd6_sent();
   PRINTF("Sending RA to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("from");
@@ -734,6 +1183,81 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
   PRINTF("\n");
   return;
 }
+
+#if UIP_ND6_RA_TRICKLE
+/*---------------------------------------------------------------------------*/
+void
+uip_nd6_ra_input(void)
+{
+  /* Does the RA advertise what we advertise? */
+  u8_t consistent = 1;
+
+  PRINTF("Received RA from");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("to");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+  nd6_recv();
+
+#if UIP_CONF_IPV6_CHECKS
+  if((UIP_IP_BUF->ttl != UIP_ND6_HOP_LIMIT) ||
+     (!uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) ||
+     (UIP_ICMP_BUF->icode != 0)) {
+    PRINTF("RA received is bad");
+    goto discard;
+  }
+#endif /*UIP_CONF_IPV6_CHECKS */
+
+  nd6_opt_offset = UIP_ND6_RA_LEN;
+  while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
+    if(UIP_ND6_OPT_HDR_BUF->len == 0) {
+      PRINTF("RA received is bad");
+      goto discard;
+    }
+    switch (UIP_ND6_OPT_HDR_BUF->type) {
+    case UIP_ND6_OPT_PREFIX_INFO:
+      prefix = uip_ds6_prefix_lookup(&UIP_ND6_OPT_PREFIX_BUF->prefix,
+                                     UIP_ND6_OPT_PREFIX_BUF->preflen);
+      if(prefix == NULL || !prefix->advertise) {
+        consistent = 0;
+      }
+      break;
+#if CONF_6LOWPAN_ND_6CO
+    case UIP_ND6_OPT_6CO:
+      nd6_opt_6co = UIP_ND6_OPT_6CO_BUF;
+      context = uip_ds6_context_lookup_by_id(nd6_opt_6co->res1_c_cid & UIP_ND6_RA_CID);
+      if(context == NULL || context->length != nd6_opt_6co->preflen ||
+         !uip_ipaddr_prefixcmp(&context->prefix, &nd6_opt_6co->prefix,
+                               context->length) ||
+         ((nd6_opt_6co->res1_c_cid & UIP_ND6_RA_FLAG_COMPRESSION) != 0) !=
+         (context->state == IN_USE_COMPRESS)) {
+        consistent = 0;
+      }
+      break;
+#endif /* CONF_6LOWPAN_ND_6CO */
+#if CONF_6LOWPAN_ND_ABRO
+    case UIP_ND6_OPT_ABRO:
+      abr = uip_ds6_abr_lookup(&UIP_ND6_OPT_ABRO_BUF->address);
+      if(abr == NULL || abr->version !=
+         (((u32_t)uip_ntohs(UIP_ND6_OPT_ABRO_BUF->version_high) << 16) |
+          uip_ntohs(UIP_ND6_OPT_ABRO_BUF->version_low))) {
+        consistent = 0;
+      }
+      break;
+#endif /* CONF_6LOWPAN_ND_ABRO */
+    default:
+      break;
+    }
+    nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
+  }
+  PRINTF("RA is %sconsistent\n", consistent ? "" : "in");
+  uip_ds6_ra_trickle_heard(consistent);
+
+discard:
+  uip_len = 0;
+  return;
+}
+#endif /* UIP_ND6_RA_TRICKLE */
 #endif /* UIP_ND6_SEND_RA */
 #endif /* UIP_CONF_ROUTER */
 
@@ -772,7 +1296,7 @@ uip_nd6_rs_output(uip_ipaddr_t* rtr_ipaddr)
   UIP_ICMP_BUF->icmpchksum = 0;
   UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 
-  UIP_STAT(++uip_stat.nd6.sent);
+  nd6_sent();
   PRINTF("Sendin RS to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("from");
@@ -788,6 +1312,10 @@ uip_nd6_ra_input(void)
 {
   u8_t new_addr = 0;
   u8_t new_defrt = 0;
+#if CONF_6LOWPAN_ND_ABRO
+  /* Are the PIOs and 6COs of this RA from the newest version of the ABRO? */
+  u8_t abro_current = 1;
+#endif /* CONF_6LOWPAN_ND_ABRO */
   nd6_opt_llao = NULL;
   nd6_opt_prefix_info = NULL;
   nd6_opt_6co = NULL;
@@ -802,7 +1330,8 @@ uip_nd6_ra_input(void)
   PRINTF("to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("\n");
-  UIP_STAT(++uip_stat.nd6.recv);
+  nd6_recv();
+  uip_ds6_rs_stats.ra_received++;
 
 #if UIP_CONF_IPV6_CHECKS
   if((UIP_IP_BUF->ttl != UIP_ND6_HOP_LIMIT) ||
@@ -829,6 +1358,28 @@ uip_nd6_ra_input(void)
     uip_ds6_if.retrans_timer = uip_ntohl(UIP_ND6_RA_BUF->retrans_timer);
   }
 
+#if CONF_6LOWPAN_ND_ABRO
+  /* The ABRO may come after the options it versions: look for it first */
+  nd6_opt_offset = UIP_ND6_RA_LEN;
+  while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
+    if(UIP_ND6_OPT_HDR_BUF->len == 0) {
+      PRINTF("RA received is bad");
+      goto discard;
+    }
+    if((UIP_ND6_OPT_HDR_BUF->type == UIP_ND6_OPT_ABRO) &&
+       (UIP_ND6_OPT_HDR_BUF->len == UIP_ND6_OPT_ABRO_LEN >> 3)) {
+      PRINTF("Processing ABRO option in RA\n");
+      abro_current =
+        uip_ds6_abr_update(&UIP_ND6_OPT_ABRO_BUF->address,
+                           ((u32_t)uip_ntohs(UIP_ND6_OPT_ABRO_BUF->version_high) << 16) |
+                           uip_ntohs(UIP_ND6_OPT_ABRO_BUF->version_low),
+                           uip_ntohs(UIP_ND6_OPT_ABRO_BUF->lifetime));
+      break;
+    }
+    nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
+  }
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
   /* Options processing */
   nd6_opt_offset = UIP_ND6_RA_LEN;
   while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
@@ -850,6 +1401,7 @@ uip_nd6_ra_input(void)
   /* Hosts can not have NCEs in INCOMPLETE state in 6lowpan-nd */
         if(nbr->state == NBR_INCOMPLETE) {
           nbr->state = NBR_STALE;
+          UIP_DS6_TRACE_NBR(nbr);
         }
 #endif /* UIP_CONF_ROUTER */        
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
@@ -858,6 +1410,7 @@ uip_nd6_ra_input(void)
                   UIP_LLADDR_LEN);
 
           nbr->state = NBR_STALE;
+          UIP_DS6_TRACE_NBR(nbr);
         }
         nbr->isrouter = 1;
       }
@@ -868,6 +1421,12 @@ uip_nd6_ra_input(void)
         uip_ntohl(((uip_nd6_opt_mtu *) UIP_ND6_OPT_HDR_BUF)->mtu);
       break;
     case UIP_ND6_OPT_PREFIX_INFO:
+#if CONF_6LOWPAN_ND_ABRO
+      if(!abro_current) {
+        PRINTF("Ignoring PREFIX option from an old ABRO version\n");
+        break;
+      }
+#endif /* CONF_6LOWPAN_ND_ABRO */
       PRINTF("Processing PREFIX option in RA\n");
       nd6_opt_prefix_info = (uip_nd6_opt_prefix_info *) UIP_ND6_OPT_HDR_BUF;
       if((uip_ntohl(nd6_opt_prefix_info->validlt) >= 
@@ -961,11 +1520,20 @@ uip_nd6_ra_input(void)
       break;
 #if CONF_6LOWPAN_ND_6CO
   case UIP_ND6_OPT_6CO:
+#if CONF_6LOWPAN_ND_ABRO
+    if(!abro_current) {
+      PRINTF("Ignoring 6CO option from an old ABRO version\n");
+      break;
+    }
+#endif /* CONF_6LOWPAN_ND_ABRO */
     nd6_opt_6co = (uip_nd6_opt_6co*)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset];
     context = uip_ds6_context_lookup_by_id(nd6_opt_6co->res1_c_cid & UIP_ND6_RA_CID);
     if (context != NULL) {
       /* Context already exists. Update*/
       if (nd6_opt_6co->lifetime != 0) {
+        /* Radio threads may be decompressing with it, see
+         * UIP_DS6_CONTEXT_WRITE_BEGIN() */
+        UIP_DS6_CONTEXT_WRITE_BEGIN(context);
         context->length = nd6_opt_6co->preflen;
         uip_ipaddr_copy(&context->prefix, &nd6_opt_6co->prefix);
         if (nd6_opt_6co->res1_c_cid & UIP_ND6_RA_FLAG_COMPRESSION) {
@@ -973,6 +1541,8 @@ uip_nd6_ra_input(void)
         } else {
           context->state = IN_USE_UNCOMPRESS_ONLY;
         }
+        UIP_DS6_CONTEXT_WRITE_END(context);
+        UIP_DS6_TRACE_CONTEXT(context);
         /* Lifetime field in 6CO expressed in units of 60 seconds */
         stimer_set(&context->vlifetime, uip_ntohs(nd6_opt_6co->lifetime) * 60);
         context->defrt_lifetime = uip_ntohs(UIP_ND6_RA_BUF->router_lifetime);
@@ -993,8 +1563,8 @@ uip_nd6_ra_input(void)
 #endif /* CONF_6LOWPAN_ND_6CO */
 #if CONF_6LOWPAN_ND_ABRO
   case UIP_ND6_OPT_ABRO:
-    /* Process ABRO option */
-    break
+    /* Already processed, before the other options */
+    break;
 #endif /* CONF_6LOWPAN_ND_ABRO */
     default:
       PRINTF("ND option not supported in RA");
@@ -1024,7 +1594,8 @@ uip_nd6_ra_input(void)
       }
     }
     /* In all cases, clear RS count */
-    rscount = 0;
+    uip_ds6_rscount = 0;
+    uip_ds6_rs_suppress();
   } else { /* UIP_ND6_RA_BUF->router_lifetime == 0 */
     if(defrt != NULL) {
       uip_ds6_defrt_rm(defrt);
@@ -1051,7 +1622,7 @@ uip_nd6_ra_input(void)
     u8_t defrts = 0;
     for (defrt = uip_ds6_defrt_list;
         defrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; defrt++) {
-      if (defrt->isused) {
+      if (defrt->isused && UIP_DS6_IF_MATCH(defrt)) {
         defrts++;
       }
     }
@@ -1077,6 +1648,10 @@ uip_nd6_ra_input(void)
     }
   }
   
+  /* New lifetimes and registrations may need processing earlier than
+   * uip_ds6_periodic() was scheduled for */
+  uip_ds6_reschedule(0);
+
 discard:
   uip_len = 0;
   return;
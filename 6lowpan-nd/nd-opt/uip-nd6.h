@@ -101,6 +101,29 @@
 #define UIP_ND6_MAX_INITIAL_RAS             3   /*transmissions*/
 #define UIP_ND6_MIN_DELAY_BETWEEN_RAS       10   /*seconds*/
 #define UIP_ND6_MAX_RA_DELAY_TIME_MS        2000 /*milli seconds*/
+/* I-D.ietf-6lowpan-nd: a context is advertised with C=0 during this time
+ * before being used for compression, and before being removed */
+#define UIP_ND6_MIN_CONTEXT_CHANGE_DELAY    300  /*seconds*/
+
+/* RFC 6206 Trickle for unsolicited RAs: the interval doubles from
+ * UIP_ND6_RA_TRICKLE_IMIN up to UIP_ND6_MAX_RA_INTERVAL while nothing
+ * changes, and the RA of an interval is suppressed if
+ * UIP_ND6_RA_TRICKLE_K consistent RAs were heard before it */
+#ifndef UIP_CONF_ND6_RA_TRICKLE
+#define UIP_ND6_RA_TRICKLE                  0
+#else
+#define UIP_ND6_RA_TRICKLE UIP_CONF_ND6_RA_TRICKLE
+#endif
+#ifndef UIP_CONF_ND6_RA_TRICKLE_IMIN
+#define UIP_ND6_RA_TRICKLE_IMIN             4   /*seconds*/
+#else
+#define UIP_ND6_RA_TRICKLE_IMIN UIP_CONF_ND6_RA_TRICKLE_IMIN
+#endif
+#ifndef UIP_CONF_ND6_RA_TRICKLE_K
+#define UIP_ND6_RA_TRICKLE_K                1
+#else
+#define UIP_ND6_RA_TRICKLE_K UIP_CONF_ND6_RA_TRICKLE_K
+#endif
 /** @} */
 
 
@@ -128,6 +151,32 @@
 #define UIP_ND6_REGISTRATION_LIFETIME	60	/* In units of 60 seconds, 1 hour */
 #endif /* UIP_CONF_ND6_REGISTRATION_LIFETIME */
 
+/* Multihop DAD (I-D.ietf-6lowpan-nd): a 6LR checks each registration of a
+ * non link-local address with the 6LBR (DAR/DAC) before accepting it */
+#ifdef UIP_CONF_ND6_MULTIHOP_DAD
+#define UIP_ND6_MULTIHOP_DAD          UIP_CONF_ND6_MULTIHOP_DAD
+#else
+#define UIP_ND6_MULTIHOP_DAD          0
+#endif
+#define UIP_ND6_MULTIHOP_HOPLIMIT     64
+/* Valid lifetime of an ABRO with a lifetime field of 0 (in units of 60
+ * seconds) */
+#define UIP_ND6_ABRO_DEF_LIFETIME     10000
+/* Minimum time between two DARs for the same registration (in seconds) */
+#ifdef UIP_CONF_ND6_DAR_RETRANS_TIME
+#define UIP_ND6_DAR_RETRANS_TIME      UIP_CONF_ND6_DAR_RETRANS_TIME
+#else
+#define UIP_ND6_DAR_RETRANS_TIME      2
+#endif
+/* Control overhead accounting: ND messages and options sent and received
+ * per type (packets and bytes), ARO status outcomes, registration retries
+ * and evictions. See uip_nd6_stats_snapshot() */
+#ifdef UIP_ND6_CONF_STATS
+#define UIP_ND6_STATS                 UIP_ND6_CONF_STATS
+#else
+#define UIP_ND6_STATS                 0
+#endif
+
 /** @} */
 
 
@@ -138,6 +187,14 @@
 #define UIP_ND6_OPT_PREFIX_INFO         3
 #define UIP_ND6_OPT_REDIRECTED_HDR      4
 #define UIP_ND6_OPT_MTU                 5
+
+/* 6LoWPAN-ND message types, not in uip-icmp6.h */
+#ifndef ICMP6_DAR
+#define ICMP6_DAR                       157
+#endif
+#ifndef ICMP6_DAC
+#define ICMP6_DAC                       158
+#endif
 /* 
  * 6LoWPAN-ND option types. Note that this values are temporary and may change.
  * UIP_ND6_OPT_ARO has a value of 31 in draft-ietf-6lowpan-nd, however, Wireshark's
@@ -166,6 +223,7 @@
 #define UIP_ND6_NS_LEN                  20 
 #define UIP_ND6_RA_LEN                  12
 #define UIP_ND6_RS_LEN                  4
+#define UIP_ND6_DAR_LEN                 28
 /** @} */
 
 
@@ -175,6 +233,8 @@
 #define UIP_ND6_OPT_PREFIX_INFO_LEN    32
 #define UIP_ND6_OPT_MTU_LEN            8
 #define UIP_ND6_OPT_ARO_LEN     	   16
+#define UIP_ND6_OPT_ABRO_LEN           24
+#define UIP_ND6_OPT_6CO_LEN            24
 
 /* posible ARO status field values */
 #define ARO_STATUS_SUCCESS				0
@@ -352,6 +412,19 @@ typedef struct uip_nd6_redirect {
   uip_ipaddr_t tgtipaddress;  
   uip_ipaddr_t destipaddress;  
 } uip_nd6_redirect;
+
+/**
+ * \brief A duplicate address request or confirmation (same format)
+ *
+ * No options
+ */
+typedef struct uip_nd6_dar {
+  u8_t status;
+  u8_t reserved;
+  u16_t lifetime;
+  uip_lladdr_t eui64;
+  uip_ipaddr_t regipaddr;
+} uip_nd6_dar;
 /** @} */
 
 /**
@@ -402,6 +475,18 @@ typedef struct uip_nd6_opt_6co {
 
 #endif /* CONF_6LOWPAN_ND_6CO */
 
+#if CONF_6LOWPAN_ND_ABRO
+/** \brief ND option authoritative border router */
+typedef struct uip_nd6_opt_abro {
+  u8_t type;
+  u8_t len;
+  u16_t version_low;
+  u16_t version_high;
+  u16_t lifetime;
+  uip_ipaddr_t address;
+} uip_nd6_opt_abro ;
+#endif /* CONF_6LOWPAN_ND_ABRO */
+
 
 /** \brief ND option MTU */
 typedef struct uip_nd6_opt_mtu {
@@ -419,6 +504,55 @@ typedef struct uip_nd6_opt_redirected_hdr {
 } uip_nd6_opt_redirected_hdr;
 /** @} */
 
+/**
+ * \name ND control overhead counters
+ * @{
+ */
+/** \brief Message types, also the kinds uip_ds6_conv_stats_t counts */
+#define UIP_ND6_STATS_RS      0
+#define UIP_ND6_STATS_RA      1
+#define UIP_ND6_STATS_NS      2
+#define UIP_ND6_STATS_NA      3
+#define UIP_ND6_STATS_DAR     4
+#define UIP_ND6_STATS_DAC     5
+#define UIP_ND6_STATS_TYPES   6
+
+/** \brief A packet and byte counter. Bytes of a message count its IPv6
+ * header, bytes of an option count the option only */
+typedef struct uip_nd6_count {
+  u32_t pkts;
+  u32_t bytes;
+} uip_nd6_count_t;
+
+#if UIP_ND6_STATS
+/** \brief Options */
+#define UIP_ND6_STATS_ARO     0
+#define UIP_ND6_STATS_6CO     1
+#define UIP_ND6_STATS_ABRO    2
+#define UIP_ND6_STATS_PIO     3
+#define UIP_ND6_STATS_OPTS    4
+/** \brief ARO status outcomes: ARO_STATUS_*, then all other values */
+#define UIP_ND6_STATS_ARO_OTHER 3
+#define UIP_ND6_STATS_ARO_NB    4
+
+typedef struct uip_nd6_stats {
+  uip_nd6_count_t sent[UIP_ND6_STATS_TYPES];
+  uip_nd6_count_t recv[UIP_ND6_STATS_TYPES];
+  uip_nd6_count_t opt_sent[UIP_ND6_STATS_OPTS];
+  uip_nd6_count_t opt_recv[UIP_ND6_STATS_OPTS];
+  u32_t aro_sent[UIP_ND6_STATS_ARO_NB]; /**< statuses we answered (router) */
+  u32_t aro_recv[UIP_ND6_STATS_ARO_NB]; /**< statuses we were answered */
+  u32_t reg_retries;   /**< registration NSs sent again, unanswered */
+  u32_t reg_failures;  /**< registrations given up, router deemed gone */
+  u32_t reg_evictions; /**< registrations evicted from the full list */
+} uip_nd6_stats_t;
+
+#define UIP_ND6_STAT(s) s
+#else /* UIP_ND6_STATS */
+#define UIP_ND6_STAT(s)
+#endif /* UIP_ND6_STATS */
+/** @} */
+
 /**
  * \name ND Neighbor Cache, Router List and Prefix List handling functions
  * @{
@@ -527,6 +661,8 @@ void
  * - sender is performing NUD (ip dst = unicast)
  * - sender is performing address resolution (ip dest = solicited node mcast
  * address)
+ * - (6LR only) sender registers its address with us (ARO option, see
+ * I-D.ietf-6lowpan-nd). The NA carries the ARO back with the status.
  *
  * We do:
  * - if the tgt belongs to me, reply, otherwise ignore  
@@ -601,6 +737,36 @@ void uip_nd6_rs_input(void);
  */
 void uip_nd6_ra_output(uip_ipaddr_t *dest);
 #endif /* UIP_ND6_SEND_RA */
+
+#if UIP_ND6_MULTIHOP_DAD
+/**
+ * \brief Send a Duplicate Address Request to the 6LBR
+ * \param lbr the address of the 6LBR
+ * \param regipaddr the address the host registers
+ * \param eui64 the EUI-64 of the host (from its ARO)
+ * \param lifetime the registration lifetime (from its ARO)
+ *
+ * Only for 6LRs, on behalf of a host which sent a NS with ARO
+ */
+void uip_nd6_dar_output(uip_ipaddr_t *lbr, uip_ipaddr_t *regipaddr,
+                        uip_lladdr_t *eui64, u16_t lifetime);
+
+/**
+ * \brief Process a Duplicate Address Request
+ *
+ * Only for the 6LBR: the registration is checked against the registrations
+ * of the whole 6LoWPAN, and the DAC with the result is sent back to the 6LR
+ */
+void uip_nd6_dar_input(void);
+
+/**
+ * \brief Process a Duplicate Address Confirmation
+ *
+ * Only for 6LRs: completes the pending registration and sends the NA with
+ * ARO the host is waiting for
+ */
+void uip_nd6_dac_input(void);
+#endif /* UIP_ND6_MULTIHOP_DAD */
 #endif /*UIP_CONF_ROUTER*/
 
 /**
@@ -626,11 +792,22 @@ void uip_nd6_rs_output(uip_ipaddr_t* rtr_ipaddr);
  * - If MTU option: update MTU.
  * - If SLLAO option: update entry in neighbor cache
  * - If prefix option: start autoconf, add prefix to prefix list
+ *
+ * Routers only check whether the RA advertises the same prefixes, contexts
+ * and ABRO versions as theirs, for Trickle (UIP_ND6_RA_TRICKLE)
  */
 void
 uip_nd6_ra_input(void);
 /** @} */
 
+#if UIP_ND6_STATS
+/**
+ * \brief Copy the ND counters of the node in s, then clear them if reset
+ * is set, so that successive snapshots give the overhead of each period
+ */
+void uip_nd6_stats_snapshot(uip_nd6_stats_t *s, u8_t reset);
+#endif /* UIP_ND6_STATS */
+
 
 void
 uip_appserver_addr_get(uip_ipaddr_t *ipaddr); 
@@ -777,6 +954,46 @@ uip_appserver_addr_get(uip_ipaddr_t *ipaddr);
  *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  * 
  * 
+ * Authoritative border router option
+ *    0                   1                   2                   3
+ *    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |     Type      |  Length = 3   |          Version Low          |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |          Version High         |        Valid Lifetime         |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                               |
+ *    +                                                               +
+ *    |                                                               |
+ *    +                          6LBR Address                         +
+ *    |                                                               |
+ *    +                                                               +
+ *    |                                                               |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ *
+ * DAR and DAC message format, no options
+ *    0                   1                   2                   3
+ *    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |     Type      |     Code      |          Checksum             |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |    Status     |   Reserved    |     Registration Lifetime     |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                               |
+ *    +                            EUI-64                             +
+ *    |                                                               |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                                                               |
+ *    +                                                               +
+ *    |                                                               |
+ *    +                      Registered Address                       +
+ *    |                                                               |
+ *    +                                                               +
+ *    |                                                               |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ *
  * Redirected header option
  *
  *    0                   1                   2                   3